@@ -0,0 +1,69 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "gemini/function_registry.h"
+#include "gemini/logger.h"
+
+// Measures FunctionRegistry lookup + argument decoding + invocation throughput and the cost of
+// fetching the tool schema for a request. Does not need an API key.
+
+namespace
+{
+    template <typename Func>
+    double perSecond(size_t iterations, Func&& func)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i)
+            func(i);
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return static_cast<double>(iterations) / elapsed.count();
+    }
+}
+
+int main()
+{
+    GeminiCPP::Log::init();
+
+    constexpr size_t functionCount = 64;
+    constexpr size_t iterations = 1'000'000;
+
+    GeminiCPP::FunctionRegistry registry;
+    for (size_t i = 0; i < functionCount; ++i)
+    {
+        registry.registerFunction("convert_currency_" + std::to_string(i),
+            [](double amount, std::string from, std::string to) {
+                return nlohmann::json{{"amount", amount * 1.1}, {"from", from}, {"to", to}};
+            },
+            "Converts an amount between two currencies.", {"amount", "from", "to"});
+    }
+
+    const nlohmann::json args = {{"to", "EUR"}, {"amount", 42.0}, {"from", "USD"}};
+    const std::string name = "convert_currency_" + std::to_string(functionCount / 2);
+
+    size_t sink = 0;
+    const double invokes = perSecond(iterations, [&](size_t) {
+        auto result = registry.invoke(name, args);
+        sink += result.has_value() ? result->size() : 0;
+    });
+
+    const double lookups = perSecond(iterations, [&](size_t) {
+        sink += registry.find(name) != nullptr;
+    });
+
+    const double toolJson = perSecond(iterations, [&](size_t) {
+        sink += registry.toolJson()->size();
+    });
+
+    const double toolCopies = perSecond(iterations / 100, [&](size_t) {
+        sink += registry.getTool().functionDeclarations.size();
+    });
+
+    std::cout << "functions registered:     " << functionCount << "\n"
+              << "invoke() per second:      " << static_cast<uint64_t>(invokes) << "\n"
+              << "find() per second:        " << static_cast<uint64_t>(lookups) << "\n"
+              << "toolJson() per second:    " << static_cast<uint64_t>(toolJson) << "\n"
+              << "getTool() per second:     " << static_cast<uint64_t>(toolCopies) << "\n"
+              << "(checksum " << sink << ")\n";
+    return 0;
+}
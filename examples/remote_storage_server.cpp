@@ -0,0 +1,588 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#ifdef GEMINI_HAS_ZLIB
+#include <zlib.h>
+#endif
+
+#include <nlohmann/json.hpp>
+
+#include "gemini/internal/gzip.h"
+#include "gemini/storage.h"
+
+// A minimal stand-in for the server RemoteStorage talks to: PUT/GET/PATCH /chats/{id} and GET /chats, with
+// ETags, If-Match, If-None-Match and gzip request bodies. By default it runs a self-check driving RemoteStorage
+// through every versioning and fallback path (PATCH, 304, 404/405/412/415/501) and exits non-zero on a
+// mismatch. With --serve [port] it only serves, for trying other clients against it. Does not need an API key.
+
+namespace
+{
+#ifdef _WIN32
+    using Socket = SOCKET;
+    constexpr Socket INVALID = INVALID_SOCKET;
+    void shutdownSocket(Socket s) { ::shutdown(s, SD_BOTH); }
+    void closeSocket(Socket s) { ::closesocket(s); }
+#else
+    using Socket = int;
+    constexpr Socket INVALID = -1;
+    void shutdownSocket(Socket s) { ::shutdown(s, SHUT_RDWR); }
+    void closeSocket(Socket s) { ::close(s); }
+#endif
+
+    struct HttpRequest
+    {
+        std::string method;
+        std::string path;
+        std::map<std::string, std::string> headers; ///< Names lower-cased.
+        std::string body;
+
+        [[nodiscard]] std::string header(const std::string& name) const
+        {
+            const auto it = headers.find(name);
+            return it == headers.end() ? std::string() : it->second;
+        }
+    };
+
+    struct HttpResponse
+    {
+        int status = 200;
+        std::string etag;
+        std::string body;
+    };
+
+    const char* reasonPhrase(int status)
+    {
+        switch (status)
+        {
+        case 200: return "OK";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 409: return "Conflict";
+        case 412: return "Precondition Failed";
+        case 415: return "Unsupported Media Type";
+        case 501: return "Not Implemented";
+        default: return "Unknown";
+        }
+    }
+
+    std::optional<std::string> gunzip(const std::string& data)
+    {
+#ifdef GEMINI_HAS_ZLIB
+        z_stream stream{};
+        if (inflateInit2(&stream, 15 + 16) != Z_OK)
+            return std::nullopt;
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+        stream.avail_in = static_cast<uInt>(data.size());
+
+        std::string out;
+        char buffer[16384];
+        int status;
+        do
+        {
+            stream.next_out = reinterpret_cast<Bytef*>(buffer);
+            stream.avail_out = sizeof(buffer);
+            status = inflate(&stream, Z_NO_FLUSH);
+            if (status != Z_OK && status != Z_STREAM_END)
+            {
+                inflateEnd(&stream);
+                return std::nullopt;
+            }
+            out.append(buffer, sizeof(buffer) - stream.avail_out);
+        } while (status != Z_STREAM_END);
+        inflateEnd(&stream);
+        return out;
+#else
+        (void)data;
+        return std::nullopt;
+#endif
+    }
+
+    /**
+     * @brief In-memory chat store speaking the RemoteStorage protocol over HTTP/1.1 keep-alive connections.
+     */
+    class StandInServer
+    {
+    public:
+        std::atomic<int> patchStatus{0};      ///< Non-zero (405, 501) answers every PATCH with that status.
+        std::atomic<bool> rejectGzip{false};  ///< Answers gzip request bodies with 415.
+
+        ~StandInServer() { stop(); }
+
+        bool start(uint16_t port)
+        {
+            listener_ = ::socket(AF_INET, SOCK_STREAM, 0);
+            if (listener_ == INVALID)
+                return false;
+            int reuse = 1;
+            ::setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            address.sin_port = htons(port);
+            socklen_t length = sizeof(address);
+            if (::bind(listener_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(listener_, 16) != 0 ||
+                ::getsockname(listener_, reinterpret_cast<sockaddr*>(&address), &length) != 0)
+            {
+                closeSocket(listener_);
+                listener_ = INVALID;
+                return false;
+            }
+            port_ = ntohs(address.sin_port);
+            acceptThread_ = std::thread([this]() { acceptLoop(); });
+            return true;
+        }
+
+        void stop()
+        {
+            if (stopping_.exchange(true) || listener_ == INVALID)
+                return;
+            shutdownSocket(listener_);
+            closeSocket(listener_);
+            acceptThread_.join();
+
+            // Unblocks the connection threads; each closes its own socket.
+            std::vector<std::thread> connections;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                for (const Socket s : open_)
+                    shutdownSocket(s);
+                connections.swap(connections_);
+            }
+            for (auto& connection : connections)
+                connection.join();
+        }
+
+        [[nodiscard]] uint16_t port() const { return port_; }
+
+        /// @brief Simulates a write by another client: the stored version (and its ETag) changes.
+        void changeBehindClients(const std::string& id)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (const auto it = chats_.find(id); it != chats_.end())
+            {
+                it->second.session["name"] = "renamed elsewhere";
+                it->second.version = nextVersion_++;
+            }
+        }
+
+        void erase(const std::string& id)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            chats_.erase(id);
+        }
+
+        [[nodiscard]] std::optional<nlohmann::json> stored(const std::string& id)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            const auto it = chats_.find(id);
+            return it == chats_.end() ? std::nullopt : std::optional<nlohmann::json>(it->second.session);
+        }
+
+        /// @brief Requests served since the last call, as "METHOD /path [If-Match] [gzip] -> status".
+        [[nodiscard]] std::vector<std::string> takeLog()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return std::exchange(log_, {});
+        }
+
+    private:
+        struct Document
+        {
+            nlohmann::json session;
+            uint64_t version = 0;
+
+            [[nodiscard]] std::string etag() const { return "\"v" + std::to_string(version) + "\""; }
+        };
+
+        void acceptLoop()
+        {
+            while (!stopping_)
+            {
+                const Socket connection = ::accept(listener_, nullptr, nullptr);
+                if (connection == INVALID)
+                    continue;
+
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (stopping_)
+                {
+                    closeSocket(connection);
+                    break;
+                }
+                open_.push_back(connection);
+                connections_.emplace_back([this, connection]() {
+                    serve(connection);
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    open_.erase(std::find(open_.begin(), open_.end(), connection));
+                    closeSocket(connection);
+                });
+            }
+        }
+
+        // Serves requests on one connection until either side closes it.
+        void serve(Socket connection)
+        {
+            std::string buffer;
+            char chunk[8192];
+            auto receive = [&]() {
+                const auto received = ::recv(connection, chunk, sizeof(chunk), 0);
+                if (received <= 0)
+                    return false;
+                buffer.append(chunk, static_cast<size_t>(received));
+                return true;
+            };
+            auto sendAll = [&](const std::string& data) {
+                for (size_t sent = 0; sent < data.size();)
+                {
+                    const auto n = ::send(connection, data.data() + sent, static_cast<int>(data.size() - sent), 0);
+                    if (n <= 0)
+                        return false;
+                    sent += static_cast<size_t>(n);
+                }
+                return true;
+            };
+
+            while (true)
+            {
+                size_t headerEnd;
+                while ((headerEnd = buffer.find("\r\n\r\n")) == std::string::npos)
+                {
+                    if (!receive())
+                        return;
+                }
+
+                HttpRequest request;
+                size_t lineStart = 0;
+                for (size_t lineEnd; (lineEnd = buffer.find("\r\n", lineStart)) <= headerEnd; lineStart = lineEnd + 2)
+                {
+                    const std::string line = buffer.substr(lineStart, lineEnd - lineStart);
+                    if (lineStart == 0)
+                    {
+                        const size_t space = line.find(' ');
+                        request.method = line.substr(0, space);
+                        request.path = line.substr(space + 1, line.find(' ', space + 1) - space - 1);
+                        continue;
+                    }
+                    const size_t colon = line.find(':');
+                    if (colon == std::string::npos)
+                        continue;
+                    std::string name = line.substr(0, colon);
+                    for (char& c : name)
+                        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+                    request.headers[name] = line.substr(line.find_first_not_of(' ', colon + 1));
+                }
+                buffer.erase(0, headerEnd + 4);
+
+                if (request.header("expect") == "100-continue" && !sendAll("HTTP/1.1 100 Continue\r\n\r\n"))
+                    return;
+                const size_t length = request.headers.count("content-length") ? std::stoul(request.header("content-length")) : 0;
+                while (buffer.size() < length)
+                {
+                    if (!receive())
+                        return;
+                }
+                request.body = buffer.substr(0, length);
+                buffer.erase(0, length);
+
+                const HttpResponse response = handle(request);
+                std::string reply = "HTTP/1.1 " + std::to_string(response.status) + " " + reasonPhrase(response.status) + "\r\n";
+                if (!response.etag.empty())
+                    reply += "ETag: " + response.etag + "\r\n";
+                if (response.status != 304)
+                    reply += "Content-Type: application/json\r\nContent-Length: " + std::to_string(response.body.size()) + "\r\n";
+                reply += "\r\n";
+                if (response.status != 304)
+                    reply += response.body;
+                if (!sendAll(reply) || request.header("connection") == "close")
+                    return;
+            }
+        }
+
+        HttpResponse handle(HttpRequest request)
+        {
+            const bool gzipped = request.header("content-encoding") == "gzip";
+            const bool conditional = request.headers.count("if-match") > 0;
+            HttpResponse response = route(request, gzipped);
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            log_.push_back(request.method + " " + request.path + (conditional ? " [If-Match]" : "") + (gzipped ? " [gzip]" : "") +
+                           " -> " + std::to_string(response.status));
+            return response;
+        }
+
+        HttpResponse route(HttpRequest& request, bool gzipped)
+        {
+            if (gzipped)
+            {
+                std::optional<std::string> body;
+                if (rejectGzip || !(body = gunzip(request.body)))
+                    return {415, {}, R"({"error":{"message":"gzip bodies are not accepted"}})"};
+                request.body = std::move(*body);
+            }
+
+            const std::string prefix = "/chats";
+            if (request.path.compare(0, prefix.size(), prefix) != 0)
+                return {404, {}, R"({"error":{"message":"not found"}})"};
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (request.path == prefix)
+            {
+                if (request.method != "GET")
+                    return {405, {}, {}};
+                nlohmann::json ids = nlohmann::json::array();
+                for (const auto& [id, document] : chats_)
+                    ids.push_back(id);
+                return {200, {}, ids.dump()};
+            }
+
+            const std::string id = request.path.substr(prefix.size() + 1);
+            const auto it = chats_.find(id);
+            if (request.method == "PATCH" && patchStatus != 0)
+                return {patchStatus.load(), {}, {}};
+            if (it == chats_.end() && request.method != "PUT")
+                return {404, {}, R"({"error":{"message":"no such session"}})"};
+            const std::string ifMatch = request.header("if-match");
+            if (!ifMatch.empty() && (it == chats_.end() || it->second.etag() != ifMatch))
+                return {412, {}, R"({"error":{"message":"the session changed"}})"};
+
+            if (request.method == "GET")
+            {
+                if (request.header("if-none-match") == it->second.etag())
+                    return {304, it->second.etag(), {}};
+                return {200, it->second.etag(), it->second.session.dump()};
+            }
+
+            nlohmann::json body = nlohmann::json::parse(request.body, nullptr, false);
+            if (body.is_discarded() || !body.is_object())
+                return {400, {}, R"({"error":{"message":"invalid JSON"}})"};
+
+            if (request.method == "PUT")
+            {
+                Document& document = chats_[id];
+                document.session = std::move(body);
+                document.version = nextVersion_++;
+                return {200, document.etag(), "{}"};
+            }
+
+            if (request.method == "PATCH")
+            {
+                nlohmann::json& session = it->second.session;
+                nlohmann::json& history = session["history"];
+                if (body.value("base", size_t{0}) != history.size())
+                    return {409, {}, R"({"error":{"message":"base does not match"}})"};
+
+                for (auto& turn : body["turns"])
+                    history.push_back(std::move(turn));
+                nlohmann::json& tokens = session["turnTokens"];
+                if (!tokens.is_array())
+                    tokens = nlohmann::json::array();
+                while (tokens.size() < history.size())
+                    tokens.push_back(0);
+                for (const auto& change : body.value("tokens", nlohmann::json::array()))
+                    tokens[change[0].get<size_t>()] = change[1];
+                for (const auto& [key, value] : body.value("meta", nlohmann::json::object()).items())
+                {
+                    if (value.is_null())
+                        session.erase(key);
+                    else
+                        session[key] = value;
+                }
+                it->second.version = nextVersion_++;
+                return {200, it->second.etag(), "{}"};
+            }
+            return {405, {}, {}};
+        }
+
+        Socket listener_ = INVALID;
+        uint16_t port_ = 0;
+        std::atomic<bool> stopping_{false};
+        std::thread acceptThread_;
+
+        std::mutex mutex_;
+        std::vector<Socket> open_;
+        std::vector<std::thread> connections_;
+        std::map<std::string, Document> chats_;
+        uint64_t nextVersion_ = 1;
+        std::vector<std::string> log_;
+    };
+
+    GeminiCPP::Content makeTurn(size_t turn, size_t padding = 0)
+    {
+        return GeminiCPP::Content::fromJson({
+            {"role", turn % 2 == 0 ? "user" : "model"},
+            {"parts", {{{"text", "Turn " + std::to_string(turn) + std::string(padding, 'x')}}}}
+        });
+    }
+
+    int failures = 0;
+
+    void expect(const char* what, StandInServer& server, const std::vector<std::string>& requests, bool condition = true)
+    {
+        const auto log = server.takeLog();
+        const bool ok = condition && log == requests;
+        failures += ok ? 0 : 1;
+        std::cout << (ok ? "  ok      " : "  FAILED  ") << what << "\n";
+        for (const auto& line : log)
+            std::cout << "            " << line << "\n";
+        if (!ok && log != requests)
+        {
+            std::cout << "          expected:\n";
+            for (const auto& line : requests)
+                std::cout << "            " << line << "\n";
+        }
+    }
+
+    int selfCheck(StandInServer& server)
+    {
+        const bool gzip = GeminiCPP::Internal::gzipCompress("x").has_value();
+        const std::string url = "http://127.0.0.1:" + std::to_string(server.port());
+        GeminiCPP::RemoteStorageOptions options;
+        options.compressionThreshold = 4096;
+        GeminiCPP::RemoteStorage storage(url, "", options);
+
+        GeminiCPP::ChatSession session(nullptr, "gemini-2.5-flash", "stand-in", "a");
+        auto snapshot = session.snapshot();
+        size_t turn = 0;
+        auto save = [&](size_t padding = 0) {
+            snapshot.history.push_back(makeTurn(turn++, padding));
+            return storage.save(GeminiCPP::ChatSession::fromSnapshot(nullptr, snapshot));
+        };
+
+        std::cout << "RemoteStorage against the stand-in server at " << url << (gzip ? "" : " (built without zlib)") << "\n";
+
+        bool saved = save();
+        expect("a new session is uploaded with a blind PUT", server, {"PUT /chats/a -> 200"}, saved);
+
+        saved = save();
+        expect("a grown session is sent as a PATCH with If-Match", server, {"PATCH /chats/a [If-Match] -> 200"},
+               saved && server.stored("a")->at("history").size() == 2);
+
+        auto loaded = storage.load("a", nullptr);
+        expect("an unchanged session loads from a 304", server, {"GET /chats/a -> 304"},
+               loaded && loaded.value->historySnapshot().size() == 2);
+
+        saved = save(8192);
+        expect("a large body is gzip-compressed", server, {std::string("PATCH /chats/a [If-Match]") + (gzip ? " [gzip]" : "") + " -> 200"}, saved);
+
+        server.changeBehindClients("a");
+        saved = save();
+        expect("a session changed elsewhere is not overwritten (412)", server, {"PATCH /chats/a [If-Match] -> 412"},
+               !saved && server.stored("a")->value("name", "") == "renamed elsewhere");
+        saved = save();
+        expect("nor on the next save, before a reload", server, {"PATCH /chats/a [If-Match] -> 412"}, !saved);
+
+        loaded = storage.load("a", nullptr);
+        expect("a reload fetches the other version", server, {"GET /chats/a -> 200"}, static_cast<bool>(loaded));
+        snapshot = loaded.value->snapshot();
+        turn = snapshot.history.size();
+        saved = save();
+        expect("saves go through again after the reload", server, {"PATCH /chats/a [If-Match] -> 200"}, saved);
+
+        snapshot.history = GeminiCPP::History();
+        snapshot.turnTokens.clear();
+        saved = save();
+        expect("a rewritten history is replaced with a conditional PUT", server, {"PUT /chats/a [If-Match] -> 200"}, saved);
+
+        server.erase("a");
+        saved = save();
+        expect("a session gone from the server is uploaded again with a blind PUT (404)", server,
+               {"PATCH /chats/a [If-Match] -> 404", "PUT /chats/a -> 200"}, saved);
+
+        if (gzip)
+        {
+            server.rejectGzip = true;
+            saved = save(8192);
+            expect("a 415 resends the body uncompressed", server,
+                   {"PATCH /chats/a [If-Match] [gzip] -> 415", "PATCH /chats/a [If-Match] -> 200"}, saved);
+            saved = save(8192);
+            expect("and later bodies are not compressed", server, {"PATCH /chats/a [If-Match] -> 200"}, saved);
+        }
+
+        // PATCH support is remembered per storage: each status gets a fresh one.
+        options.compressRequests = false;
+        for (const int status : {405, 501})
+        {
+            GeminiCPP::RemoteStorage fresh(url, "", options);
+            loaded = fresh.load("a", nullptr);
+            expect("a fresh storage loads the session", server, {"GET /chats/a -> 200"}, static_cast<bool>(loaded));
+            snapshot = loaded.value->snapshot();
+            turn = snapshot.history.size();
+            server.patchStatus = status;
+            snapshot.history.push_back(makeTurn(turn++));
+            saved = fresh.save(GeminiCPP::ChatSession::fromSnapshot(nullptr, snapshot));
+            const std::string code = std::to_string(status);
+            expect(("a " + code + " to PATCH falls back to a conditional PUT").c_str(), server,
+                   {"PATCH /chats/a [If-Match] -> " + code, "PUT /chats/a [If-Match] -> 200"}, saved);
+            snapshot.history.push_back(makeTurn(turn++));
+            saved = fresh.save(GeminiCPP::ChatSession::fromSnapshot(nullptr, snapshot));
+            expect("and PATCH is not tried again", server, {"PUT /chats/a [If-Match] -> 200"}, saved);
+            server.patchStatus = 0;
+        }
+
+        const auto ids = storage.listSessions();
+        expect("sessions are listed", server, {"GET /chats -> 200"}, ids == std::vector<std::string>{"a"});
+
+        std::cout << (failures == 0 ? "All checks passed\n" : std::to_string(failures) + " checks failed\n");
+        return failures == 0 ? 0 : 1;
+    }
+}
+
+int main(int argc, char** argv)
+{
+#ifdef _WIN32
+    WSADATA wsa;
+    ::WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+
+    const bool serveOnly = argc > 1 && std::strcmp(argv[1], "--serve") == 0;
+    const uint16_t port = serveOnly && argc > 2 ? static_cast<uint16_t>(std::stoi(argv[2])) : 0;
+
+    StandInServer server;
+    if (!server.start(port))
+    {
+        std::cerr << "Cannot listen on port " << port << "\n";
+        return 1;
+    }
+
+    if (serveOnly)
+    {
+        std::cout << "Serving /chats on http://127.0.0.1:" << server.port() << " (Ctrl+C to stop)\n";
+        while (true)
+        {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            for (const auto& line : server.takeLog())
+                std::cout << line << "\n";
+            std::cout.flush();
+        }
+    }
+
+    const int result = selfCheck(server);
+    server.stop();
+#ifdef _WIN32
+    ::WSACleanup();
+#endif
+    return result;
+}
@@ -0,0 +1,81 @@
+#include <chrono>
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "gemini/internal/io_engine.h"
+#include "gemini/logger.h"
+#include "gemini/storage.h"
+
+// Measures LocalStorage saves per second: many sessions each appending one turn per save, the way
+// chats save after every turn. Durable saves group-commit their fsyncs per batch. Does not need an API key.
+
+namespace
+{
+    GeminiCPP::Content makeTurn(size_t session, size_t turn)
+    {
+        return GeminiCPP::Content::fromJson({
+            {"role", turn % 2 == 0 ? "user" : "model"},
+            {"parts", {{{"text", "Turn " + std::to_string(turn) + " of session " + std::to_string(session) + ": " + std::string(200, 'x')}}}}
+        });
+    }
+
+    double savesPerSecond(const std::filesystem::path& root, bool durable, size_t sessionCount, size_t turns)
+    {
+        std::filesystem::remove_all(root);
+
+        GeminiCPP::LocalStorageOptions options;
+        options.durable = durable;
+        GeminiCPP::LocalStorage storage(root.string(), options);
+
+        std::vector<GeminiCPP::ChatSessionSnapshot> snapshots;
+        for (size_t i = 0; i < sessionCount; ++i)
+        {
+            GeminiCPP::ChatSession session(nullptr, "gemini-2.5-flash", "bench", "bench-" + std::to_string(i));
+            storage.save(session);
+            snapshots.push_back(session.snapshot());
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        std::vector<std::future<bool>> saves;
+        for (size_t turn = 0; turn < turns; ++turn)
+        {
+            for (size_t i = 0; i < sessionCount; ++i)
+            {
+                snapshots[i].history.push_back(makeTurn(i, turn));
+                saves.push_back(storage.saveAsync(GeminiCPP::ChatSession::fromSnapshot(nullptr, snapshots[i])));
+            }
+        }
+        storage.flush();
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        size_t failed = 0;
+        for (auto& save : saves)
+            failed += save.get() ? 0 : 1;
+        if (failed > 0)
+            std::cout << "  (" << failed << " saves failed)\n";
+
+        std::filesystem::remove_all(root);
+        return static_cast<double>(saves.size()) / elapsed.count();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    GeminiCPP::Log::init();
+
+    const std::filesystem::path root = argc > 1 ? argv[1] : (std::filesystem::temp_directory_path() / "gemini-storage-bench");
+    constexpr size_t sessionCount = 200;
+    constexpr size_t turns = 20;
+
+    const double buffered = savesPerSecond(root, false, sessionCount, turns);
+    const double durable = savesPerSecond(root, true, sessionCount, turns);
+
+    std::cout << "file I/O backend:         " << (GeminiCPP::Internal::IoEngine::instance().usesIoUring() ? "io_uring" : "blocking stdio") << "\n"
+              << "sessions x turns:         " << sessionCount << " x " << turns << "\n"
+              << "saves per second:         " << static_cast<uint64_t>(buffered) << "\n"
+              << "durable saves per second: " << static_cast<uint64_t>(durable) << "\n";
+    return 0;
+}
@@ -0,0 +1,70 @@
+﻿#pragma once
+
+#ifndef GEMINI_APIS_CACHES_H
+#define GEMINI_APIS_CACHES_H
+
+#include <string>
+#include "gemini/response.h"
+#include "gemini/duration.h"
+#include "gemini/types/caching_api_types.h"
+
+namespace GeminiCPP
+{
+    class Client;
+
+    /**
+     * @brief Provides methods to manage cached contents on the server.
+     * * Cached contents can be referenced from generation requests to avoid re-sending
+     * large, reused contexts. Each cache has a time-to-live after which the server deletes it.
+     */
+    class Caches
+    {
+    public:
+        /**
+         * @brief Constructs a new Caches API module.
+         * @param client Pointer to the main Client instance.
+         */
+        explicit Caches(Client* client);
+
+        /**
+         * @brief Creates a new cached content resource.
+         * @param content The content, model and ttl to cache.
+         * @return Result<CachedContent> containing the created resource (name, expireTime, usage).
+         */
+        Result<CachedContent> create(const CachedContent& content);
+
+        /**
+         * @brief Retrieves metadata for a cached content.
+         * @param name The resource name (e.g., "cachedContents/abc-123").
+         */
+        Result<CachedContent> get(const std::string& name);
+
+        /**
+         * @brief Lists cached contents.
+         * @param pageSize Maximum number of caches to return (default 50).
+         * @param pageToken Token for the next page of results.
+         */
+        Result<ListCachedContentsResponse> list(int pageSize = 50, const std::string& pageToken = "");
+
+        /**
+         * @brief Updates the time-to-live of a cached content.
+         * @details The new expiration is computed by the server as now + ttl.
+         * @param name The resource name of the cache.
+         * @param ttl The new time-to-live.
+         * @return Result<CachedContent> containing the updated resource (with the new expireTime).
+         */
+        Result<CachedContent> updateTtl(const std::string& name, const Duration& ttl);
+
+        /**
+         * @brief Deletes a cached content from the server.
+         * @param name The resource name of the cache.
+         * @return Result<bool> true if deletion was successful.
+         */
+        Result<bool> deleteCache(const std::string& name);
+
+    private:
+        Client* client_;
+    };
+}
+
+#endif // GEMINI_APIS_CACHES_H
@@ -0,0 +1,122 @@
+﻿#pragma once
+
+#ifndef GEMINI_BLOB_STORE_H
+#define GEMINI_BLOB_STORE_H
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <nlohmann/json.hpp>
+
+#include "history.h"
+
+namespace GeminiCPP
+{
+    /**
+     * @brief Content-addressed store for large binary payloads (images, audio, documents).
+     * * Blobs are immutable and keyed by the hex SHA-256 of their bytes, so storing the same payload twice
+     * (e.g. an image shared by several sessions, or re-saved on every compaction) keeps a single copy.
+     */
+    class IBlobStore
+    {
+    public:
+        virtual ~IBlobStore() = default;
+
+        /**
+         * @brief Stores raw bytes.
+         * @return The key of the blob, or nullopt if it could not be stored.
+         */
+        [[nodiscard]] virtual std::optional<std::string> put(std::string_view bytes) = 0;
+
+        /**
+         * @brief Reads a blob back.
+         * @return The raw bytes, or nullopt if the key is unknown or unreadable.
+         */
+        [[nodiscard]] virtual std::optional<std::string> get(const std::string& key) = 0;
+
+        /**
+         * @brief Checks whether a blob is present.
+         */
+        [[nodiscard]] virtual bool contains(const std::string& key) = 0;
+    };
+
+    /**
+     * @brief IBlobStore keeping each blob as a raw binary file under <root>/<first 2 hex digits>/<key>.
+     * @details Writes are atomic, so a concurrent or interrupted put never leaves a partial blob behind.
+     * Blobs are never deleted by the library.
+     */
+    class LocalBlobStore : public IBlobStore
+    {
+    public:
+        /**
+         * @param rootPath Directory holding the blobs. Can be shared by several storages and processes.
+         * @param durable fsync every new blob before put() returns.
+         */
+        explicit LocalBlobStore(std::string rootPath = "blobs", bool durable = false);
+
+        [[nodiscard]] std::optional<std::string> put(std::string_view bytes) override;
+        [[nodiscard]] std::optional<std::string> get(const std::string& key) override;
+        [[nodiscard]] bool contains(const std::string& key) override;
+
+    private:
+        [[nodiscard]] std::optional<std::filesystem::path> blobPath(const std::string& key) const;
+
+        std::filesystem::path rootPath_;
+        bool durable_;
+    };
+
+    /**
+     * @brief Which inline payloads a storage moves out of session files.
+     */
+    struct BlobOffloadPolicy
+    {
+        std::shared_ptr<IBlobStore> store; ///< Disabled when null.
+        size_t minBytes = 64 * 1024;       ///< Only base64 payloads at least this long are offloaded.
+
+        [[nodiscard]] bool enabled() const { return store != nullptr; }
+    };
+
+    /**
+     * @brief Replaces large inline base64 payloads of serialized turns with references into an IBlobStore.
+     * * An offloaded "inlineData" object keeps its mimeType and trades "data" for "blobRef" (the blob key)
+     * and "blobSize" (the decoded size). The blob holds the raw bytes, a quarter smaller than the base64
+     * and never parsed as part of a session file.
+     * * Turns read back with references are appended to the history lazily (see History::push_back_lazy()):
+     * their blobs are only fetched and re-encoded when the turn is first used, typically when the next
+     * request is built.
+     */
+    class BlobOffload
+    {
+    public:
+        /**
+         * @brief Offloads the eligible payloads found anywhere in j, in place.
+         * @details Payloads that cannot be stored, or whose base64 would not round-trip exactly, stay inline.
+         * @return true if at least one payload was replaced.
+         */
+        static bool offload(nlohmann::json& j, const BlobOffloadPolicy& policy);
+
+        /**
+         * @brief Checks whether j contains blob references.
+         */
+        [[nodiscard]] static bool hasReferences(const nlohmann::json& j);
+
+        /**
+         * @brief Replaces the blob references found in j with the inline base64 data, in place.
+         * @details A blob that cannot be read is logged and its reference is left in place.
+         * @return false if a blob could not be read.
+         */
+        static bool rehydrate(nlohmann::json& j, IBlobStore& store);
+
+        /**
+         * @brief Appends a serialized turn to a history, lazily if it references blobs.
+         * @details If a blob cannot be read when the turn is first used, the turn keeps its references (so
+         * rewriting the session preserves them) and the read is retried on the next use.
+         */
+        static void appendTurn(History& history, nlohmann::json turn, const std::shared_ptr<IBlobStore>& store);
+    };
+}
+
+#endif // GEMINI_BLOB_STORE_H
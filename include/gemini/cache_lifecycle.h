@@ -0,0 +1,126 @@
+﻿#pragma once
+
+#ifndef GEMINI_CACHE_LIFECYCLE_H
+#define GEMINI_CACHE_LIFECYCLE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "duration.h"
+#include "cache_registry.h"
+
+namespace GeminiCPP
+{
+    class Client;
+    struct GenerationResult;
+
+    /**
+     * @brief Tuning knobs for the CacheLifecycleManager.
+     */
+    struct CacheLifecyclePolicy
+    {
+        std::chrono::seconds sweepInterval{60};      ///< How often the background thread inspects the registry.
+        std::chrono::seconds renewBefore{300};       ///< Hot caches expiring within this window get their TTL extended.
+        Duration renewTtl = Duration::fromMinutes(60); ///< TTL applied when extending a hot cache.
+        std::chrono::seconds hotWindow{900};         ///< A cache is hot if it was hit within this window.
+        double minHitRate = 0.5;                     ///< A cache also needs at least this hit rate to be considered hot.
+        std::chrono::seconds coldAfter{1800};        ///< A cache with no hit for this long is cold.
+        bool deleteCold = true;                      ///< Whether cold caches are deleted from the server (and unregistered).
+    };
+
+    /**
+     * @brief Usage counters tracked per registered cache alias.
+     */
+    struct CacheUsageStats
+    {
+        uint64_t hits = 0;          ///< Requests that reported cachedContentTokenCount > 0.
+        uint64_t misses = 0;        ///< Requests that referenced the cache but reported no cached tokens.
+        uint64_t cachedTokens = 0;  ///< Sum of cachedContentTokenCount over all hits.
+        std::chrono::steady_clock::time_point firstSeen{};  ///< When the manager first saw the alias.
+        std::chrono::steady_clock::time_point lastHit{};    ///< Time of the most recent hit (epoch if never).
+
+        [[nodiscard]] double hitRate() const;
+    };
+
+    /**
+     * @brief Keeps the caches of a CacheRegistry alive while they are used and removes them once they are not.
+     * * A background thread periodically sweeps the registry:
+     * * - Aliases whose expireTime has passed (or whose cache no longer exists on the server) are unregistered.
+     * * - Hot caches (recent hits, good hit rate) that are close to expiring get their TTL extended.
+     * * - Cold caches (no hit for CacheLifecyclePolicy::coldAfter) are deleted from the server and unregistered.
+     * * Hits are reported through recordUsage(), typically right after a generation that referenced the cache.
+     */
+    class CacheLifecycleManager
+    {
+    public:
+        /**
+         * @brief Constructs the manager. The background thread is not started until start() is called.
+         * @param client Client used to update and delete caches. Must outlive the manager.
+         * @param registry The registry to manage. Must outlive the manager.
+         * @param policy Lifecycle policy.
+         */
+        CacheLifecycleManager(Client* client, CacheRegistry& registry, CacheLifecyclePolicy policy = {});
+
+        CacheLifecycleManager(const CacheLifecycleManager&) = delete;
+        CacheLifecycleManager& operator=(const CacheLifecycleManager&) = delete;
+
+        ~CacheLifecycleManager();
+
+        /**
+         * @brief Starts the background sweep thread. Does nothing if already running.
+         */
+        void start();
+
+        /**
+         * @brief Stops the background sweep thread and waits for it to exit.
+         */
+        void stop();
+
+        /**
+         * @brief Runs a single sweep synchronously on the calling thread.
+         */
+        void sweep();
+
+        /**
+         * @brief Records the outcome of a request that referenced a cache.
+         * @param alias The registry alias of the cache.
+         * @param cachedContentTokenCount usageMetadata.cachedContentTokenCount reported for the request.
+         */
+        void recordUsage(const std::string& alias, int cachedContentTokenCount);
+
+        /**
+         * @brief Convenience overload reading the cached token count from a GenerationResult.
+         */
+        void recordUsage(const std::string& alias, const GenerationResult& result);
+
+        /**
+         * @brief Returns the usage counters of an alias (zeroed if the alias is unknown).
+         */
+        [[nodiscard]] CacheUsageStats stats(const std::string& alias) const;
+
+        void setPolicy(const CacheLifecyclePolicy& policy);
+        [[nodiscard]] CacheLifecyclePolicy getPolicy() const;
+
+    private:
+        void run();
+        void renew(const CachedItemInfo& info);
+        void drop(const CachedItemInfo& info, bool deleteRemote);
+
+        Client* client_;
+        CacheRegistry& registry_;
+        CacheLifecyclePolicy policy_;
+        std::unordered_map<std::string, CacheUsageStats> stats_;
+
+        std::thread worker_;
+        bool running_ = false;
+        mutable std::mutex mutex_;
+        std::condition_variable cv_;
+    };
+}
+
+#endif // GEMINI_CACHE_LIFECYCLE_H
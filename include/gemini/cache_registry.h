@@ -6,7 +6,13 @@
 #include <string>
 #include <vector>
 #include <optional>
+#include <chrono>
 #include <filesystem>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <unordered_map>
 #include <nlohmann/json.hpp>
 #include "types/caching_api_types.h"
 
@@ -23,14 +29,39 @@ namespace GeminiCPP
         std::string model;        ///< The model this cache is compatible with.
         std::string expireTime;   ///< Expiration timestamp.
 
+        /**
+         * @brief Parses expireTime (RFC 3339) into a time point.
+         * @return The expiration time, or nullopt if expireTime is empty or malformed.
+         */
+        [[nodiscard]] std::optional<std::chrono::system_clock::time_point> expiresAt() const;
+
         [[nodiscard]] nlohmann::json toJson() const;
         [[nodiscard]] static CachedItemInfo fromJson(const nlohmann::json& j);
     };
 
+    /**
+     * @brief Persistence options for CacheRegistry.
+     */
+    struct CacheRegistryOptions
+    {
+        /// @brief Write-behind window. Mutations within this window are coalesced into a single file write.
+        std::chrono::milliseconds flushDelay{200};
+        
+        /// @brief Guards the registry file with an inter-process lock and merges concurrent changes from
+        /// other processes on every flush. Enable when several processes share the same registry file.
+        bool processLock = false;
+
+        /// @brief Upper bound of the backoff between retries of a failed write (which starts at flushDelay).
+        std::chrono::milliseconds maxRetryDelay{30000};
+    };
+
     /**
      * @brief Manages a local registry of cached content.
      * * Allows developers to map friendly names (aliases) to complex server-side IDs.
      * * The registry is persisted to a JSON file (default: "gemini_caches.json").
+     * * Lookups are served from an in-memory map under a shared lock, so the registry can be queried from
+     * every request thread. Mutations are persisted asynchronously by a write-behind flusher that batches
+     * them and replaces the file atomically (temp file + fsync + rename).
      */
     class CacheRegistry
     {
@@ -38,8 +69,18 @@ namespace GeminiCPP
         /**
          * @brief Constructs a CacheRegistry.
          * @param registryPath Path to the JSON file where the registry is stored.
+         * @param options Persistence options.
          */
-        explicit CacheRegistry(std::string registryPath = "gemini_caches.json");
+        explicit CacheRegistry(std::string registryPath = "gemini_caches.json", CacheRegistryOptions options = {});
+
+        CacheRegistry(const CacheRegistry&) = delete;
+        CacheRegistry& operator=(const CacheRegistry&) = delete;
+
+        /**
+         * @brief Flushes pending mutations and stops the flusher.
+         * @details A failing write is retried a few more times before the remaining mutations are given up.
+         */
+        ~CacheRegistry();
 
         /**
          * @brief Registers a new cache entry.
@@ -47,6 +88,13 @@ namespace GeminiCPP
          * @param content The CachedContent object returned from the API.
          */
         void registerCache(const std::string& alias, const CachedContent& content);
+
+        /**
+         * @brief Replaces an entry with newer server metadata (e.g. after a TTL update), if it still names the same cache.
+         * @param expectedId The cache ID the alias was read with.
+         * @return false if the alias was removed or now refers to another cache; nothing is changed then.
+         */
+        bool updateCache(const std::string& alias, const std::string& expectedId, const CachedContent& content);
         
         /**
          * @brief Retrieves the server ID associated with an alias.
@@ -71,12 +119,40 @@ namespace GeminiCPP
          */
         [[nodiscard]] std::vector<std::string> listAliases() const;
 
+        /**
+         * @brief Blocks until every mutation made before the call has been written to disk.
+         * @return false if the write failed; the mutations stay queued and are retried in the background.
+         */
+        bool flush();
+
     private:
+        using PendingOps = std::unordered_map<std::string, std::optional<CachedItemInfo>>;
+        
         std::string registryPath_;
-        nlohmann::json registry_;
+        CacheRegistryOptions options_;
+        
+        std::unordered_map<std::string, CachedItemInfo> entries_;
+        mutable std::shared_mutex entriesMutex_;
+
+        // Write-behind state
+        PendingOps pending_; // alias -> new value (nullopt = erased)
+        uint64_t mutationSeq_ = 0;
+        uint64_t persistedSeq_ = 0;
+        uint64_t failedSeq_ = 0;    // Mutations up to here were in the last failed write (and are queued for retry).
+        uint64_t failedWrites_ = 0;
+        bool flushRequested_ = false;
+        bool stopping_ = false;
+        std::mutex flushMutex_;
+        std::condition_variable flushCv_;
+        std::condition_variable persistedCv_;
+        std::thread flusher_;
 
-        void load();
-        void save() const;
+        bool load(); // false if the process lock could not be taken.
+        void enqueue(const std::string& alias, std::optional<CachedItemInfo> info);
+        void flushLoop();
+        bool persist(PendingOps& ops);
+        [[nodiscard]] std::unordered_map<std::string, CachedItemInfo> readFromDisk() const;
+        [[nodiscard]] static std::string serialize(const std::unordered_map<std::string, CachedItemInfo>& entries);
     };
 }
 
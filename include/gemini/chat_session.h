@@ -1,22 +1,54 @@
-#pragma once
+﻿#pragma once
 
 #ifndef GEMINI_CHAT_SESSION_H
 #define GEMINI_CHAT_SESSION_H
 
 #include <future>
+#include <memory>
 #include <vector>
 #include <string>
 #include <mutex>
+#include <optional>
+#include <cstdint>
 
 #include "generation_method.h"
 #include "response.h"
 #include "function_registry.h"
+#include "function_executor.h"
+#include "history.h"
+#include "context_window.h"
+#include "history_compaction.h"
+#include "serial_executor.h"
 #include "support.h"
 
 namespace GeminiCPP
 {
     class Client; 
 
+    /**
+     * @brief Point-in-time copy of the persistent state of a ChatSession.
+     * @details Cheap to take: the history is shared with the session, not copied. Storage backends use it to
+     * serialize a session outside of its lock, or to write only what changed since an earlier snapshot.
+     */
+    struct ChatSessionSnapshot
+    {
+        std::string id;
+        std::string name;
+        std::string model;
+        std::string systemInstruction;
+        History history;
+        std::vector<int> turnTokens;
+        HistorySummary summary;
+        std::string parentId;           ///< Session this one was forked from (empty if none).
+        std::vector<size_t> forkPoints; ///< History size at each fork in this session's lineage, oldest first.
+
+        /**
+         * @brief Same format as ChatSession::toJson().
+         */
+        [[nodiscard]] nlohmann::json toJson() const;
+        [[nodiscard]] static ChatSessionSnapshot fromJson(const nlohmann::json& j);
+    };
+
     /**
      * @brief Manages a multi-turn conversation with the Gemini model.
      * * This class maintains the history of the conversation, handles function calling loops
@@ -35,14 +67,24 @@ namespace GeminiCPP
          */
         ChatSession(Client* client, std::string_view model, std::string sessionName = "", std::string sessionId = "");
         
+        /**
+         * @brief Copies every setting and the history; the copy keeps the session ID (see fork()).
+         * @details Cheap: the history turns, tools and registered functions are shared until either side
+         * changes them.
+         */
         ChatSession(const ChatSession& other);
         ChatSession& operator=(const ChatSession& other);
 
-        ~ChatSession() = default;
+        /**
+         * @brief Waits for a running history compaction before destroying the session.
+         */
+        ~ChatSession();
         
         /**
          * @brief Sends a structured content message to the chat.
          * @details Updates history and handles potential function call loops if auto-reply is enabled.
+         * Turns of one session never interleave: a send() or stream() started while another is running
+         * waits for it to finish.
          * @param content The content to send.
          * @return GenerationResult containing the model's response.
          */
@@ -57,6 +99,8 @@ namespace GeminiCPP
 
         /**
          * @brief Streams the response for a structured content message.
+         * @details With auto-reply enabled, function calls are dispatched as soon as they arrive in the stream
+         * and their responses are sent back in a new streamed turn, like send() does.
          * @param content The content to send.
          * @param callback The function to call for each received chunk.
          * @return GenerationResult containing the aggregated response.
@@ -71,16 +115,61 @@ namespace GeminiCPP
          */
         [[nodiscard]] GenerationResult stream(const std::string& text, const StreamCallback& callback);
 
-        // Async versions
+        /**
+         * @name Async versions
+         * Queued on the session's turn queue: async turns of one session run one at a time, in call order,
+         * while different sessions run in parallel on the turn pool (see setTurnExecutor()). A turn cancelled
+         * before it starts (cancelQueuedTurns(), or destroying the session) completes with a CANCELLED failure.
+         */
         [[nodiscard]] std::future<GenerationResult> sendAsync(const Content& content);
         [[nodiscard]] std::future<GenerationResult> sendAsync(const std::string& text);
         [[nodiscard]] std::future<GenerationResult> streamAsync(const Content& content, const StreamCallback& callback);
         [[nodiscard]] std::future<GenerationResult> streamAsync(const std::string& text, const StreamCallback& callback);
 
+        /**
+         * @brief Sets the pool where queued async turns run.
+         * @param pool nullptr uses SerialExecutor::defaultPool(); must outlive the session.
+         */
+        void setTurnExecutor(ThreadPool* pool);
+
+        /**
+         * @brief Number of async turns waiting behind the running one.
+         */
+        [[nodiscard]] size_t queuedTurns() const;
+
+        /**
+         * @brief Cancels the async turns that have not started yet.
+         * @return The number of turns cancelled.
+         */
+        size_t cancelQueuedTurns();
+
+        [[nodiscard]] SerialExecutorStats turnQueueStats() const;
+
+        /**
+         * @brief Starts a branch of the conversation at its current point.
+         * @details The branch gets every setting of this session and shares its history: O(1) in time and
+         * memory, and later turns on either side are copy-on-write. The fork is recorded in the snapshot, so
+         * LocalStorage with a blob store keeps the shared prefix once and each branch costs only its own turns.
+         * Queued async turns and a running compaction are not carried over.
+         * @param sessionName Name of the branch; empty keeps this session's name.
+         * @param sessionId ID of the branch; empty generates one.
+         */
+        [[nodiscard]] ChatSession fork(std::string sessionName = "", std::string sessionId = "") const;
+
         /**
          * @brief Gets the unique session ID.
          */
         [[nodiscard]] std::string getId() const;
+
+        /**
+         * @brief ID of the session this one was forked from (empty if it was not forked).
+         */
+        [[nodiscard]] std::string getParentId() const;
+
+        /**
+         * @brief Number of leading history turns shared with the parent (0 if not forked).
+         */
+        [[nodiscard]] size_t getForkPoint() const;
         
         /**
          * @brief Updates the model used for this session.
@@ -128,20 +217,37 @@ namespace GeminiCPP
          * @param func The function implementation.
          * @param doc A description of what the function does.
          * @param argNames The names of the function arguments.
+         * @param options Optional deadline and concurrency limit (see FunctionOptions).
          */
         template <typename Func>
-        void registerFunction(const std::string& name, Func&& func, const std::string& doc, const std::vector<std::string>& argNames)
+        void registerFunction(const std::string& name, Func&& func, const std::string& doc, const std::vector<std::string>& argNames,
+                              FunctionOptions options = {})
         {
             std::lock_guard<std::mutex> lock(mutex_);
-            functionRegistry_.registerFunction(name, std::forward<Func>(func), doc, argNames);
+            functionRegistry_.registerFunction(name, std::forward<Func>(func), doc, argNames, options);
+            toolsJson_.reset();
         }
 
+        /**
+         * @brief Registers a function executed by long-lived worker processes.
+         * @see FunctionRegistry::registerWorkerFunction
+         */
+        void registerWorkerFunction(FunctionDeclaration declaration, ToolWorkerOptions workerOptions, FunctionOptions options = {});
+
         /**
          * @brief Enables or disables automatic execution of function calls.
          * @param enabled If true, the client executes tool calls and sends results back automatically.
          */
         void setAutoReply(bool enabled);
         
+        /**
+         * @brief Controls how the function calls of one model turn are executed during auto-reply.
+         * @details Calls run concurrently on the policy's executor (up to maxParallelism at a time), each
+         * limited by callTimeout. Their responses are sent back in call order, matched by FunctionCall::id.
+         */
+        void setFunctionExecutionPolicy(const FunctionExecutionPolicy& policy);
+        [[nodiscard]] FunctionExecutionPolicy getFunctionExecutionPolicy() const;
+
         /**
          * @brief Sets the maximum number of consecutive function call turns allowed.
          * @param maxTurns Maximum turns (default 10) to prevent infinite loops.
@@ -149,6 +255,34 @@ namespace GeminiCPP
         void setMaxFunctionCallTurns(int maxTurns);
         [[nodiscard]] int getMaxFunctionCallTurns() const;
         
+        /**
+         * @brief Limits the history sent with each request to a token budget.
+         * @details Only the request is trimmed; the stored history keeps every turn. Turn sizes come from the
+         * usageMetadata of earlier responses and fall back to an estimate for turns that were never measured.
+         */
+        void setContextPolicy(const ContextWindowPolicy& policy);
+        [[nodiscard]] ContextWindowPolicy getContextPolicy() const;
+
+        /**
+         * @brief Enables background compaction of old turns into a model-written summary.
+         * @details When the history that would be sent exceeds CompactionPolicy::triggerTokens, the older turns
+         * (after the pinned ones, before the most recent ones) are summarized on the policy's executor.
+         * Sends never wait for it; once the summary is ready it replaces those turns in the requests, while
+         * history() and toJson() keep every raw turn.
+         */
+        void setCompactionPolicy(const CompactionPolicy& policy);
+        [[nodiscard]] CompactionPolicy getCompactionPolicy() const;
+
+        /**
+         * @brief Returns the summary currently standing in for older turns (empty if none).
+         */
+        [[nodiscard]] HistorySummary getHistorySummary() const;
+
+        /**
+         * @brief Blocks until the compaction in flight, if any, has finished.
+         */
+        void waitForCompaction() const;
+
         /**
          * @brief Clears the conversation history. System instructions are preserved.
          */
@@ -156,17 +290,42 @@ namespace GeminiCPP
         
         /**
          * @brief Retrieves the current conversation history.
+         * @note Deep-copies every turn. Prefer historySnapshot() when the turns are only read.
          */
         [[nodiscard]] std::vector<Content> history() const;
+
+        /**
+         * @brief Retrieves an O(1) snapshot of the conversation history.
+         * @details The snapshot shares its turns with the session and is not affected by later sends.
+         */
+        [[nodiscard]] History historySnapshot() const;
         
         // Serialization
         [[nodiscard]] nlohmann::json toJson() const;
+        [[nodiscard]] ChatSessionSnapshot snapshot() const;
+
+        /**
+         * @brief Restores a session from a snapshot, sharing (not copying) its history.
+         * @details Lazily loaded turns stay undecoded until the session needs them.
+         */
+        [[nodiscard]] static ChatSession fromSnapshot(Client* client, ChatSessionSnapshot snapshot);
         [[nodiscard]] static ChatSession fromJson(Client* client, const nlohmann::json& j);
 
     private:
         [[nodiscard]] GenerationResult sendInternal();
-        [[nodiscard]] GenerationResult streamInternal(const StreamCallback& callback);
-        [[nodiscard]] std::vector<Tool> getCombinedTools() const;
+        [[nodiscard]] GenerationResult streamInternal(const StreamCallback& callback, const StreamPartCallback& onPart);
+        [[nodiscard]] std::shared_ptr<const std::string> getCombinedToolsJson() const; // expects mutex_ to be held
+        [[nodiscard]] std::future<GenerationResult> enqueueTurn(std::function<GenerationResult()> turn);
+        void copyFrom(const ChatSession& other); // Everything but the ID and the turn queue; expects other.mutex_ (and mutex_) to be held.
+
+        // These expect mutex_ to be held.
+        void appendTurn(Content content, int tokens = 0);
+        void recordUsage(const std::vector<size_t>& sentTurns, int summaryTokens, uint64_t epoch, const GenerationResult& result);
+        [[nodiscard]] ContextWindowSelection selectContext() const;
+        [[nodiscard]] std::optional<Content> buildSystemInstruction() const;
+        void maybeStartCompaction();
+
+        void runCompaction(History snapshot, HistorySummary previous, size_t begin, size_t end, uint64_t epoch, CompactionPolicy policy);
 
         Client* client_;
         std::string model_;
@@ -174,16 +333,32 @@ namespace GeminiCPP
         std::string sessionName_;
         std::string systemInstruction_;
         std::string cachedContent_;
-        std::vector<Content> history_;
-        std::vector<Tool> tools_;
+        History history_;
+        std::vector<int> turnTokens_; // Tracked token count per history turn (0 = unknown).
+        ContextWindowPolicy contextPolicy_;
+        CompactionPolicy compactionPolicy_;
+        HistorySummary summary_;
+        uint64_t historyEpoch_ = 0; // Bumped whenever the history is replaced, so stale summaries and token usage are discarded.
+        bool compactionRunning_ = false;
+        std::shared_future<void> compactionTask_;
+        std::shared_ptr<const std::vector<Tool>> tools_; // Copy-on-write, shared by copies and forks.
         FunctionRegistry functionRegistry_;
+        mutable std::shared_ptr<const std::string> toolsJson_; // Serialized tools_ + registry tool, reset when either changes.
+        FunctionExecutionPolicy functionExecutionPolicy_;
         bool autoReply_ = true;
         int maxFunctionCallTurns_ = 10;
 
         GenerationConfig config_;
         std::vector<SafetySetting> safetySettings_;
 
+        ThreadPool* turnExecutor_ = nullptr;
+
+        std::string parentId_;
+        std::vector<size_t> forkPoints_; // Lineage of fork points, oldest first; cleared with the history.
+
         mutable std::mutex mutex_;
+        std::mutex turnMutex_; // Held for the whole of a send() or stream(), so turns never interleave.
+        std::unique_ptr<SerialExecutor> turnQueue_; // Created by the first async turn; guarded by mutex_.
     };
 }
 #endif
\ No newline at end of file
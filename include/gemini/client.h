@@ -18,6 +18,7 @@
 #include "apis/files.h"
 #include "apis/models.h"
 #include "apis/tokens.h"
+#include "apis/caches.h"
 
 namespace GeminiCPP
 {
@@ -62,6 +63,11 @@ namespace GeminiCPP
          */
         Tokens tokens;
 
+        /**
+         * @brief Module for Caching API operations (create, update ttl, delete cached contents).
+         */
+        Caches caches;
+
         // --- CORE GENERATION METHODS ---
 
         /**
@@ -79,9 +85,11 @@ namespace GeminiCPP
          * * @param model The model identifier.
          * @param request The structured request body.
          * @param callback A function to handle incoming string chunks.
-         * @return GenerationResult containing the final accumulated content and usage metadata.
+         * @param onPart Optional. Invoked for every non-text part (e.g. a function call) as soon as it arrives.
+         * @return GenerationResult containing the final accumulated content (all part types) and usage metadata.
          */
-        [[nodiscard]] GenerationResult streamGenerateContent(const std::string& model, const StreamGenerateContentRequestBody& request, const StreamCallback& callback);
+        [[nodiscard]] GenerationResult streamGenerateContent(const std::string& model, const StreamGenerateContentRequestBody& request, const StreamCallback& callback,
+                                                             const StreamPartCallback& onPart = nullptr);
 
         // --- CONVENIENCE OVERLOADS ---
 
@@ -189,6 +197,17 @@ namespace GeminiCPP
         template <JsonSerializable ResponseType>
         Result<ResponseType> postMultipart(const std::string& endpoint, const std::string& filePath, const std::string& mimeType, const nlohmann::json& metadata);
 
+        /**
+         * @brief Performs a generic HTTP PATCH request expecting a JSON response.
+         * * @tparam ResponseType A type that implements the JsonSerializable concept.
+         * @param url The target URL.
+         * @param payload The JSON body to send.
+         * @param params Query parameters to append to the URL (e.g., updateMask).
+         * @return Result<ResponseType> The parsed response or error.
+         */
+        template <JsonSerializable ResponseType>
+        Result<ResponseType> patch(const std::string& url, const nlohmann::json& payload, const std::map<std::string, std::string>& params = {});
+
         /**
          * @brief Performs a generic HTTP DELETE request.
          * * @param url The target URL.
@@ -197,11 +216,12 @@ namespace GeminiCPP
         Result<bool> deleteResource(const std::string& url);
 
     private:
-        [[nodiscard]] GenerationResult submitRequest(const Url& url, const nlohmann::json& payload);
-        [[nodiscard]] GenerationResult submitStreamRequest(const Url& url, const nlohmann::json& payload, const StreamCallback& callback);
+        [[nodiscard]] GenerationResult submitRequest(const Url& url, const std::string& body);
+        [[nodiscard]] GenerationResult submitStreamRequest(const Url& url, const std::string& body, const StreamCallback& callback, const StreamPartCallback& onPart);
 
         void postHelper(const Url& url, const nlohmann::json& payload, std::string& text, long& statusCode);
         void getHelper(const Url& url, const std::map<std::string, std::string>& params, std::string& text, long& statusCode);
+        void patchHelper(const Url& url, const nlohmann::json& payload, const std::map<std::string, std::string>& params, std::string& text, long& statusCode);
         void multipartHelper(const Url& url, const std::string& filePath, const std::string& mimeType, const nlohmann::json& metadata, std::string& text, long& statusCode);
 
         std::string api_key_;
@@ -256,6 +276,29 @@ namespace GeminiCPP
         }
     }
 
+    template <JsonSerializable ResponseType>
+    Result<ResponseType> Client::patch(const std::string& urlStr, const nlohmann::json& payload, const std::map<std::string, std::string>& params)
+    {
+        Url url(urlStr);
+        long statusCode;
+        std::string text;
+        patchHelper(url, payload, params, text, statusCode);
+
+        if (!HttpMappedStatusCodeHelper::isSuccess(statusCode))
+        {
+            return Result<ResponseType>::Failure(Utils::parseErrorMessage(text), statusCode);
+        }
+        try
+        {
+            return Result<ResponseType>::Success(ResponseType::fromJson(nlohmann::json::parse(text)), statusCode);
+        }
+        catch (const std::exception& e)
+        {
+            using namespace std::string_literals;
+            return Result<ResponseType>::Failure("Parse Error: "s + e.what(), statusCode);
+        }
+    }
+
     template <JsonSerializable ResponseType>
     Result<ResponseType> Client::postMultipart(const std::string& endpoint, const std::string& filePath, const std::string& mimeType, const nlohmann::json& metadata)
     {
@@ -0,0 +1,61 @@
+﻿#pragma once
+
+#ifndef GEMINI_CONTEXT_WINDOW_H
+#define GEMINI_CONTEXT_WINDOW_H
+
+#include <cstddef>
+#include <vector>
+
+#include "history.h"
+
+namespace GeminiCPP
+{
+    /**
+     * @brief Controls which part of a chat history is sent with each request.
+     */
+    struct ContextWindowPolicy
+    {
+        int maxTokens = 0;              ///< Token budget for the history sent per request. 0 disables the window (send everything).
+        size_t pinnedTurns = 0;         ///< The first N turns are always sent (e.g. the task description).
+        bool keepFunctionPairs = true;  ///< Never send a function response without the model turn that requested it (and vice versa).
+        size_t bytesPerToken = 4;       ///< Estimate used for turns without a tracked token count (JSON bytes per token).
+    };
+
+    /**
+     * @brief Result of applying a ContextWindowPolicy to a History.
+     */
+    struct ContextWindowSelection
+    {
+        History history;              ///< The turns to send; shares turns with the source history.
+        std::vector<size_t> indices;  ///< Positions of the selected turns in the source history, ascending.
+        int tokens = 0;               ///< Tracked/estimated token count of the selected turns.
+    };
+
+    /**
+     * @brief Picks the turns of a conversation that fit a token budget.
+     * * The window keeps the pinned prefix plus the longest recent suffix that fits into
+     * ContextWindowPolicy::maxTokens. Turns are dropped in units, so a model turn with function calls
+     * and the function response turn that answers it are kept or dropped together. Where possible the
+     * suffix starts at a user turn. The most recent unit is always sent, even if it exceeds the budget.
+     * * The source history is never modified.
+     */
+    class ContextWindow
+    {
+    public:
+        /**
+         * @brief Applies the policy to a history.
+         * @param history The full conversation.
+         * @param turnTokens Tracked token count per turn (same order as history). Missing or non-positive
+         * entries are estimated from the turn's JSON size.
+         * @param policy The window policy.
+         */
+        [[nodiscard]] static ContextWindowSelection select(const History& history, const std::vector<int>& turnTokens, const ContextWindowPolicy& policy);
+
+        /**
+         * @brief Estimates the token count of a turn from the size of its JSON.
+         */
+        [[nodiscard]] static int estimateTokens(size_t jsonBytes, size_t bytesPerToken = 4);
+    };
+}
+
+#endif // GEMINI_CONTEXT_WINDOW_H
@@ -9,7 +9,11 @@
 
 #include <future>
 #include <coroutine>
+#include <exception>
+#include <functional>
+#include <optional>
 #include <thread>
+#include <utility>
 
 namespace GeminiCPP
 {
@@ -86,6 +90,88 @@ namespace GeminiCPP
     {
         return FutureAwaiter<T>{f};
     }
+
+    /**
+     * @brief Coroutine return type for asynchronous tools registered in a FunctionRegistry.
+     * * The coroutine is lazy: it does not run until start() is called, and it reports its result through
+     * the callback given to start() instead of blocking a thread. Write the tool body with co_return.
+     * @tparam T The result type (must be convertible to nlohmann::json).
+     */
+    template <typename T>
+    class ToolTask
+    {
+    public:
+        using Callback = std::function<void(std::optional<T>, std::exception_ptr)>;
+
+        struct promise_type
+        {
+            std::optional<T> value;
+            std::exception_ptr error;
+            Callback onDone;
+
+            ToolTask get_return_object() { return ToolTask{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+
+            auto final_suspend() noexcept
+            {
+                struct FinalAwaiter
+                {
+                    bool await_ready() noexcept { return false; }
+                    void await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+                    {
+                        auto& promise = handle.promise();
+                        Callback callback = std::move(promise.onDone);
+                        std::optional<T> value = std::move(promise.value);
+                        std::exception_ptr error = promise.error;
+                        handle.destroy();
+                        if (callback)
+                            callback(std::move(value), error);
+                    }
+                    void await_resume() noexcept {}
+                };
+                return FinalAwaiter{};
+            }
+
+            template <typename U>
+            void return_value(U&& result) { value.emplace(std::forward<U>(result)); }
+            void unhandled_exception() { error = std::current_exception(); }
+        };
+
+        ToolTask(ToolTask&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+        ToolTask& operator=(ToolTask&& other) noexcept
+        {
+            if (this != &other)
+            {
+                if (handle_)
+                    handle_.destroy();
+                handle_ = std::exchange(other.handle_, {});
+            }
+            return *this;
+        }
+        ToolTask(const ToolTask&) = delete;
+        ToolTask& operator=(const ToolTask&) = delete;
+
+        ~ToolTask()
+        {
+            if (handle_)
+                handle_.destroy();
+        }
+
+        /**
+         * @brief Runs the coroutine. onDone is called exactly once, from whichever thread finishes it.
+         */
+        void start(Callback onDone) &&
+        {
+            auto handle = std::exchange(handle_, {});
+            handle.promise().onDone = std::move(onDone);
+            handle.resume();
+        }
+
+    private:
+        explicit ToolTask(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+        std::coroutine_handle<promise_type> handle_;
+    };
 }
 
 #endif // C++20 Check
@@ -0,0 +1,75 @@
+﻿#pragma once
+
+#ifndef GEMINI_FUNCTION_CACHE_H
+#define GEMINI_FUNCTION_CACHE_H
+
+#include <chrono>
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <nlohmann/json.hpp>
+
+namespace GeminiCPP
+{
+    /**
+     * @brief Result caching for a pure function (same arguments always give the same result).
+     */
+    struct FunctionCachePolicy
+    {
+        size_t maxEntries = 0;            ///< Results kept per function; least recently used ones are evicted. 0 disables caching.
+        std::chrono::milliseconds ttl{0}; ///< How long a result stays valid. 0 = until evicted.
+    };
+
+    struct FunctionCacheStats
+    {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t evictions = 0;   ///< Entries dropped to stay within maxEntries.
+        size_t expirations = 0; ///< Entries found past their TTL.
+        size_t entries = 0;
+    };
+
+    /**
+     * @brief Thread-safe LRU cache of function results keyed by the canonical form of the arguments.
+     * * Error results are never stored, so a failed call is retried the next time.
+     */
+    class FunctionResultCache
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        explicit FunctionResultCache(FunctionCachePolicy policy);
+
+        /**
+         * @brief Serializes arguments so that equal JSON values give equal keys (object members are sorted by name).
+         */
+        [[nodiscard]] static std::string canonicalKey(const nlohmann::json& args);
+
+        [[nodiscard]] std::optional<nlohmann::json> get(const std::string& key);
+        void put(std::string key, const nlohmann::json& result);
+        void clear();
+
+        [[nodiscard]] FunctionCacheStats stats() const;
+        [[nodiscard]] const FunctionCachePolicy& policy() const { return policy_; }
+
+    private:
+        struct Entry
+        {
+            std::string key;
+            nlohmann::json result;
+            Clock::time_point expires;
+        };
+
+        FunctionCachePolicy policy_;
+        mutable std::mutex mutex_;
+        std::list<Entry> entries_; ///< Most recently used first.
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> index_; ///< Keys point into entries_.
+        FunctionCacheStats stats_;
+    };
+}
+
+#endif // GEMINI_FUNCTION_CACHE_H
@@ -0,0 +1,82 @@
+﻿#pragma once
+
+#ifndef GEMINI_FUNCTION_EXECUTOR_H
+#define GEMINI_FUNCTION_EXECUTOR_H
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#include "function_registry.h"
+
+namespace GeminiCPP
+{
+    class ThreadPool;
+
+    /**
+     * @brief Controls how the function calls of one model turn are executed.
+     */
+    struct FunctionExecutionPolicy
+    {
+        size_t maxParallelism = 4;                 ///< Calls of one turn running at the same time. 1 runs them sequentially on the caller thread.
+        std::chrono::milliseconds callTimeout{0};  ///< Per-call limit measured from submission (waiting for a worker included). 0 waits indefinitely.
+        ThreadPool* executor = nullptr;            ///< Where calls run. nullptr uses FunctionExecutor::defaultPool(); must outlive the session.
+    };
+
+    /**
+     * @brief Executes the function calls of a model turn, concurrently where allowed.
+     * * Calls are started as soon as they are submitted (so a streaming turn can dispatch a call before
+     * the rest of the turn has arrived); wait() returns one FunctionResponse per call, in submission order,
+     * each carrying the id of its FunctionCall. Unknown functions and calls exceeding the timeout yield an
+     * error response; a call that times out before a worker picked it up is never started. A timed-out call
+     * that is running keeps going in the background, but a replacement worker is started so the remaining
+     * calls are not held back (and the default pool grows by one thread, so hung calls cannot exhaust it).
+     * * Asynchronous functions and functions with FunctionOptions are dispatched through
+     * FunctionRegistry::invokeAsync() and do not occupy a worker while they run.
+     * * The registry is copied on construction, so it may change or go away while the calls run.
+     */
+    class FunctionExecutor
+    {
+    public:
+        FunctionExecutor(FunctionRegistry registry, FunctionExecutionPolicy policy);
+
+        FunctionExecutor(const FunctionExecutor&) = delete;
+        FunctionExecutor& operator=(const FunctionExecutor&) = delete;
+
+        /**
+         * @brief Queues a call and starts it if a worker slot is free. Thread-safe.
+         */
+        void submit(FunctionCall call);
+
+        /**
+         * @brief Blocks until every submitted call has finished or timed out.
+         * @return The responses in submission order.
+         */
+        [[nodiscard]] std::vector<FunctionResponse> wait();
+
+        [[nodiscard]] size_t size() const;
+        [[nodiscard]] bool empty() const { return size() == 0; }
+
+        /**
+         * @brief Process-wide pool for function calls of executors that were not given one.
+         * @details Separate from ThreadPool::shared(), which background work such as history compaction
+         * uses: a function that never returns only ever blocks this pool's threads.
+         */
+        [[nodiscard]] static ThreadPool& defaultPool();
+
+    private:
+        struct State;
+
+        [[nodiscard]] bool sequential() const;
+        void startWorker();
+
+        FunctionRegistry registry_;
+        FunctionExecutionPolicy policy_;
+        std::shared_ptr<State> state_; ///< Shared with workers, which may outlive a timed-out wait().
+    };
+}
+
+#endif // GEMINI_FUNCTION_EXECUTOR_H
@@ -3,23 +3,62 @@
 #ifndef GEMINI_FUNCTION_REGISTRY_H
 #define GEMINI_FUNCTION_REGISTRY_H
 
+#include <chrono>
+#include <future>
 #include <string>
+#include <string_view>
+#include <stdexcept>
 #include <vector>
 #include <functional>
-#include <map>
+#include <memory>
 #include <tuple>
 #include <nlohmann/json.hpp>
 
 #include "internal/function_utils.h"
+#include "internal/async_utils.h"
+#include "coroutine.h"
+#include "function_cache.h"
 #include "logger.h"
+#include "thread_pool.h"
+#include "tool_worker.h"
 #include "types/generating_content_api_types.h"
 
 namespace GeminiCPP
 {
+    /**
+     * @brief Thrown by a tool (or stored in its future) to report that the call was cancelled.
+     * @details Reported to the model as a structured error with status "CANCELLED".
+     */
+    class FunctionCancelled : public std::runtime_error
+    {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    /**
+     * @brief Per-function execution limits.
+     */
+    struct FunctionOptions
+    {
+        std::chrono::milliseconds timeout{0}; ///< Deadline for one call, including time spent waiting for a slot. 0 = none.
+        size_t maxConcurrency = 0;            ///< Calls of this function running at once; further calls queue. 0 = unlimited.
+        FunctionCachePolicy cache;            ///< Memoizes results of pure functions. Disabled by default.
+    };
+
     /**
      * @brief Manages client-side function registration and invocation for Tool use.
      * * This class automatically generates JSON schemas from C++ function signatures and
      * handles the invocation of these functions when requested by the model.
+     * * Functions live in an immutable open-addressing hash table (name hashes are stored next to the
+     * entries) that is rebuilt on registration, together with the Tool and its serialized JSON. Lookups
+     * and getTool() therefore never rebuild or copy schemas, and copying a registry is O(1).
+     * * Functions may be asynchronous: returning std::future<T> or ToolTask<T> (a coroutine). Those are
+     * awaited without blocking a thread per call, and FunctionOptions adds a deadline and a concurrency
+     * limit. Timeouts, cancellations and exceptions become structured {"error": {"status", "message"}} results.
+     * * Heavyweight tools can run in worker processes (registerWorkerFunction()) that are kept alive
+     * between calls instead of being started for every call.
+     * * Pure functions can opt into a result cache (FunctionOptions::cache), so repeated calls with the
+     * same arguments are answered without running the function again.
      */
     class FunctionRegistry
     {
@@ -30,7 +69,23 @@ namespace GeminiCPP
         struct RegisteredFunction
         {
             FunctionDeclaration declaration;
-            std::function<nlohmann::json(const nlohmann::json&)> invoker; 
+            std::function<nlohmann::json(const nlohmann::json&)> invoker; ///< Synchronous functions; empty for async ones.
+            std::function<void(const nlohmann::json&, Internal::FunctionCompletion)> asyncInvoker; ///< Future/ToolTask functions.
+            FunctionOptions options;
+            std::shared_ptr<Internal::ConcurrencyGate> gate; ///< Set if options.maxConcurrency > 0; shared by registry copies.
+            std::shared_ptr<FunctionResultCache> cache;      ///< Set if options.cache.maxEntries > 0; shared by registry copies.
+
+            /**
+             * @brief Runs a synchronous function, answering from the result cache when possible.
+             */
+            [[nodiscard]] nlohmann::json call(const nlohmann::json& args) const;
+
+            [[nodiscard]] bool isAsync() const { return static_cast<bool>(asyncInvoker); }
+
+            /**
+             * @brief True if calls must go through invokeAsync() (async function, deadline or concurrency limit).
+             */
+            [[nodiscard]] bool needsDispatch() const { return isAsync() || gate || options.timeout.count() > 0; }
         };
 
         // ====================================================================
@@ -47,6 +102,14 @@ namespace GeminiCPP
             using ArgsTuple = std::tuple<Args...>;
             using ReturnType = ReturnT;
         };
+
+        // Mutable lambda / non-const functor
+        template <typename ClassType, typename ReturnT, typename... Args>
+        struct function_traits<ReturnT(ClassType::*)(Args...)>
+        {
+            using ArgsTuple = std::tuple<Args...>;
+            using ReturnType = ReturnT;
+        };
         
         template <typename ReturnT, typename... Args>
         struct function_traits<ReturnT(*)(Args...)> {
@@ -57,6 +120,16 @@ namespace GeminiCPP
         // Functor Wrapper
         template <typename T>
         struct function_traits : public function_traits<decltype(&T::operator())> {};
+
+        // Asynchronous return types
+        template <typename T>
+        struct async_traits { static constexpr bool isFuture = false; static constexpr bool isTask = false; };
+
+        template <typename T>
+        struct async_traits<std::future<T>> { static constexpr bool isFuture = true; static constexpr bool isTask = false; using ValueType = T; };
+
+        template <typename T>
+        struct async_traits<ToolTask<T>> { static constexpr bool isFuture = false; static constexpr bool isTask = true; using ValueType = T; };
         
         // ====================================================================
         // ====================================================================
@@ -64,84 +137,215 @@ namespace GeminiCPP
 
         /**
          * @brief Registers a C++ function/lambda to be available to the Gemini model.
-         * @tparam Func The function type.
+         * @tparam Func The function type. It may return a value, void, std::future<T> or ToolTask<T>.
          * @param name The name of the function (exposed to LLM).
          * @param func The actual C++ function or lambda to execute.
          * @param description A description of what the function does (critical for LLM to use it correctly).
          * @param argNames A list of argument names corresponding to the function parameters.
+         * @param options Optional deadline and concurrency limit for calls of this function.
          */
         template <typename Func>
-        void registerFunction(const std::string& name, Func&& func, const std::string& description, const std::vector<std::string>& argNames)
+        void registerFunction(const std::string& name, Func&& func, const std::string& description, const std::vector<std::string>& argNames,
+                              FunctionOptions options = {})
         {
             using Traits = function_traits<std::decay_t<Func>>;
+            using Async = async_traits<typename Traits::ReturnType>;
             
-            FunctionDeclaration decl;
-            decl.name = name;
-            decl.description = description;
-            decl.parameters = generateSchema<typename Traits::ArgsTuple>(argNames);
+            RegisteredFunction entry;
+            entry.declaration.name = name;
+            entry.declaration.description = description;
+            entry.declaration.parameters = generateSchema<typename Traits::ArgsTuple>(argNames);
+            entry.options = options;
+            if (options.maxConcurrency > 0)
+                entry.gate = std::make_shared<Internal::ConcurrencyGate>(options.maxConcurrency);
+            if (options.cache.maxEntries > 0)
+                entry.cache = std::make_shared<FunctionResultCache>(options.cache);
 
-            auto invoker = [func = std::forward<Func>(func), argNames](const nlohmann::json& args) -> nlohmann::json
+            if constexpr (Async::isFuture)
             {
-                try
+                entry.asyncInvoker = [func = std::forward<Func>(func), argNames](const nlohmann::json& args, Internal::FunctionCompletion done) mutable
                 {
-                    auto tupleArgs = Internal::jsonToTuple<typename Traits::ArgsTuple>(args, argNames);
-                    
-                    if constexpr (std::is_void_v<typename Traits::ReturnType>)
+                    try
                     {
-                        std::apply(func, tupleArgs);
-                        return {{"result", "ok"}};
-                    } else
+                        auto future = std::make_shared<std::future<typename Async::ValueType>>(
+                            std::apply(func, Internal::jsonToTuple<typename Traits::ArgsTuple>(args, argNames)));
+                        awaitFuture(std::move(future), std::move(done));
+                    }
+                    catch (...)
                     {
-                        return std::apply(func, tupleArgs);
+                        done(Internal::functionErrorFromException(std::current_exception()));
                     }
-                }
-                catch (const std::exception& e)
+                };
+            }
+            else if constexpr (Async::isTask)
+            {
+                entry.asyncInvoker = [func = std::forward<Func>(func), argNames](const nlohmann::json& args, Internal::FunctionCompletion done) mutable
                 {
-                    GEMINI_ERROR("Function execution failed: {}", e.what());
-                    return {{"error", e.what()}};
-                }
-            };
+                    try
+                    {
+                        std::apply(func, Internal::jsonToTuple<typename Traits::ArgsTuple>(args, argNames))
+                            .start([done](std::optional<typename Async::ValueType> value, std::exception_ptr error) {
+                                if (error || !value)
+                                    done(Internal::functionErrorFromException(error ? error : std::make_exception_ptr(FunctionCancelled("Task produced no result"))));
+                                else
+                                    done(nlohmann::json(std::move(*value)));
+                            });
+                    }
+                    catch (...)
+                    {
+                        done(Internal::functionErrorFromException(std::current_exception()));
+                    }
+                };
+            }
+            else
+            {
+                entry.invoker = [func = std::forward<Func>(func), argNames](const nlohmann::json& args) mutable -> nlohmann::json
+                {
+                    try
+                    {
+                        auto tupleArgs = Internal::jsonToTuple<typename Traits::ArgsTuple>(args, argNames);
+                        
+                        if constexpr (std::is_void_v<typename Traits::ReturnType>)
+                        {
+                            std::apply(func, std::move(tupleArgs));
+                            return {{"result", "ok"}};
+                        } else
+                        {
+                            return std::apply(func, std::move(tupleArgs));
+                        }
+                    }
+                    catch (const std::exception& e)
+                    {
+                        GEMINI_ERROR("Function execution failed: {}", e.what());
+                        return {{"error", e.what()}};
+                    }
+                };
+            }
 
-            functions_[name] = {decl, invoker};
+            insert(std::move(entry));
             GEMINI_INFO("Function registered: {}", name);
         }
 
+        /**
+         * @brief Registers a function executed by a pool of long-lived worker processes (see ToolWorkerPool).
+         * @param declaration Name, description and parameter schema exposed to the model.
+         * @param workerOptions Command line, pool size, timeouts and health checks of the workers.
+         * @param options Optional deadline, concurrency limit and result cache, as for registerFunction().
+         */
+        void registerWorkerFunction(FunctionDeclaration declaration, ToolWorkerOptions workerOptions, FunctionOptions options = {});
+
         /**
          * @brief Invokes a registered function by name using JSON arguments.
          * @param name The function name to call.
          * @param args The arguments as a JSON object (key-value pairs).
          * @return std::optional<nlohmann::json> The result of the function execution, or nullopt if not found.
          */
-        [[nodiscard]] std::optional<nlohmann::json> invoke(const std::string& name, const nlohmann::json& args)
-        {
-            if (functions_.contains(name))
-            {
-                return functions_[name].invoker(args);
-            }
-            return std::nullopt;
-        }
+        [[nodiscard]] std::optional<nlohmann::json> invoke(const std::string& name, const nlohmann::json& args) const;
+
+        /**
+         * @brief Invokes a registered function without blocking the caller.
+         * @details done is called exactly once: with the result, or with a structured error if the function is
+         * unknown, exceeds its deadline, is cancelled or throws. Synchronous functions with FunctionOptions run on
+         * FunctionExecutor::defaultPool(); asynchronous ones are awaited by a shared watcher thread.
+         */
+        void invokeAsync(std::string_view name, const nlohmann::json& args, Internal::FunctionCompletion done) const;
+
+        /**
+         * @brief Looks up a registered function.
+         * @return Pointer to the registration, or nullptr if no function has this name.
+         */
+        [[nodiscard]] const RegisteredFunction* find(std::string_view name) const;
+
+        /**
+         * @brief Like find(), but the returned registration stays valid after the registry changes or is destroyed.
+         */
+        [[nodiscard]] std::shared_ptr<const RegisteredFunction> findShared(std::string_view name) const;
+
+        /**
+         * @brief Hit/miss counters of a function's result cache.
+         * @return nullopt if the function is unknown or not cached.
+         */
+        [[nodiscard]] std::optional<FunctionCacheStats> cacheStats(std::string_view name) const;
+
+        /**
+         * @brief Drops all cached results (of every copy of this registry).
+         */
+        void clearCaches() const;
 
         /**
          * @brief Generates a Tool definition containing all registered functions.
          * @return A Tool object ready to be sent in a Gemini API request.
          */
-        [[nodiscard]] Tool getTool() const
-        {
-            Tool t;
-            for (const auto& reg : std::views::values(functions_))
-            {
-                t.functionDeclarations.push_back(reg.declaration);
-            }
-            return t;
-        }
+        [[nodiscard]] Tool getTool() const;
+
+        /**
+         * @brief The Tool built at the last registration, shared instead of copied.
+         */
+        [[nodiscard]] std::shared_ptr<const Tool> tool() const;
+
+        /**
+         * @brief The serialized JSON object of tool(), cached until the next registration.
+         */
+        [[nodiscard]] std::shared_ptr<const std::string> toolJson() const;
 
         /**
          * @brief Checks if the registry is empty.
          */
-        [[nodiscard]] bool empty() const { return functions_.empty(); }
+        [[nodiscard]] bool empty() const { return size() == 0; }
+        [[nodiscard]] size_t size() const;
 
     private:
-        std::map<std::string, RegisteredFunction> functions_;
+        struct Slot
+        {
+            size_t hash = 0;
+            std::shared_ptr<const RegisteredFunction> function; ///< nullptr marks a free slot.
+        };
+
+        struct Table
+        {
+            std::vector<Slot> slots;  ///< Power-of-two capacity, linear probing, load factor <= 1/2.
+            size_t count = 0;
+            std::shared_ptr<const Tool> tool;
+            std::shared_ptr<const std::string> toolJson;
+        };
+
+        void insert(RegisteredFunction function);
+
+        template <typename T>
+        static void awaitFuture(std::shared_ptr<std::future<T>> future, Internal::FunctionCompletion done)
+        {
+            auto deliver = [future, done]() {
+                try
+                {
+                    if constexpr (std::is_void_v<T>)
+                    {
+                        future->get();
+                        done({{"result", "ok"}});
+                    }
+                    else
+                    {
+                        done(nlohmann::json(future->get()));
+                    }
+                }
+                catch (...)
+                {
+                    done(Internal::functionErrorFromException(std::current_exception()));
+                }
+            };
+
+            Internal::AsyncWatcher::instance().watch([future, deliver]() {
+                const auto status = future->wait_for(std::chrono::seconds(0));
+                if (status == std::future_status::timeout)
+                    return false;
+                if (status == std::future_status::deferred)
+                    (void)ThreadPool::shared().submit(deliver); // A deferred future only runs when get() is called.
+                else
+                    deliver();
+                return true;
+            });
+        }
+
+        std::shared_ptr<const Table> table_;
 
         template <typename TupleType, std::size_t... Is>
         nlohmann::json generateSchemaImpl(const std::vector<std::string>& argNames, std::index_sequence<Is...>)
@@ -0,0 +1,210 @@
+﻿#pragma once
+
+#ifndef GEMINI_HISTORY_H
+#define GEMINI_HISTORY_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "types/caching_api_types.h"
+
+namespace GeminiCPP
+{
+    /**
+     * @brief Persistent (structurally shared) list of conversation turns.
+     * * Turns are stored in immutable, reference-counted nodes that point to the previous turn.
+     * Copying a History is O(1) and never copies Content; appending to one copy does not affect the others,
+     * which keep sharing the common prefix. This lets chat sessions hand their history to request bodies,
+     * snapshots and storage without deep-copying large parts (e.g. base64 blobs).
+     * * Each turn is serialized once when it is appended and the JSON bytes are kept next to it, so request
+     * bodies can splice past turns in instead of re-serializing them on every send.
+     * * Turns loaded from storage can be appended lazily (push_back_lazy()): they are only decoded when their
+     * content or JSON is first needed, so loading a long session does not decode turns that are never used.
+     */
+    class History
+    {
+    public:
+        /**
+         * @brief Identifies one version of a History without keeping its turns alive.
+         * @details Only ever compared against (extends()), never turned back into a History: a node revived
+         * from a weak reference while its chain is being released could have lost its earlier turns.
+         * @see mark(), extends()
+         */
+        class Mark
+        {
+        public:
+            Mark() = default;
+            [[nodiscard]] size_t size() const { return size_; }
+
+        private:
+            friend class History;
+            std::weak_ptr<const void> node_;
+            size_t size_ = 0;
+        };
+
+        /**
+         * @brief Thrown by the decoder of a lazy turn when part of the turn cannot be read right now.
+         * @details Carries the turn as far as it could be decoded (e.g. still holding blob references). The
+         * turn serves that JSON meanwhile, is not cached as decoded, and decoding is retried on the next access.
+         */
+        struct IncompleteTurn : std::runtime_error
+        {
+            IncompleteTurn(const std::string& what, nlohmann::json partial)
+                : std::runtime_error(what), turn(std::move(partial)) {}
+
+            nlohmann::json turn;
+        };
+
+        History() = default;
+
+        /**
+         * @brief Appends a turn. O(1); existing copies of this History are unaffected.
+         */
+        void push_back(Content content);
+
+        /**
+         * @brief Appends a turn that is decoded on first access.
+         * @param jsonSize Size (or close estimate) of the turn's serialized JSON, reported without decoding (e.g. to the context window).
+         * @param decode Produces the turn as JSON, on whichever thread first needs the turn. Called again on
+         * the next access if it threw: an undecodable turn is never cached as an (empty) replacement.
+         */
+        void push_back_lazy(size_t jsonSize, std::function<nlohmann::json()> decode);
+
+        /**
+         * @brief Removes all turns from this History (other copies keep theirs).
+         */
+        void clear();
+
+        [[nodiscard]] size_t size() const;
+        [[nodiscard]] bool empty() const;
+
+        /**
+         * @brief Returns the most recent turn, or nullptr if the history is empty.
+         */
+        [[nodiscard]] std::shared_ptr<const Content> back() const;
+
+        /**
+         * @brief Returns shared handles to all turns, oldest first.
+         * @details Only pointers are copied; the Content objects are shared with the history.
+         */
+        [[nodiscard]] std::vector<std::shared_ptr<const Content>> turns() const;
+
+        /**
+         * @brief Deep-copies all turns into a vector, oldest first.
+         */
+        [[nodiscard]] std::vector<Content> toVector() const;
+
+        /**
+         * @brief Appends the cached JSON of all turns to out, oldest first, separated by commas.
+         * @details The output is the inside of a JSON array (no brackets). Nothing is re-serialized.
+         */
+        void appendJson(std::string& out) const;
+
+        /**
+         * @brief Total size in bytes of the cached JSON of all turns.
+         */
+        [[nodiscard]] size_t jsonBytes() const;
+
+        /**
+         * @brief Returns the cached JSON size in bytes of each turn, oldest first.
+         */
+        [[nodiscard]] std::vector<size_t> turnJsonSizes() const;
+
+        /**
+         * @brief Builds a History holding only the turns at the given positions.
+         * @details Positions are 0-based (oldest first) and must be ascending; out-of-range ones are ignored.
+         * The selected turns and their cached JSON are shared, not copied, and this History is not modified.
+         */
+        [[nodiscard]] History select(const std::vector<size_t>& indices) const;
+
+        /**
+         * @brief Returns the first count turns (all of them if count >= size()).
+         * @details O(size() - count). The result shares its nodes with this History; appending to either
+         * later does not affect the other.
+         */
+        [[nodiscard]] History prefix(size_t count) const;
+
+        /**
+         * @brief Appends the turns of other at positions from..other.size()-1, oldest first.
+         * @details O(other.size() - from). The turns are shared, not copied, and lazy ones stay undecoded.
+         */
+        void append(const History& other, size_t from = 0);
+
+        /**
+         * @brief Decodes the lazy turns at positions from..size()-1 and reports whether all of them could be decoded.
+         * @details A turn whose decoder failed (e.g. corrupt stored bytes) is served as an empty placeholder;
+         * storage checks this before writing, so the placeholder never replaces the stored turn. Turns that
+         * are only incomplete (IncompleteTurn) count as readable: they are written as read.
+         */
+        [[nodiscard]] bool readable(size_t from = 0) const;
+
+        /**
+         * @brief Returns a mark of the current version of this History.
+         */
+        [[nodiscard]] Mark mark() const;
+
+        /**
+         * @brief Checks whether this History is the marked version plus zero or more appended turns.
+         * @details O(size() - mark.size()). False if the marked turns are gone or were replaced (cleared, selected, ...).
+         */
+        [[nodiscard]] bool extends(const Mark& mark) const;
+
+        /**
+         * @brief Returns the cached JSON of the turns at positions from..size()-1, oldest first.
+         * @details O(size() - from). The views stay valid as long as this History (or a copy) holds the turns.
+         */
+        [[nodiscard]] std::vector<std::string_view> jsonSince(size_t from) const;
+
+    private:
+        struct Turn
+        {
+            /**
+             * @brief Decodes a lazy turn if that has not happened yet. No-op for eager turns.
+             * @return false if the turn is incomplete or unreadable: the fallback members hold it until a retry succeeds.
+             */
+            bool ensureDecoded() const;
+
+            [[nodiscard]] const Content& getContent() const { return ensureDecoded() ? content : fallbackContent; }
+            [[nodiscard]] const std::string& getJson() const { return ensureDecoded() ? json : fallbackJson; }
+
+            mutable Content content;
+            mutable std::string json; ///< content.toJson().dump(), computed once at append (or decode) time.
+            size_t jsonSize = 0;      ///< json.size(), known up front for lazy turns.
+
+            std::function<nlohmann::json()> decode; ///< Set for lazy turns.
+            mutable std::mutex decodeMutex;
+            mutable std::atomic<bool> decoded{false};
+            mutable std::atomic<bool> hasFallback{false};
+            mutable std::atomic<bool> unreadable{false}; ///< The last decode failed outright (not IncompleteTurn).
+            mutable Content fallbackContent; ///< Set once by the first failed decode, then never changed.
+            mutable std::string fallbackJson;
+        };
+
+        struct Node
+        {
+            std::shared_ptr<const Node> prev;
+            std::shared_ptr<const Turn> turn;
+            size_t size = 0;       ///< Number of turns up to and including this node.
+            size_t jsonBytes = 0;  ///< Cumulative JSON size up to and including this node.
+
+            Node(std::shared_ptr<const Node> prev_, std::shared_ptr<const Turn> turn_);
+            Node(const Node&) = delete;
+            Node& operator=(const Node&) = delete;
+            ~Node();
+        };
+
+        [[nodiscard]] std::vector<const Node*> nodes() const;
+
+        std::shared_ptr<const Node> head_;
+    };
+}
+
+#endif // GEMINI_HISTORY_H
@@ -0,0 +1,75 @@
+﻿#pragma once
+
+#ifndef GEMINI_HISTORY_COMPACTION_H
+#define GEMINI_HISTORY_COMPACTION_H
+
+#include <cstddef>
+#include <string>
+
+#include "history.h"
+#include "types/generating_content_api_types.h"
+
+namespace GeminiCPP
+{
+    class ThreadPool;
+
+    /**
+     * @brief Controls background summarization of old chat turns.
+     */
+    struct CompactionPolicy
+    {
+        bool enabled = false;
+        int triggerTokens = 32000;                ///< Compact once the history that would be sent exceeds this many tokens.
+        size_t keepRecentTurns = 8;               ///< The newest turns are never summarized.
+        std::string model = "gemini-2.5-flash-lite"; ///< Model used to write the summaries (usually a cheaper one).
+        std::string instruction =
+            "You maintain the running summary of a conversation between a user and an assistant. "
+            "Merge the previous summary and the new transcript into one concise summary. Keep facts, decisions, "
+            "open questions, names, numbers and tool results that later turns may depend on.";
+        ThreadPool* executor = nullptr;           ///< Where summaries are generated. nullptr uses ThreadPool::shared(); must outlive the session.
+    };
+
+    /**
+     * @brief A summary standing in for the turns [begin, end) of a chat history.
+     */
+    struct HistorySummary
+    {
+        size_t begin = 0;
+        size_t end = 0;
+        std::string text;
+        int tokens = 0;
+
+        [[nodiscard]] bool empty() const { return end <= begin; }
+
+        [[nodiscard]] static HistorySummary fromJson(const nlohmann::json& j);
+        [[nodiscard]] nlohmann::json toJson() const;
+    };
+
+    /**
+     * @brief Stateless helpers used by ChatSession to compact its history.
+     */
+    class HistoryCompactor
+    {
+    public:
+        /**
+         * @brief Chooses where a summary covering turns from 'begin' should end.
+         * @details Returns the largest cut <= limit that starts a user turn and does not separate a function
+         * call from its response, or 'begin' if there is none.
+         */
+        [[nodiscard]] static size_t findCut(const History& history, size_t begin, size_t limit);
+
+        /**
+         * @brief Builds the summarization request for the turns [from, end).
+         * @param previousSummary Summary of the turns before 'from' (empty for the first compaction).
+         */
+        [[nodiscard]] static GenerateContentRequestBody buildRequest(const History& history, size_t from, size_t end,
+                                                                     const std::string& previousSummary, const CompactionPolicy& policy);
+
+        /**
+         * @brief Renders the turns [from, end) as a plain-text transcript.
+         */
+        [[nodiscard]] static std::string transcript(const History& history, size_t from, size_t end);
+    };
+}
+
+#endif // GEMINI_HISTORY_COMPACTION_H
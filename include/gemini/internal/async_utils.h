@@ -0,0 +1,150 @@
+﻿#pragma once
+
+#ifndef GEMINI_ASYNC_UTILS_H
+#define GEMINI_ASYNC_UTILS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace GeminiCPP::Internal
+{
+    using FunctionCompletion = std::function<void(nlohmann::json)>;
+
+    /**
+     * @brief Builds the structured error payload returned to the model for a failed tool call.
+     * @param status A canonical status name (e.g. "DEADLINE_EXCEEDED", "CANCELLED", "INTERNAL").
+     */
+    [[nodiscard]] nlohmann::json functionError(std::string_view status, std::string_view message);
+
+    /**
+     * @brief Converts the exception a tool finished with into a structured error payload.
+     */
+    [[nodiscard]] nlohmann::json functionErrorFromException(std::exception_ptr error);
+
+    /**
+     * @brief Delivers a tool result at most once (the first of result, timeout or cancellation wins).
+     */
+    class OnceCompletion
+    {
+    public:
+        explicit OnceCompletion(FunctionCompletion completion) : completion_(std::move(completion)) {}
+
+        /**
+         * @return true if this call delivered the result.
+         */
+        bool complete(nlohmann::json result)
+        {
+            if (done_.exchange(true))
+                return false;
+            completion_(std::move(result));
+            completion_ = nullptr;
+            return true;
+        }
+
+        [[nodiscard]] bool done() const { return done_.load(); }
+
+    private:
+        std::atomic<bool> done_{false};
+        FunctionCompletion completion_;
+    };
+
+    /**
+     * @brief Limits how many invocations of one function run at a time; the rest wait in FIFO order.
+     */
+    class ConcurrencyGate
+    {
+    public:
+        explicit ConcurrencyGate(size_t limit) : limit_(limit) {}
+
+        /**
+         * @brief Runs start now if a slot is free, otherwise when one is released.
+         */
+        void acquire(std::function<void()> start);
+
+        /**
+         * @brief Frees a slot, handing it to the next waiting invocation if any.
+         * @details The waiter is started on FunctionExecutor::defaultPool(), not on the releasing thread: that may
+         * be the watcher thread, and a waiter finishing synchronously would otherwise release (and recurse) there.
+         */
+        void release();
+
+        [[nodiscard]] size_t active() const;
+        [[nodiscard]] size_t waiting() const;
+
+    private:
+        mutable std::mutex mutex_;
+        size_t limit_;
+        size_t active_ = 0;
+        std::deque<std::function<void()>> waiting_;
+    };
+
+    /**
+     * @brief Process-wide helper thread for asynchronous tools.
+     * * It fires deadlines and polls std::futures returned by tools, so waiting for any number of
+     * in-flight tool calls costs one thread in total instead of one blocked thread per call.
+     */
+    class AsyncWatcher
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+        using TimerId = uint64_t; ///< 0 is never a valid id.
+
+        static AsyncWatcher& instance();
+
+        ~AsyncWatcher();
+
+        /**
+         * @brief Polls until poll() returns true. poll() must deliver the result itself.
+         */
+        void watch(std::function<bool()> poll);
+
+        /**
+         * @brief Calls fn once at (or shortly after) the given time, unless cancelled before.
+         * @return Id for cancel().
+         */
+        TimerId schedule(Clock::time_point when, std::function<void()> fn);
+
+        /**
+         * @brief Drops a timer that has not fired, e.g. the deadline of a call that finished in time.
+         * @return false if it already fired (or is firing) or is unknown.
+         */
+        bool cancel(TimerId id);
+
+    private:
+        AsyncWatcher();
+        void run();
+
+        // Expects mutex_ to be held.
+        void popCancelledTimers();
+
+        struct Timer
+        {
+            Clock::time_point when;
+            TimerId id;
+
+            bool operator>(const Timer& other) const { return when > other.when; }
+        };
+
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::vector<std::function<bool()>> polls_;
+        std::vector<Timer> timers_; ///< Min-heap on when; cancelled ones are dropped when they reach the top.
+        std::unordered_map<TimerId, std::function<void()>> timerCallbacks_; ///< Timers not fired or cancelled yet.
+        TimerId lastTimer_ = 0;
+        bool stopping_ = false;
+        std::thread thread_;
+    };
+}
+
+#endif // GEMINI_ASYNC_UTILS_H
@@ -0,0 +1,68 @@
+﻿#pragma once
+
+#ifndef GEMINI_CHILD_PROCESS_H
+#define GEMINI_CHILD_PROCESS_H
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace GeminiCPP::Internal
+{
+    /**
+     * @brief A child process whose stdin/stdout are connected to the parent through pipes.
+     * * stderr is inherited, so diagnostics of the child end up in the parent's stderr.
+     * The destructor kills the child (if still running) and reaps it.
+     */
+    class ChildProcess
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        enum class ReadStatus
+        {
+            Line,    ///< A complete line was read.
+            Timeout, ///< The deadline passed first.
+            Closed   ///< The child closed its stdout (usually: it exited).
+        };
+
+        /**
+         * @brief Starts command[0] (looked up in PATH) with the remaining elements as arguments.
+         * @return nullptr if the process cannot be started.
+         */
+        [[nodiscard]] static std::unique_ptr<ChildProcess> spawn(const std::vector<std::string>& command);
+
+        ~ChildProcess();
+
+        ChildProcess(const ChildProcess&) = delete;
+        ChildProcess& operator=(const ChildProcess&) = delete;
+
+        /**
+         * @brief Writes line plus '\n' to the child's stdin.
+         * @return false if the child no longer reads its stdin.
+         */
+        bool writeLine(std::string_view line);
+
+        /**
+         * @brief Reads the next line (without the trailing newline) from the child's stdout.
+         */
+        ReadStatus readLine(std::string& line, Clock::time_point deadline);
+
+        [[nodiscard]] bool running();
+        void terminate();
+
+    private:
+        ChildProcess() = default;
+
+        intptr_t process_ = -1; ///< pid / process HANDLE
+        intptr_t stdin_ = -1;   ///< fd / pipe HANDLE
+        intptr_t stdout_ = -1;  ///< fd / pipe HANDLE
+        bool exited_ = false;
+        std::string buffer_;    ///< Bytes read past the last returned line.
+    };
+}
+
+#endif // GEMINI_CHILD_PROCESS_H
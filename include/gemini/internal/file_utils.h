@@ -0,0 +1,80 @@
+﻿#pragma once
+
+#ifndef GEMINI_FILE_UTILS_H
+#define GEMINI_FILE_UTILS_H
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace GeminiCPP::Internal
+{
+    /**
+     * @brief Durably replaces the content of a file.
+     * @details The data is written to a temporary file in the same directory, flushed to disk (fsync),
+     * then renamed over the target. Readers observe either the old or the new content, never a partial write.
+     * @param path The target file.
+     * @param data The bytes to write.
+     * @param durable If true, the file and its directory are synced before returning.
+     * @return true on success.
+     */
+    bool writeFileAtomic(const std::filesystem::path& path, std::string_view data, bool durable = true);
+
+    /**
+     * @brief Appends bytes to a file, creating it if needed.
+     * @param durable If true, the file is synced before returning.
+     * @return true on success.
+     */
+    bool appendFile(const std::filesystem::path& path, std::string_view data, bool durable = true);
+
+    /**
+     * @brief Flushes a file's written data to disk (fsync), e.g. after several non-durable appends.
+     * @return true on success; false if the file cannot be opened or synced.
+     */
+    bool syncFile(const std::filesystem::path& path);
+
+    /**
+     * @brief Reads a whole file into memory.
+     * @return The file content, or nullopt if the file cannot be opened.
+     */
+    [[nodiscard]] std::optional<std::string> readFile(const std::filesystem::path& path);
+
+    /**
+     * @brief Reads length bytes of a file starting at offset.
+     * @return The bytes, or nullopt if the file cannot be opened or is shorter than offset + length.
+     */
+    [[nodiscard]] std::optional<std::string> readFileRange(const std::filesystem::path& path, uint64_t offset, size_t length);
+
+    /**
+     * @brief Flushes a directory entry to disk so that renames/creations inside it survive a crash.
+     * @note No-op on platforms without directory sync (Windows).
+     */
+    bool syncDirectory(const std::filesystem::path& dir);
+
+    /**
+     * @brief Exclusive, inter-process advisory lock held on a lock file (flock / LockFileEx).
+     * * The lock is acquired in the constructor (blocking) and released in the destructor.
+     */
+    class FileLock
+    {
+    public:
+        explicit FileLock(const std::filesystem::path& lockPath);
+        ~FileLock();
+
+        FileLock(const FileLock&) = delete;
+        FileLock& operator=(const FileLock&) = delete;
+
+        /**
+         * @brief Checks whether the lock was acquired.
+         */
+        [[nodiscard]] bool locked() const { return locked_; }
+
+    private:
+        intptr_t handle_ = -1;
+        bool locked_ = false;
+    };
+}
+
+#endif // GEMINI_FILE_UTILS_H
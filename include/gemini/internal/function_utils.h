@@ -3,6 +3,7 @@
 #ifndef GEMINI_FUNCTION_UTILS_H
 #define GEMINI_FUNCTION_UTILS_H
 
+#include <array>
 #include <string>
 #include <vector>
 #include <tuple>
@@ -104,17 +105,14 @@ namespace GeminiCPP::Internal
     };
 
     /**
-     * @brief Parses a named argument from a JSON object into type T.
-     * @tparam T The target C++ type.
-     * @param j The JSON object containing arguments.
-     * @param name The key name of the argument.
-     * @return The parsed value.
-     * @throws std::runtime_error if the argument is missing (and T is not default constructible) or invalid.
+     * @brief Parses an argument that was already located in the arguments object.
+     * @param value Pointer to the argument's JSON value, or nullptr if it is missing.
+     * @param name The key name of the argument (for error messages).
      */
     template <typename T>
-    T parseArg(const nlohmann::json& j, const std::string& name)
+    T parseArgValue(const nlohmann::json* value, const std::string& name)
     {
-        if (!j.contains(name))
+        if (!value)
         {
             if constexpr
             (std::is_default_constructible_v<T>)
@@ -125,7 +123,7 @@ namespace GeminiCPP::Internal
         
         if constexpr (frenum::is_frenum_v<T>)
         {
-            auto val = frenum::cast<T>(j.at(name).get<std::string>());
+            auto val = frenum::cast<T>(value->get<std::string>());
             if(val)
                 return *val;
             
@@ -133,15 +131,47 @@ namespace GeminiCPP::Internal
         } 
         else
         {
-            return j.at(name).get<T>();
+            return value->get<T>();
         }
     }
 
-    // Helper implementation for converting JSON to Tuple
+    /**
+     * @brief Parses a named argument from a JSON object into type T.
+     * @tparam T The target C++ type.
+     * @param j The JSON object containing arguments.
+     * @param name The key name of the argument.
+     * @return The parsed value.
+     * @throws std::runtime_error if the argument is missing (and T is not default constructible) or invalid.
+     */
+    template <typename T>
+    T parseArg(const nlohmann::json& j, const std::string& name)
+    {
+        auto it = j.find(name);
+        return parseArgValue<T>(it != j.end() ? &*it : nullptr, name);
+    }
+
+    // Helper implementation for converting JSON to Tuple.
+    // Walks the arguments object once and assigns each member to its parameter slot.
     template <typename TupleType, std::size_t... Is>
     TupleType jsonToTupleImpl(const nlohmann::json& j, const std::vector<std::string>& argNames, std::index_sequence<Is...>) 
     {
-        return std::make_tuple(parseArg<std::tuple_element_t<Is, TupleType>>(j, argNames[Is])...);
+        std::array<const nlohmann::json*, sizeof...(Is)> values{};
+        if (j.is_object())
+        {
+            for (auto it = j.begin(); it != j.end(); ++it)
+            {
+                const std::string& key = it.key();
+                for (std::size_t i = 0; i < values.size(); ++i)
+                {
+                    if (!values[i] && argNames[i] == key)
+                    {
+                        values[i] = &*it;
+                        break;
+                    }
+                }
+            }
+        }
+        return TupleType{parseArgValue<std::tuple_element_t<Is, TupleType>>(values[Is], argNames[Is])...};
     }
 
     /**
@@ -0,0 +1,19 @@
+﻿#pragma once
+
+#ifndef GEMINI_GZIP_H
+#define GEMINI_GZIP_H
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace GeminiCPP::Internal
+{
+    /**
+     * @brief Compresses data in the gzip format (RFC 1952), e.g. for a Content-Encoding: gzip body.
+     * @return The compressed bytes, or nullopt if compression failed or the library was built without zlib.
+     */
+    [[nodiscard]] std::optional<std::string> gzipCompress(std::string_view data);
+}
+
+#endif // GEMINI_GZIP_H
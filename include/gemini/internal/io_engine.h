@@ -0,0 +1,61 @@
+﻿#pragma once
+
+#ifndef GEMINI_IO_ENGINE_H
+#define GEMINI_IO_ENGINE_H
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace GeminiCPP::Internal
+{
+    /**
+     * @brief One append of an IoEngine batch. Empty data only syncs the file.
+     */
+    struct FileAppend
+    {
+        std::filesystem::path path;
+        std::string data;
+    };
+
+    /**
+     * @brief Batched file appends, used by LocalStorage's group commit.
+     * * When built with GEMINI_USE_IO_URING on Linux and the kernel allows it, a whole batch of appends and
+     * their fsyncs goes to the kernel through an io_uring in one system call and completes concurrently.
+     * Otherwise (other platforms, older kernels, io_uring disabled by a sandbox) the appends run one by one
+     * with the portable stdio implementation, with identical results. Reads (loads, file ingestion) do not go
+     * through the engine: a whole-file read is a single system call either way.
+     */
+    class IoEngine
+    {
+    public:
+        /**
+         * @brief Process-wide engine; io_uring is probed once, on first use.
+         */
+        static IoEngine& instance();
+
+        ~IoEngine();
+        IoEngine(const IoEngine&) = delete;
+        IoEngine& operator=(const IoEngine&) = delete;
+
+        /**
+         * @brief Checks whether operations go through io_uring.
+         */
+        [[nodiscard]] bool usesIoUring() const;
+
+        /**
+         * @brief Appends each entry to its file (created if needed), then fsyncs every file if sync is set.
+         * @return Per entry, whether its append (and sync) succeeded.
+         */
+        std::vector<bool> appendBatch(const std::vector<FileAppend>& appends, bool sync);
+
+    private:
+        IoEngine();
+
+        struct Ring;
+        std::unique_ptr<Ring> ring_; ///< Null when falling back to stdio.
+    };
+}
+
+#endif // GEMINI_IO_ENGINE_H
@@ -0,0 +1,46 @@
+﻿#pragma once
+
+#ifndef GEMINI_JOURNAL_H
+#define GEMINI_JOURNAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace GeminiCPP::Internal
+{
+    /**
+     * @brief CRC-32 (IEEE 802.3, as used by zlib) of the given bytes.
+     */
+    [[nodiscard]] uint32_t crc32(std::string_view data, uint32_t crc = 0);
+
+    /**
+     * @brief Frames one journal record: "<crc32 as 8 hex digits> <payload>\n".
+     * @param payload Must not contain a newline (compact JSON never does).
+     */
+    [[nodiscard]] std::string encodeJournalRecord(std::string_view payload);
+
+    struct JournalContents
+    {
+        std::vector<std::string> records; ///< Payloads of the intact records, in file order.
+        std::vector<size_t> recordEnds;   ///< File offset just past each record.
+        size_t validBytes = 0;            ///< Length of the intact prefix of the file.
+        bool torn = false;                ///< The file continues past validBytes with an incomplete or corrupt record.
+    };
+
+    /**
+     * @brief Reads a journal, stopping at the first record that is incomplete or fails its checksum.
+     * @details A missing file reads as an empty journal.
+     */
+    [[nodiscard]] JournalContents readJournal(const std::filesystem::path& path);
+
+    /**
+     * @brief Parses journal bytes already in memory (e.g. the tail of a journal); offsets are relative to data.
+     */
+    [[nodiscard]] JournalContents parseJournal(std::string_view data);
+}
+
+#endif // GEMINI_JOURNAL_H
@@ -0,0 +1,17 @@
+﻿#pragma once
+
+#ifndef GEMINI_SHA256_H
+#define GEMINI_SHA256_H
+
+#include <string>
+#include <string_view>
+
+namespace GeminiCPP::Internal
+{
+    /**
+     * @brief SHA-256 digest of the given bytes as 64 lowercase hex digits.
+     */
+    [[nodiscard]] std::string sha256Hex(std::string_view data);
+}
+
+#endif // GEMINI_SHA256_H
@@ -27,6 +27,17 @@ namespace GeminiCPP
          */
         [[nodiscard]] static std::shared_ptr<dtlog::logger<>> getLogger();
 
+        /**
+         * @brief Moves the writing of log messages off the threads that log them.
+         * @details Wraps every sink of the logger in a dtlog::async_sink, so GEMINI_WARN and friends only copy
+         * the message into a ring buffer and never wait for console or file I/O. Messages still queued are
+         * written when the logger is destroyed; call getLogger()->flush() to wait for them earlier.
+         * Call once at startup, before other threads log.
+         * @param capacity Number of messages each sink's ring buffer holds.
+         * @param policy What happens to messages logged while a ring buffer is full.
+         */
+        static void enableAsync(size_t capacity = 8192, dtlog::overflow_policy policy = dtlog::overflow_policy::block);
+
     private:
         // Singleton instance
         static std::shared_ptr<dtlog::logger<>> logger_;
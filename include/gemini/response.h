@@ -68,6 +68,8 @@ namespace GeminiCPP
         int inputTokens = 0;
         int outputTokens = 0;
         int totalTokens = 0;
+        /// @brief Number of prompt tokens served from the cached content (0 if no cache was hit).
+        int cachedTokens = 0;
 
         std::optional<GroundingMetadata> groundingMetadata;
 
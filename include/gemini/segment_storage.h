@@ -0,0 +1,159 @@
+﻿#pragma once
+
+#ifndef GEMINI_SEGMENT_STORAGE_H
+#define GEMINI_SEGMENT_STORAGE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "storage.h"
+
+namespace GeminiCPP
+{
+    /**
+     * @brief Tuning of a SegmentStorage.
+     */
+    struct SegmentStorageOptions
+    {
+        size_t maxSegmentBytes = 64 << 20; ///< A segment is sealed and a new one started past this size.
+        double compactionThreshold = 0.5;  ///< Sealed segments with less than this fraction of live bytes are compacted.
+        std::chrono::milliseconds compactionInterval{1000}; ///< How often an idle writer looks for a segment to compact.
+        bool durable = true;               ///< fsync each group commit before the saves it contains complete.
+        SessionEncoding encoding = SessionEncoding::MessagePack; ///< Json is stored as MessagePack.
+        BlobOffloadPolicy blobs;           ///< Moves large inline media out of the segments; off by default.
+    };
+
+    /**
+     * @brief IChatStorage packing all sessions into a few append-only segment files.
+     * * Every save appends the whole session (a SessionCodec container) as one checksummed record to the
+     * active segment, and a hash index maps each session id to its latest record, so a load is one lookup
+     * and one read regardless of how many sessions are stored. The index is rebuilt by scanning the
+     * segments when the storage is opened; a torn record at the end of the last segment is truncated away.
+     * A segment file that cannot be read is left untouched and its sessions are missing; saves never go to it.
+     * * Saves are queued to a single writer thread that group-commits them: all saves queued while the
+     * previous batch was being written go out in one write and one fsync. Saves of the same session in a
+     * batch keep only the latest. save() waits for its batch; saveAsync() returns at once. A load sees
+     * every completed save (save() returned, the saveAsync() future is ready, or flush() returned).
+     * * Superseded records are garbage. When idle, the writer compacts the sealed segment with the least
+     * live data (below SegmentStorageOptions::compactionThreshold) by copying its live records to the
+     * active segment and deleting it.
+     * * Only one SegmentStorage may open a directory at a time.
+     */
+    class SegmentStorage : public IChatStorage
+    {
+    public:
+        /**
+         * @param rootPath Directory holding the segment files (seg-<number>.log).
+         */
+        explicit SegmentStorage(std::string rootPath = "sessions", SegmentStorageOptions options = {});
+
+        /**
+         * @brief Completes the queued saves, then stops the writer.
+         */
+        ~SegmentStorage() override;
+
+        SegmentStorage(const SegmentStorage&) = delete;
+        SegmentStorage& operator=(const SegmentStorage&) = delete;
+
+        bool save(const ChatSession& session) override;
+        [[nodiscard]] Result<ChatSession> load(const std::string& sessionId, Client* client) override;
+
+        /**
+         * @brief Lists available session IDs, sorted.
+         */
+        [[nodiscard]] std::vector<std::string> listSessions() override;
+
+        [[nodiscard]] std::future<bool> saveAsync(const ChatSession& session) override;
+        [[nodiscard]] std::future<Result<ChatSession>> loadAsync(const std::string& sessionId, Client* client) override;
+        [[nodiscard]] std::future<std::vector<std::string>> listSessionsAsync() override;
+
+        /**
+         * @brief Deletes a session (appends a tombstone).
+         * @return false if the tombstone could not be written.
+         */
+        bool remove(const std::string& sessionId);
+
+        /**
+         * @brief Blocks until everything queued before the call is written (and synced, if durable).
+         */
+        void flush();
+
+        /**
+         * @brief Number of segment files, including the active one.
+         */
+        [[nodiscard]] size_t segmentCount() const;
+
+    private:
+        enum class RecordType : uint8_t
+        {
+            Put = 1,
+            Remove = 2
+        };
+
+        struct Location
+        {
+            uint64_t segment = 0;
+            uint64_t offset = 0; ///< Of the record, header included.
+            uint32_t length = 0; ///< Of the whole record.
+        };
+
+        struct Segment
+        {
+            uint64_t bytes = 0;
+            uint64_t liveBytes = 0;
+        };
+
+        struct PendingWrite
+        {
+            RecordType type;
+            std::string id;
+            std::string payload;
+            std::vector<std::promise<bool>> done; ///< One per coalesced save.
+        };
+
+        void open();
+        void run();
+
+        // Writer thread only.
+        bool commit(std::vector<PendingWrite>& batch);
+        bool appendRecords(const std::string& data, std::vector<Location>& locations, const std::vector<size_t>& recordSizes, bool durable);
+        bool compactOne();
+        void rollSegment();
+
+        [[nodiscard]] std::future<bool> enqueue(RecordType type, std::string id, std::string payload);
+        [[nodiscard]] std::filesystem::path segmentPath(uint64_t segment) const;
+
+        // Expects mutex_ to be held.
+        void place(const std::string& id, RecordType type, const Location& location);
+
+        std::filesystem::path rootPath_;
+        SegmentStorageOptions options_;
+
+        mutable std::mutex mutex_;
+        std::condition_variable cv_;
+        std::unordered_map<std::string, Location> index_;
+        std::map<uint64_t, Segment> segments_; ///< By number; the last one is active.
+        uint64_t nextSegment_ = 1; ///< Higher than any segment file found, readable or not, so none is reused.
+        std::vector<PendingWrite> queue_;                ///< The next batch.
+        std::unordered_map<std::string, size_t> queued_; ///< Session id -> its write in queue_.
+        uint64_t submitted_ = 0;  ///< Writes ever queued (coalesced ones included).
+        uint64_t committed_ = 0;  ///< Writes ever completed.
+        std::condition_variable flushed_;
+        bool stopping_ = false;
+
+        std::vector<uint64_t> obsolete_; ///< Compacted segments whose file could not be deleted yet.
+
+        std::thread writer_; ///< Declared last: started after everything else is initialized.
+    };
+}
+
+#endif // GEMINI_SEGMENT_STORAGE_H
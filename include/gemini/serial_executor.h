@@ -0,0 +1,109 @@
+﻿#pragma once
+
+#ifndef GEMINI_SERIAL_EXECUTOR_H
+#define GEMINI_SERIAL_EXECUTOR_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+namespace GeminiCPP
+{
+    class ThreadPool;
+
+    struct SerialExecutorStats
+    {
+        size_t submitted = 0;
+        size_t completed = 0;
+        size_t cancelled = 0;
+        size_t queued = 0;        ///< Waiting to run (the running task excluded).
+        size_t maxQueued = 0;     ///< Highest queue depth seen.
+        bool running = false;
+    };
+
+    /**
+     * @brief Mailbox running its tasks one at a time, in submission order, on a shared ThreadPool.
+     * * Tasks of one executor never overlap, while many executors (e.g. one per chat session) run in
+     * parallel on the same pool. An executor only occupies a worker while it has something to run, and
+     * goes back to the end of the pool's queue after each task, so a long backlog in one executor does
+     * not starve the others.
+     * * Queued tasks can be cancelled; their cancel callback runs instead (e.g. to complete a future).
+     * Destroying the executor cancels what is queued and waits for the running task.
+     */
+    class SerialExecutor
+    {
+    public:
+        using TaskId = uint64_t;
+
+        /**
+         * @param pool Where tasks run. nullptr uses defaultPool(); must outlive the executor.
+         */
+        explicit SerialExecutor(ThreadPool* pool = nullptr);
+        ~SerialExecutor();
+
+        SerialExecutor(const SerialExecutor&) = delete;
+        SerialExecutor& operator=(const SerialExecutor&) = delete;
+
+        /**
+         * @brief Queues a task behind the ones already submitted.
+         * @param onCancel Called instead of task if the task is cancelled before it starts.
+         */
+        TaskId submit(std::function<void()> task, std::function<void()> onCancel = {});
+
+        /**
+         * @brief Cancels a task that has not started yet.
+         * @return false if it is running, finished or unknown.
+         */
+        bool cancel(TaskId id);
+
+        /**
+         * @brief Cancels every task that has not started yet.
+         * @return The number of tasks cancelled.
+         */
+        size_t cancelAll();
+
+        /**
+         * @brief Blocks until nothing is queued or running.
+         */
+        void wait();
+
+        /**
+         * @brief Changes the pool used from the next task on.
+         */
+        void setPool(ThreadPool* pool);
+
+        [[nodiscard]] size_t queued() const;
+        [[nodiscard]] SerialExecutorStats stats() const;
+
+        /**
+         * @brief Process-wide pool for serial executors that were not given one.
+         * @details Separate from ThreadPool::shared(): tasks such as chat turns block on function calls that
+         * run there, and would deadlock it if they occupied all of its workers.
+         */
+        [[nodiscard]] static ThreadPool& defaultPool();
+
+    private:
+        struct Task
+        {
+            TaskId id;
+            std::function<void()> run;
+            std::function<void()> onCancel;
+        };
+
+        void schedule(); // Expects mutex_ to be held.
+        void runNext();
+
+        ThreadPool* pool_;
+        mutable std::mutex mutex_;
+        std::condition_variable idle_;
+        std::deque<Task> queue_;
+        TaskId nextId_ = 0;
+        bool scheduled_ = false; ///< A runNext() is queued on or running in the pool.
+        SerialExecutorStats stats_;
+    };
+}
+
+#endif // GEMINI_SERIAL_EXECUTOR_H
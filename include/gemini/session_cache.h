@@ -0,0 +1,155 @@
+﻿#pragma once
+
+#ifndef GEMINI_SESSION_CACHE_H
+#define GEMINI_SESSION_CACHE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "storage.h"
+
+namespace GeminiCPP
+{
+    enum class CacheWriteMode
+    {
+        WriteThrough, ///< save() returns once the backend has the session.
+        WriteBack     ///< save() returns at once; the session is written to the backend in the background.
+    };
+
+    /**
+     * @brief Tuning of a CachedStorage.
+     */
+    struct SessionCacheOptions
+    {
+        size_t maxBytes = 64 << 20; ///< Memory budget for cached sessions (approximate: JSON size of their turns and fields).
+        std::shared_ptr<IChatStorage> diskTier; ///< Optional second tier (e.g. a LocalStorage) receiving sessions evicted from memory.
+        CacheWriteMode writeMode = CacheWriteMode::WriteThrough;
+        std::chrono::milliseconds writeBackInterval{1000}; ///< How long a WriteBack save may wait before it is written.
+    };
+
+    struct SessionCacheStats
+    {
+        size_t hits = 0;           ///< Loads served from memory.
+        size_t diskHits = 0;       ///< Loads served from the disk tier.
+        size_t misses = 0;         ///< Loads that went to the backend.
+        size_t coalescedLoads = 0; ///< Loads that waited for an identical load already in flight.
+        size_t evictions = 0;      ///< Sessions dropped from memory to stay within maxBytes.
+        size_t writeBackFailures = 0;
+        size_t entries = 0;
+        size_t bytes = 0;
+        size_t dirty = 0;          ///< WriteBack saves not yet written to the backend.
+    };
+
+    /**
+     * @brief IChatStorage decorator caching sessions in front of a slower one (typically a RemoteStorage).
+     * * Recently used sessions are kept in memory as snapshots, whose history is shared with the sessions
+     * handed out, so a hit costs no deserialization and no copy of the turns. The least recently used ones
+     * are evicted past SessionCacheOptions::maxBytes and, with a disk tier, written to it on a background
+     * thread; a later load is then served from disk before falling back to the backend. Only copies the
+     * cache wrote itself are read back from the disk tier, and a save makes the disk copy of that session stale.
+     * * Concurrent loads of the same session share one fetch (single flight). Failed loads are not cached.
+     * * With CacheWriteMode::WriteThrough a save writes to the backend first and caches the session once that
+     * succeeded. With WriteBack it only marks the cached session dirty: a writer thread saves dirty sessions
+     * every writeBackInterval (or at flush(), or when memory is over budget). Dirty sessions are never evicted,
+     * and listSessions() includes those not written yet. A write that fails is retried on the next round.
+     * * The cache assumes it is the only writer of the sessions it serves; use invalidate() when a session
+     * may have been changed behind its back.
+     */
+    class CachedStorage : public IChatStorage
+    {
+    public:
+        explicit CachedStorage(std::shared_ptr<IChatStorage> backend, SessionCacheOptions options = {});
+
+        /**
+         * @brief Writes pending WriteBack saves, then stops the writer.
+         */
+        ~CachedStorage() override;
+
+        CachedStorage(const CachedStorage&) = delete;
+        CachedStorage& operator=(const CachedStorage&) = delete;
+
+        bool save(const ChatSession& session) override;
+        [[nodiscard]] Result<ChatSession> load(const std::string& sessionId, Client* client) override;
+        [[nodiscard]] std::vector<std::string> listSessions() override;
+
+        [[nodiscard]] std::future<bool> saveAsync(const ChatSession& session) override;
+        [[nodiscard]] std::future<Result<ChatSession>> loadAsync(const std::string& sessionId, Client* client) override;
+        [[nodiscard]] std::future<std::vector<std::string>> listSessionsAsync() override;
+
+        /**
+         * @brief Blocks until every WriteBack save made before the call has been attempted.
+         * @return false if some dirty session could not be written.
+         */
+        bool flush();
+
+        /**
+         * @brief Forgets a session (memory and disk tier), so the next load reads it from the backend.
+         * @details A dirty session is kept: dropping it would lose the save.
+         */
+        void invalidate(const std::string& sessionId);
+
+        [[nodiscard]] SessionCacheStats stats() const;
+
+    private:
+        struct Entry
+        {
+            std::string id;
+            ChatSessionSnapshot snapshot;
+            size_t bytes = 0;
+            uint64_t version = 0;  ///< Changes with every save, so a finished write can tell if it is still current.
+            bool dirty = false;
+            bool onDisk = false;   ///< The disk tier holds this exact version.
+        };
+
+        using LoadResult = Result<ChatSessionSnapshot>;
+
+        [[nodiscard]] LoadResult fetch(const std::string& sessionId);
+        [[nodiscard]] static size_t entryBytes(const ChatSessionSnapshot& snapshot);
+        [[nodiscard]] static Result<ChatSession> toSession(const LoadResult& result, Client* client);
+
+        void run();
+
+        // Expect mutex_ to be held.
+        void insert(ChatSessionSnapshot snapshot, bool dirty, bool onDisk);
+        void erase(std::list<Entry>::iterator entry);
+        void evict();
+        void demote(const Entry& entry);
+
+        std::shared_ptr<IChatStorage> backend_;
+        SessionCacheOptions options_;
+
+        mutable std::mutex mutex_;
+        std::list<Entry> entries_; ///< Most recently used first.
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> index_; ///< Ids point into entries_.
+        std::unordered_map<std::string, std::shared_future<LoadResult>> inflight_;
+        std::unordered_set<std::string> onDisk_;               ///< Sessions whose disk tier copy is current.
+        std::unordered_map<std::string, uint64_t> demoting_;   ///< Session id -> version being written to the disk tier.
+        size_t bytes_ = 0;
+        uint64_t nextVersion_ = 0;
+        SessionCacheStats stats_;
+
+        // WriteBack.
+        std::condition_variable cv_;
+        std::condition_variable flushed_;
+        uint64_t flushRequested_ = 0; ///< flush() calls so far.
+        uint64_t flushCompleted_ = 0; ///< flush() calls served by a finished write round.
+        bool lastRoundOk_ = true;
+        bool stopping_ = false;
+
+        ThreadPool demoter_{1}; ///< Writes evicted sessions to the disk tier, in eviction order.
+        std::thread writer_;    ///< Declared last: started after everything else is initialized.
+    };
+}
+
+#endif // GEMINI_SESSION_CACHE_H
@@ -0,0 +1,164 @@
+﻿#pragma once
+
+#ifndef GEMINI_SESSION_CATALOG_H
+#define GEMINI_SESSION_CATALOG_H
+
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace GeminiCPP
+{
+    /**
+     * @brief Catalog entry describing a stored session without loading it.
+     */
+    struct SessionInfo
+    {
+        std::string id;
+        std::string name;
+        std::string model;
+        size_t turnCount = 0;
+        std::chrono::system_clock::time_point updatedAt{};
+        size_t bytes = 0; ///< Size of the session's files on disk (snapshot and journal; blobs excluded).
+
+        [[nodiscard]] nlohmann::json toJson() const;
+        [[nodiscard]] static SessionInfo fromJson(const nlohmann::json& j);
+    };
+
+    enum class SessionSortKey
+    {
+        UpdatedAt,
+        Name,
+        Id,
+        TurnCount,
+        Bytes
+    };
+
+    /**
+     * @brief Filter, order and page of a catalog listing.
+     */
+    struct SessionQuery
+    {
+        std::string nameContains; ///< Substring the name must contain (case-sensitive); empty matches all.
+        std::string model;        ///< Exact model; empty matches all.
+        std::optional<std::chrono::system_clock::time_point> updatedAfter;  ///< Exclusive.
+        std::optional<std::chrono::system_clock::time_point> updatedBefore; ///< Exclusive.
+
+        SessionSortKey sortBy = SessionSortKey::UpdatedAt;
+        bool descending = true; ///< Ties are always broken by ascending id, so pages are stable.
+        size_t offset = 0;
+        size_t limit = 50;
+    };
+
+    struct SessionPage
+    {
+        std::vector<SessionInfo> sessions;
+        size_t total = 0; ///< Number of sessions matching the filter, across all pages.
+    };
+
+    /**
+     * @brief Persistent index of session metadata, kept in memory and backed by a journal file.
+     * * Every change is one checksummed journal record (see Internal::encodeJournalRecord()), so an update
+     * is applied completely or not at all; a torn final record is dropped when the catalog is opened. The
+     * file is rewritten with one record per session once superseded records dominate it.
+     * * Writers bracket each batch of session writes with beginBatch()/endBatch(). A batch left open by a
+     * crash is reported by unfinished() on the next open(), so its sessions can be re-indexed from their
+     * files even if they never got a catalog record.
+     * * Several catalogs, in one process or several, may share the file. Appends and rewrites hold a lock
+     * file (<path>.lock) and first read the records the others appended, so a rewrite keeps them; refresh()
+     * reads them without the lock.
+     * * Queries only touch the in-memory index: filtering is a linear scan and sorting a partial sort of the
+     * requested page, so listing millions of sessions never reads their files.
+     */
+    class SessionCatalog
+    {
+    public:
+        /**
+         * @param path The catalog file.
+         * @param durable fsync every update.
+         */
+        explicit SessionCatalog(std::filesystem::path path, bool durable = false);
+
+        /**
+         * @brief Loads the catalog file.
+         * @return false if there was no catalog file yet (the owner should rebuild the index).
+         */
+        bool open();
+
+        /**
+         * @brief Applies the records other writers appended since the last read (or the file they rewrote).
+         */
+        void refresh();
+
+        /**
+         * @brief Inserts or replaces the entry of info.id.
+         */
+        bool upsert(const SessionInfo& info);
+
+        bool remove(const std::string& id);
+
+        /**
+         * @brief Records that the sessions in ids are about to be written.
+         * @param sync fsync the record, so it is on disk before any of the session files change.
+         * @return The batch to pass to endBatch().
+         */
+        uint64_t beginBatch(const std::vector<std::string>& ids, bool sync);
+
+        /**
+         * @brief Records that a batch is complete: its sessions' catalog records are up to date.
+         */
+        void endBatch(uint64_t batch);
+
+        /**
+         * @brief Returns the sessions of batches that were begun but never ended, sorted.
+         */
+        [[nodiscard]] std::vector<std::string> unfinished() const;
+
+        /**
+         * @brief Ends every open batch, once the owner has re-indexed the sessions of unfinished().
+         */
+        void clearUnfinished();
+
+        [[nodiscard]] std::optional<SessionInfo> find(const std::string& id) const;
+        [[nodiscard]] SessionPage query(const SessionQuery& query) const;
+
+        /**
+         * @brief Returns the ids of all sessions, sorted.
+         */
+        [[nodiscard]] std::vector<std::string> ids() const;
+
+        [[nodiscard]] size_t size() const;
+
+    private:
+        // These expect mutex_ to be held. append() also applies the record to the index.
+        bool append(const nlohmann::json& record, bool sync = false);
+        void apply(const nlohmann::json& record);
+        void catchUp(bool repair); // repair: truncate a torn end; only with the file lock held.
+        void reset();
+
+        // Expects the file lock to be held too.
+        bool compact();
+
+        std::filesystem::path path_;
+        std::filesystem::path lockPath_;
+        bool durable_;
+
+        mutable std::mutex mutex_;
+        std::unordered_map<std::string, SessionInfo> entries_;
+        size_t records_ = 0; ///< Records in the file, including superseded ones.
+        std::map<uint64_t, std::vector<std::string>> openBatches_; ///< Begun and not yet ended, by batch number.
+        uint64_t readBytes_ = 0;  ///< Length of the file prefix applied to the index.
+        std::string head_;        ///< First bytes of the file as read; they change when any writer rewrites it.
+        std::mt19937_64 random_{std::random_device{}()}; ///< Batch numbers and rewrite generations, unique across writers.
+    };
+}
+
+#endif // GEMINI_SESSION_CATALOG_H
@@ -0,0 +1,68 @@
+﻿#pragma once
+
+#ifndef GEMINI_SESSION_CODEC_H
+#define GEMINI_SESSION_CODEC_H
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <nlohmann/json.hpp>
+
+#include "blob_store.h"
+#include "chat_session.h"
+
+namespace GeminiCPP
+{
+    /**
+     * @brief On-disk encoding of a session snapshot.
+     */
+    enum class SessionEncoding : uint8_t
+    {
+        Json = 0,        ///< ChatSession::toJson() as text.
+        MessagePack = 1, ///< Binary container, turns encoded as MessagePack.
+        Cbor = 2         ///< Binary container, turns encoded as CBOR.
+    };
+
+    /**
+     * @brief Encodes session snapshots in a compact binary container with an index of the turns.
+     * * Layout: the magic "GSES", a version byte, an encoding byte, the header length (4 bytes, little
+     * endian), the header, then the encoded turns back to back. The header holds the session metadata,
+     * the turn tokens, caller-defined attributes and, per turn, [offset, length, JSON size].
+     * * decode() only parses the header. Turns are appended to the history lazily and decoded on first
+     * access, so cold-starting a large session does not decode turns it never sends. Lazy turns keep the
+     * encoded buffer alive until they are released.
+     * * With a BlobOffloadPolicy, large inline payloads are stored as blob references (see BlobOffload) and
+     * fetched back when a turn is decoded.
+     */
+    class SessionCodec
+    {
+    public:
+        /**
+         * @param encoding MessagePack or Cbor.
+         * @param attributes Extra header fields for the caller (e.g. storage bookkeeping).
+         * @param blobs Where to offload large inline payloads; disabled by default.
+         */
+        [[nodiscard]] static std::string encode(const ChatSessionSnapshot& snapshot, SessionEncoding encoding,
+                                                const nlohmann::json& attributes = nlohmann::json::object(),
+                                                const BlobOffloadPolicy& blobs = {});
+
+        /**
+         * @brief Parses the header and sets up lazy turns.
+         * @param attributes Receives the attributes passed to encode(), if not null.
+         * @param blobs Resolves the blob references of the turns, if any.
+         * @return nullopt if data is not a valid session container.
+         */
+        [[nodiscard]] static std::optional<ChatSessionSnapshot> decode(std::shared_ptr<const std::string> data,
+                                                                       nlohmann::json* attributes = nullptr,
+                                                                       std::shared_ptr<IBlobStore> blobs = nullptr);
+
+        /**
+         * @brief Checks for the container magic.
+         */
+        [[nodiscard]] static bool isBinary(std::string_view data);
+    };
+}
+
+#endif // GEMINI_SESSION_CODEC_H
@@ -0,0 +1,166 @@
+﻿#pragma once
+
+#ifndef GEMINI_SESSION_MANAGER_H
+#define GEMINI_SESSION_MANAGER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+#include "storage.h"
+
+namespace GeminiCPP
+{
+    /**
+     * @brief Tuning of a SessionManager.
+     */
+    struct SessionManagerOptions
+    {
+        std::shared_ptr<IChatStorage> storage; ///< Idle sessions are evicted to and rehydrated from it. Without one, nothing is evicted.
+        size_t memoryBudget = 512 << 20;       ///< Bytes of live sessions (mostly their history) above which idle ones are evicted.
+        std::chrono::milliseconds idleTimeout{0};      ///< Also evict sessions unused for this long, within budget or not. 0 = only under memory pressure.
+        std::chrono::milliseconds sweepInterval{1000}; ///< How often memory is re-measured and idle sessions evicted.
+        size_t shards = 0; ///< Independently locked partitions of the session map. 0 = 4 per hardware thread.
+    };
+
+    struct SessionManagerStats
+    {
+        size_t sessions = 0;        ///< Live (in memory) sessions.
+        size_t bytes = 0;           ///< Their accounted memory, as of the last sweep.
+        size_t hits = 0;            ///< get() calls served from memory.
+        size_t rehydrations = 0;    ///< Sessions loaded back from storage.
+        size_t coalescedLoads = 0;  ///< get() calls that waited for a rehydration already in flight.
+        size_t evictions = 0;
+        size_t evictionFailures = 0; ///< Evictions abandoned because the save failed.
+    };
+
+    /**
+     * @brief Hosts many live ChatSessions (e.g. one per end-user conversation), keyed by session id.
+     * * Sessions live in a map split into shards, each with its own lock, so lookups of different sessions
+     * scale across cores. The manager owns the sessions and hands out shared pointers to them.
+     * * Each session is charged sizeof(ChatSession) plus the serialized size of its history. A sweeper thread
+     * re-measures the sessions every sweepInterval and, while the total is over memoryBudget (or for sessions
+     * unused for idleTimeout), evicts idle sessions to storage, least recently used first. A session is idle
+     * while the manager holds the only reference to it and it has no async turn queued or running; one in use
+     * is never evicted. Eviction saves the
+     * session and drops it from memory unless it was accessed while being saved.
+     * * get() of an evicted session loads it back from storage transparently; concurrent get() calls for it
+     * share one load.
+     * * Sessions still live when the manager is destroyed are saved to storage.
+     */
+    class SessionManager
+    {
+    public:
+        /**
+         * @param client Client given to created and rehydrated sessions.
+         */
+        explicit SessionManager(Client* client, SessionManagerOptions options = {});
+
+        /**
+         * @brief Stops the sweeper, then saves every live session to storage.
+         */
+        ~SessionManager();
+
+        SessionManager(const SessionManager&) = delete;
+        SessionManager& operator=(const SessionManager&) = delete;
+
+        /**
+         * @brief Creates a new live session.
+         * @details If a session with that id is already live, it is returned instead. An id only known to
+         * storage is not looked up: use get() to resume a conversation.
+         * @param sessionId Optional ID (generated if empty).
+         */
+        [[nodiscard]] std::shared_ptr<ChatSession> create(std::string_view model, std::string sessionName = "", std::string sessionId = "");
+
+        /**
+         * @brief Returns a live session, rehydrating it from storage if it was evicted.
+         * @return NOT_FOUND if it is neither live nor in storage.
+         */
+        [[nodiscard]] Result<std::shared_ptr<ChatSession>> get(const std::string& sessionId);
+
+        /**
+         * @brief Whether the session is live (in memory).
+         */
+        [[nodiscard]] bool contains(const std::string& sessionId) const;
+
+        /**
+         * @brief Drops a live session from memory without saving it. Holders of the pointer keep the object.
+         * @return false if it was not live.
+         */
+        bool remove(const std::string& sessionId);
+
+        /**
+         * @brief Runs one sweep now: re-measures the live sessions and evicts idle ones as needed.
+         * @return The number of sessions evicted.
+         */
+        size_t evictIdle();
+
+        /**
+         * @brief Saves every live session to storage (they stay live).
+         * @return false if there is no storage or a save failed.
+         */
+        bool saveAll();
+
+        [[nodiscard]] size_t size() const;
+        [[nodiscard]] size_t memoryBytes() const;
+        [[nodiscard]] SessionManagerStats stats() const;
+
+    private:
+        using Clock = std::chrono::steady_clock;
+        using LoadResult = Result<std::shared_ptr<ChatSession>>;
+
+        struct Entry
+        {
+            std::shared_ptr<ChatSession> session;
+            size_t bytes = 0;
+            Clock::time_point lastAccess;
+            uint64_t accesses = 0; ///< Bumped by every get(), so an eviction can tell the session was used meanwhile.
+            bool evicting = false;
+        };
+
+        struct alignas(64) Shard
+        {
+            mutable std::mutex mutex;
+            std::unordered_map<std::string, Entry> sessions;
+            std::unordered_map<std::string, std::shared_future<LoadResult>> loading;
+        };
+
+        [[nodiscard]] Shard& shardFor(const std::string& sessionId) const;
+        [[nodiscard]] static size_t sessionBytes(const ChatSession& session);
+
+        [[nodiscard]] LoadResult rehydrate(const std::string& sessionId);
+        bool evict(Shard& shard, const std::string& sessionId, uint64_t accesses);
+        size_t sweep(); // Expects sweepMutex_ to be held.
+        void run();
+
+        Client* client_;
+        SessionManagerOptions options_;
+
+        size_t shardCount_;
+        std::unique_ptr<Shard[]> shards_;
+
+        std::atomic<size_t> sessions_{0};
+        std::atomic<size_t> bytes_{0};
+        std::atomic<size_t> hits_{0};
+        std::atomic<size_t> rehydrations_{0};
+        std::atomic<size_t> coalescedLoads_{0};
+        std::atomic<size_t> evictions_{0};
+        std::atomic<size_t> evictionFailures_{0};
+
+        std::mutex sweepMutex_; ///< Serializes sweeps; also guards stopping_.
+        std::condition_variable sweepCv_;
+        bool stopping_ = false;
+
+        std::thread sweeper_; ///< Declared last: started after everything else is initialized.
+    };
+}
+
+#endif // GEMINI_SESSION_MANAGER_H
@@ -3,11 +3,23 @@
 #ifndef GEMINI_STORAGE_H
 #define GEMINI_STORAGE_H
 
+#include <atomic>
+#include <chrono>
 #include <string>
 #include <vector>
+#include <condition_variable>
+#include <deque>
 #include <filesystem>
+#include <mutex>
+#include <random>
+#include <unordered_map>
 
+#include "blob_store.h"
 #include "chat_session.h"
+#include "internal/io_engine.h"
+#include "session_catalog.h"
+#include "session_codec.h"
+#include "thread_pool.h"
 
 namespace GeminiCPP
 {
@@ -56,8 +68,50 @@ namespace GeminiCPP
         [[nodiscard]] virtual std::future<std::vector<std::string>> listSessionsAsync() = 0;
     };
 
+    /**
+     * @brief Tuning of the session journals written by LocalStorage.
+     */
+    struct LocalStorageOptions
+    {
+        size_t minCompactionBytes = 1 << 20; ///< Journals smaller than this are never compacted.
+        double compactionRatio = 1.0;        ///< Compact once the journal is larger than this multiple of the snapshot.
+        bool durable = false;                ///< fsync every write, so saves also survive power loss (not only crashes).
+        SessionEncoding encoding = SessionEncoding::Json; ///< Snapshot format; binary ones load their history lazily.
+        BlobOffloadPolicy blobs;             ///< Moves large inline media out of snapshots and journals; off by default.
+    };
+
     /**
      * @brief Implementation of IChatStorage that saves sessions as JSON files on the local disk.
+     * * Each session is a snapshot plus an append-only journal <id>.journal. The snapshot is <id>.json (the
+     * ChatSession::toJson() format) or, with a binary SessionEncoding, <id>.session (see SessionCodec), whose
+     * turns are only decoded when the loaded session first needs them. Snapshots in either format load.
+     * * A save appends one checksummed record to the journal holding only the new turns and changed
+     * metadata, so its cost is proportional to what changed, not to the session size. Once the journal
+     * outgrows the snapshot it is compacted: the snapshot is rewritten atomically and the journal restarted.
+     * * Loading replays the journal over the snapshot. A torn or corrupt final record (e.g. after a crash
+     * during a save) is discarded and truncated away; the session loads as of the last complete save.
+     * * A full snapshot is also written when a session was not loaded or saved through this instance, or
+     * when its history was rewritten rather than appended to (e.g. clearHistory()).
+     * * With LocalStorageOptions::blobs set, large base64 payloads are written to the blob store once and the
+     * session files only reference them; turns holding references are rehydrated when first used.
+     * It also enables prefix sharing for forked sessions (ChatSession::fork()): the history a session shares
+     * with its parent is written to the blob store once, as one blob per fork point holding only the turns
+     * since the previous one, and the session's own snapshot holds only the turns after its last fork.
+     * * A SessionCatalog (<root>/.catalog) indexes the metadata of every session and is updated with each save,
+     * so listSessions() and querySessions() never scan the directory or open session files. Opening the
+     * storage lists the directory once and indexes session files the catalog lacks (all of them if it is
+     * missing, or those written before it existed). Each batch of saves is announced in the catalog (durably, with
+     * durable set) before any session file changes, so sessions of a batch cut short by a crash are
+     * re-indexed when the storage is next opened; an entry left stale otherwise is repaired when the session loads.
+     * * Saves go through a single writer thread. Each session has one pending slot holding its latest
+     * snapshot, so a burst of saves of one session collapses into a single journal record, and everything
+     * pending when the writer wakes up is written as one batch: with durable set, each touched journal is
+     * synced once per batch instead of once per save. The batch's appends and syncs are submitted together
+     * through Internal::IoEngine (io_uring when enabled). Loads see completed saves; call flush() first to
+     * also see the ones still queued.
+     * * Several instances, in one process or several, may share a root as long as each session is saved
+     * through only one of them at a time: the catalog is shared safely (see SessionCatalog), and listings
+     * include the sessions the others saved.
      */
     class LocalStorage : public IChatStorage
     {
@@ -65,11 +119,12 @@ namespace GeminiCPP
         /**
          * @brief Constructs a LocalStorage.
          * @param rootPath The directory where session files will be stored.
+         * @param options Journal compaction and durability settings.
          */
-        explicit LocalStorage(std::string rootPath = "chats");
+        explicit LocalStorage(std::string rootPath = "chats", LocalStorageOptions options = {});
 
         /**
-        * @brief Saves a chat session synchronously.
+        * @brief Saves a chat session synchronously (queues it and waits for its batch).
         */
         bool save(const ChatSession& session) override;
 
@@ -81,7 +136,7 @@ namespace GeminiCPP
         [[nodiscard]] Result<ChatSession> load(const std::string& sessionId, Client* client) override;
 
         /**
-        * @brief Lists available session IDs.
+        * @brief Lists available session IDs, sorted.
         */
         [[nodiscard]] std::vector<std::string> listSessions() override;
 
@@ -102,13 +157,114 @@ namespace GeminiCPP
         */
         [[nodiscard]] std::future<std::vector<std::string>> listSessionsAsync() override;
 
+        /**
+         * @brief Returns one page of the catalog, filtered and sorted as requested.
+         */
+        [[nodiscard]] SessionPage querySessions(const SessionQuery& query) const;
+
+        /**
+         * @brief Returns the catalog entry of a session, or nullopt if it is unknown.
+         */
+        [[nodiscard]] std::optional<SessionInfo> sessionInfo(const std::string& sessionId) const;
+
+        /**
+         * @brief Blocks until every save queued before the call is written (and synced, if durable).
+         */
+        void flush();
+
     private:
+        struct JournalState
+        {
+            History::Mark history;       ///< History as of the last write.
+            std::vector<int> turnTokens; ///< Turn tokens as of the last write.
+            nlohmann::json meta;         ///< Name, model, system instruction and summary as of the last write.
+            uint64_t generation = 0;     ///< Ties the journal to its snapshot.
+            size_t journalBytes = 0;
+            size_t snapshotBytes = 0;
+        };
+
+        struct SharedPrefix
+        {
+            History history; ///< The first turns of a forked history, as written (held, so siblings share them).
+            std::string key; ///< Blob holding them.
+        };
+
+        struct PendingSave
+        {
+            ChatSessionSnapshot snapshot;
+            std::vector<std::promise<bool>> done; ///< One per coalesced save.
+        };
+
+        void drain();
+
+        // These expect mutex_ to be held. Journal records are queued to deferredAppends for the caller to write.
+        bool persist(const ChatSessionSnapshot& snapshot, std::vector<Internal::FileAppend>& deferredAppends);
+        bool writeSession(const ChatSessionSnapshot& snapshot, std::vector<Internal::FileAppend>& deferredAppends);
+        bool writeSnapshot(const ChatSessionSnapshot& snapshot);
+        [[nodiscard]] std::optional<std::string> storePrefix(const ChatSessionSnapshot& snapshot, size_t forkIndex);
+        [[nodiscard]] std::optional<History> loadPrefix(const std::string& key);
+        void rememberPrefix(const History& prefix, const std::string& key);
+        void updateCatalog(const ChatSessionSnapshot& snapshot, std::chrono::system_clock::time_point updatedAt, bool force);
+
+        void rebuildCatalog();
+        void reconcileCatalog();
+
+        [[nodiscard]] std::filesystem::path snapshotPath(const std::string& sessionId, SessionEncoding encoding) const;
+        [[nodiscard]] std::filesystem::path journalPath(const std::string& sessionId) const;
+
         std::string rootPath_;
+        LocalStorageOptions options_;
+        mutable SessionCatalog catalog_; ///< Mutable: queries first read what other instances appended to it.
+
+        std::mutex mutex_;
+        std::unordered_map<std::string, JournalState> journals_;
+        std::deque<SharedPrefix> sharedPrefixes_; ///< Recently written or read prefixes (bounded), so siblings reuse them.
+        std::mt19937_64 random_{std::random_device{}()};
+
+        std::mutex pendingMutex_;
+        std::condition_variable flushed_;
+        std::vector<PendingSave> pending_;                      ///< The next batch, one slot per session.
+        std::unordered_map<std::string, size_t> pendingSlots_;  ///< Session id -> its slot in pending_.
+        bool draining_ = false;   ///< A drain() task is queued or running.
+        uint64_t submitted_ = 0;  ///< Saves ever queued (coalesced ones included).
+        uint64_t completed_ = 0;  ///< Saves ever completed.
+
+        ThreadPool writer_{1}; ///< Runs drain(). Declared last: drained first on destruction.
     };
     
+    /**
+     * @brief Transfer settings of a RemoteStorage.
+     */
+    struct RemoteStorageOptions
+    {
+        bool deltaSync = true;              ///< PATCH only the changes since the last synced version, when the server supports it.
+        bool conditionalLoads = true;       ///< Revalidate sessions loaded or saved before with If-None-Match.
+        bool compressRequests = true;       ///< gzip request bodies (only when built with zlib).
+        size_t compressionThreshold = 1024; ///< Smaller bodies are sent as is.
+        size_t maxIdleConnections = 4;      ///< Kept-alive HTTP connections reused across requests.
+        std::chrono::milliseconds timeout{30000};
+    };
+
     /**
      * @brief Implementation of IChatStorage that interacts with a remote server via REST API.
-     * @details Assumes standard endpoints: POST /chats (save), GET /chats/{id} (load), GET /chats (list).
+     * @details Endpoints: PUT /chats/{id} (save), GET /chats/{id} (load), GET /chats (list), and optionally
+     * PATCH /chats/{id} (delta save).
+     * * Versioning is driven by the server's ETag response header; servers that send none get a full PUT per
+     * save and unconditional loads, as before. With an ETag, the storage remembers the last version it
+     * synced for each session (sharing the history with the session, not copying it) and:
+     * - saves a session that only grew since then with a PATCH carrying If-Match: <etag> and the body
+     *   {"base": <synced turn count>, "turns": [...new turns], "tokens": [[index, tokens]...], "meta": {...}}
+     *   ("tokens" and "meta" only when changed). The server applies it if the ETag still matches and replies
+     *   with the new ETag; on 404, 405, 409 or 501 the storage falls back to a full PUT.
+     * - sends that full PUT with If-Match: <etag> too, unless the server replied 404. A 412 (the session
+     *   changed on the server since it was synced) fails the save instead of overwriting the other change;
+     *   saves keep failing until load() fetches the server's version.
+     * - loads with If-None-Match: <etag>; a 304 reply reuses the remembered version without a body.
+     * * Request bodies above a threshold are gzip-compressed (Content-Encoding: gzip) and responses are
+     * accepted gzip-encoded. A server answering 415 to a compressed body gets uncompressed ones from then on.
+     * * Requests reuse a small pool of HTTP sessions, so connections are kept alive between calls.
+     * * Saves of one session are sent one at a time, each with the ETag the previous one returned; a save
+     * issued while one is in flight replaces any other still waiting (it contains all of its changes).
      */
     class RemoteStorage : public IChatStorage
     {
@@ -117,8 +273,13 @@ namespace GeminiCPP
          * @brief Constructs a RemoteStorage.
          * @param baseUrl The base URL of the remote storage service.
          * @param authToken Optional authorization token (Bearer).
+         * @param options Delta sync, compression and connection settings.
          */
-        explicit RemoteStorage(std::string baseUrl, std::string authToken = "");
+        explicit RemoteStorage(std::string baseUrl, std::string authToken = "", RemoteStorageOptions options = {});
+        ~RemoteStorage() override;
+
+        RemoteStorage(const RemoteStorage&) = delete;
+        RemoteStorage& operator=(const RemoteStorage&) = delete;
 
         /**
         * @brief Saves a chat session synchronously.
@@ -154,9 +315,49 @@ namespace GeminiCPP
         */
         [[nodiscard]] std::future<std::vector<std::string>> listSessionsAsync() override;
 
+        /**
+         * @brief Uploads sessions with large inline payloads replaced by references into a blob store.
+         * @details The store must be reachable by every reader of these sessions. Call before using the storage.
+         */
+        void setBlobOffload(BlobOffloadPolicy policy);
+
     private:
+        struct SyncedVersion
+        {
+            std::string etag;
+            ChatSessionSnapshot snapshot;
+        };
+
+        struct Connections;
+
+        struct PendingUpload
+        {
+            std::optional<ChatSessionSnapshot> snapshot; ///< Next version to send; newer saves replace it.
+            std::vector<std::promise<bool>> done;        ///< One per coalesced save.
+        };
+
+        void drainUploads(const std::string& sessionId);
+        bool upload(const ChatSessionSnapshot& snapshot);
+        void remember(const std::string& etag, const ChatSessionSnapshot& snapshot);
+
+        [[nodiscard]] std::string serialize(const ChatSessionSnapshot& snapshot) const;
+
         std::string baseUrl_;
         std::string authToken_;
+        RemoteStorageOptions options_;
+        BlobOffloadPolicy blobs_;
+
+        std::mutex mutex_;
+        std::unordered_map<std::string, SyncedVersion> synced_; ///< Last version known to match the server, by session id.
+        std::atomic<bool> patchUnsupported_{false};
+        std::atomic<bool> compressionRejected_{false};
+
+        std::unique_ptr<Connections> connections_;
+
+        std::mutex uploadsMutex_;
+        std::unordered_map<std::string, PendingUpload> uploads_; ///< Sessions with an upload running, by id.
+
+        ThreadPool uploader_; ///< Runs drainUploads(). Declared last: drained first on destruction.
     };
 }
 
@@ -17,6 +17,11 @@ namespace GeminiCPP
 {
     /// @brief Callback type for handling streamed text chunks.
     using StreamCallback = std::function<void(std::string_view)>;
+
+    struct Part;
+
+    /// @brief Callback invoked for each non-text part (function call, blob, code...) as soon as it arrives in a stream.
+    using StreamPartCallback = std::function<void(const Part&)>;
 }
 
 namespace GeminiCPP::Support
@@ -0,0 +1,79 @@
+﻿#pragma once
+
+#ifndef GEMINI_THREAD_POOL_H
+#define GEMINI_THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace GeminiCPP
+{
+    /**
+     * @brief Fixed-size pool of worker threads executing submitted tasks in FIFO order.
+     * * Used for background work (history compaction, tool execution) so that it neither blocks the
+     * caller nor spawns a new thread per task. Tasks still queued when the pool is destroyed are run
+     * before the workers are joined.
+     */
+    class ThreadPool
+    {
+    public:
+        /**
+         * @param threads Number of worker threads. 0 selects std::thread::hardware_concurrency() (at least 1).
+         */
+        explicit ThreadPool(size_t threads = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        /**
+         * @brief Queues a callable and returns a future for its result.
+         */
+        template <typename Func>
+        [[nodiscard]] auto submit(Func&& func) -> std::future<std::invoke_result_t<std::decay_t<Func>>>
+        {
+            using ResultType = std::invoke_result_t<std::decay_t<Func>>;
+            auto task = std::make_shared<std::packaged_task<ResultType()>>(std::forward<Func>(func));
+            std::future<ResultType> future = task->get_future();
+            enqueue([task]() { (*task)(); });
+            return future;
+        }
+
+        /**
+         * @brief Adds worker threads, e.g. to stand in for workers stuck in tasks that may never return.
+         */
+        void grow(size_t threads = 1);
+
+        [[nodiscard]] size_t threadCount() const;
+
+        /**
+         * @brief Number of tasks waiting for a free worker.
+         */
+        [[nodiscard]] size_t pending() const;
+
+        /**
+         * @brief Process-wide pool shared by sessions that were not given their own.
+         */
+        [[nodiscard]] static ThreadPool& shared();
+
+    private:
+        void enqueue(std::function<void()> task);
+        void workerLoop();
+
+        std::vector<std::thread> workers_;
+        std::deque<std::function<void()>> queue_;
+        mutable std::mutex mutex_;
+        std::condition_variable cv_;
+        bool stopping_ = false;
+    };
+}
+
+#endif // GEMINI_THREAD_POOL_H
@@ -0,0 +1,91 @@
+﻿#pragma once
+
+#ifndef GEMINI_TOOL_WORKER_H
+#define GEMINI_TOOL_WORKER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#include "internal/async_utils.h"
+
+namespace GeminiCPP
+{
+    /**
+     * @brief Configuration of the worker processes backing one tool.
+     */
+    struct ToolWorkerOptions
+    {
+        std::vector<std::string> command;                         ///< Program (searched in PATH) followed by its arguments.
+        size_t workers = 1;                                       ///< Processes kept running; each handles one call at a time.
+        std::chrono::milliseconds callTimeout{30000};             ///< A worker not answering within this is killed and restarted.
+        std::chrono::milliseconds healthCheckInterval{10000};     ///< Idle workers are pinged this often. 0 disables health checks.
+        std::chrono::milliseconds healthCheckTimeout{2000};       ///< Time allowed to answer a ping.
+        std::chrono::milliseconds maxRestartBackoff{5000};        ///< Upper bound for the delay between failed (re)starts.
+    };
+
+    /**
+     * @brief Pool of long-lived processes executing the calls of one tool.
+     * * Workers speak line-delimited JSON over their stdin/stdout. For every call the pool writes
+     * {"id": <n>, "name": <tool>, "args": {...}} and expects {"id": <n>, "result": <json>} (or
+     * {"id": <n>, "error": <message>}, or {"status": ..., "message": ...} as the error) on a single line.
+     * Errors reach the caller in the same {"error": {"status", "message"}} shape as other function errors.
+     * Health checks send {"id": <n>, "ping": true} and expect any reply with the same id. Lines that are
+     * not JSON objects are logged and ignored.
+     * * Workers that exit, fail a health check or exceed the call timeout are killed and restarted. A
+     * worker that could not start, or died before completing its first exchange, is restarted only after
+     * an exponentially growing delay, so a broken command does not respawn in a tight loop. The call in
+     * flight on such a worker fails with a structured error; it is not retried, since the tool may not be
+     * idempotent.
+     */
+    class ToolWorkerPool
+    {
+    public:
+        ToolWorkerPool(std::string toolName, ToolWorkerOptions options);
+        ~ToolWorkerPool();
+
+        ToolWorkerPool(const ToolWorkerPool&) = delete;
+        ToolWorkerPool& operator=(const ToolWorkerPool&) = delete;
+
+        /**
+         * @brief Queues a call; done receives the result once a worker has answered.
+         */
+        void call(const nlohmann::json& args, Internal::FunctionCompletion done);
+
+        [[nodiscard]] const std::string& toolName() const { return toolName_; }
+        [[nodiscard]] size_t workerCount() const { return threads_.size(); }
+        [[nodiscard]] size_t queuedCalls() const;
+        [[nodiscard]] size_t restarts() const { return restarts_.load(); }
+
+    private:
+        struct Job
+        {
+            nlohmann::json args;
+            Internal::FunctionCompletion done;
+        };
+
+        void workerLoop();
+
+        std::string toolName_;
+        ToolWorkerOptions options_;
+
+        mutable std::mutex mutex_;
+        std::condition_variable cv_;
+        std::condition_variable stopCv_; ///< Wakes workers waiting out a restart delay; unlike cv_, not used for jobs.
+        std::deque<Job> jobs_;
+        bool stopping_ = false;
+
+        std::atomic<uint64_t> nextId_{1};
+        std::atomic<size_t> restarts_{0};
+        std::vector<std::thread> threads_;
+    };
+}
+
+#endif // GEMINI_TOOL_WORKER_H
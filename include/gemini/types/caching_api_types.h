@@ -338,7 +338,7 @@ namespace GeminiCPP
      * * Caching allows reusing large contexts (like books or codebases) across multiple requests
      * without re-uploading or re-processing them, saving tokens and time.
      */
-    struct CachedContent
+    struct CachedContent : IJsonSerializable<CachedContent>
     {
         std::string name; // ID: "cachedContents/..."
         std::string model;
@@ -356,15 +356,16 @@ namespace GeminiCPP
         std::vector<Tool> tools;
 
         [[nodiscard]] static CachedContent fromJson(const nlohmann::json& j);
-        [[nodiscard]] nlohmann::json toJson() const;
+        [[nodiscard]] nlohmann::json toJson() const override;
     };
 
-    struct ListCachedContentsResponse
+    struct ListCachedContentsResponse : IJsonSerializable<ListCachedContentsResponse>
     {
         std::vector<CachedContent> cachedContents;
         std::string nextPageToken;
 
         [[nodiscard]] static ListCachedContentsResponse fromJson(const nlohmann::json& j);
+        [[nodiscard]] nlohmann::json toJson() const override;
     };
 }
 
@@ -6,12 +6,14 @@
 #include <string>
 #include <vector>
 #include <optional>
+#include <memory>
 
 #include "frenum.h"
 
 #include "gemini/types_base.h"
 #include "gemini/support.h"
 #include "gemini/url.h"
+#include "gemini/history.h"
 #include "caching_api_types.h"
 
 namespace GeminiCPP
@@ -737,9 +739,15 @@ namespace GeminiCPP
         // Required. The content of the current conversation with the model. For single-turn queries, this is a single
         // instance. For multi-turn queries like chat, this is a repeated field that contains the conversation history and the latest request.
         std::vector<Content> contents;
+        // Optional. Conversation turns shared with a ChatSession. They are sent before 'contents' and referenced
+        // without copying, so a long history is not duplicated for every request.
+        History history;
         // Optional. A list of Tools the Model may use to generate the next response. A Tool is a piece of code that enables the
         // system to interact with external systems to perform an action, or set of actions, outside of knowledge and scope of the Model.
         std::optional<std::vector<Tool>> tools;
+        // Optional. Pre-serialized JSON array of Tools, sent instead of 'tools' when that is not set. Lets callers
+        // reuse the serialized schemas across requests.
+        std::shared_ptr<const std::string> toolsJson;
         // Optional. Tool configuration for any Tool specified in the request.
         std::optional<ToolConfig> toolConfig;
         // Optional. A list of unique SafetySetting instances for blocking unsafe content. This will be enforced on the GenerateContentRequest.contents
@@ -756,6 +764,9 @@ namespace GeminiCPP
 
         [[nodiscard]] static GenerateContentRequestBody fromJson(const nlohmann::json& j);
         [[nodiscard]] nlohmann::json toJson() const override;
+        // Serializes the body to the wire format. History turns are spliced in from their cached JSON instead of being
+        // re-serialized, so the cost is proportional to the new content only.
+        [[nodiscard]] std::string dump() const;
     };
 
         struct StreamGenerateContentRequestBody : IJsonSerializable<StreamGenerateContentRequestBody>
@@ -763,9 +774,15 @@ namespace GeminiCPP
         // Required. The content of the current conversation with the model. For single-turn queries, this is a single
         // instance. For multi-turn queries like chat, this is a repeated field that contains the conversation history and the latest request.
         std::vector<Content> contents;
+        // Optional. Conversation turns shared with a ChatSession. They are sent before 'contents' and referenced
+        // without copying, so a long history is not duplicated for every request.
+        History history;
         // Optional. A list of Tools the Model may use to generate the next response. A Tool is a piece of code that enables the
         // system to interact with external systems to perform an action, or set of actions, outside of knowledge and scope of the Model.
         std::optional<std::vector<Tool>> tools;
+        // Optional. Pre-serialized JSON array of Tools, sent instead of 'tools' when that is not set. Lets callers
+        // reuse the serialized schemas across requests.
+        std::shared_ptr<const std::string> toolsJson;
         // Optional. Tool configuration for any Tool specified in the request.
         std::optional<ToolConfig> toolConfig;
         // Optional. A list of unique SafetySetting instances for blocking unsafe content. This will be enforced on the GenerateContentRequest.contents
@@ -782,6 +799,9 @@ namespace GeminiCPP
 
         [[nodiscard]] static StreamGenerateContentRequestBody fromJson(const nlohmann::json& j);
         [[nodiscard]] nlohmann::json toJson() const override;
+        // Serializes the body to the wire format. History turns are spliced in from their cached JSON instead of being
+        // re-serialized, so the cost is proportional to the new content only.
+        [[nodiscard]] std::string dump() const;
     };
 
     // Response from the model supporting multiple candidate responses. Safety ratings and content filtering are reported for
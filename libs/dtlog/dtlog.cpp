@@ -122,4 +122,224 @@ namespace dtlog
         if (should_flush(level))
             DTLOG_UNUSED(std::fflush(stderr));
     }
+
+    void console_sink::flush()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        DTLOG_UNUSED(std::fflush(stdout));
+    }
+
+    void err_console_sink::flush()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        DTLOG_UNUSED(std::fflush(stderr));
+    }
+
+    async_sink::async_sink(std::shared_ptr<isink> sink, size_t capacity, overflow_policy policy)
+        : m_sink(std::move(sink)), m_policy(policy)
+    {
+        if (!m_sink)
+            throw std::invalid_argument("dtlog: async_sink needs a sink to write to");
+
+        size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+        m_slots = std::make_unique<slot[]>(size);
+        for (size_t i = 0; i < size; ++i)
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        m_mask = size - 1;
+
+        m_writer = std::thread(&async_sink::run, this);
+    }
+
+    async_sink::~async_sink()
+    {
+        m_stop.store(true);
+        m_queued.fetch_add(1); // Wakes the writer, which empties the ring before it exits.
+        m_queued.notify_one();
+        if (m_writer.joinable())
+            m_writer.join();
+    }
+
+    void async_sink::log(const std::string& msg, log_level level)
+    {
+        while (!try_push(msg, level))
+        {
+            if (m_policy == overflow_policy::drop)
+            {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            if (m_policy == overflow_policy::drop_oldest)
+            {
+                std::string oldest;
+                log_level oldest_level;
+                if (try_pop(oldest, oldest_level))
+                {
+                    m_dropped.fetch_add(1, std::memory_order_relaxed);
+                    complete(1);
+                }
+                else
+                {
+                    std::this_thread::yield(); // The oldest slot is still being written by another producer.
+                }
+                continue;
+            }
+
+            // Registered before reading the counter, so the writer either sees the waiter or this thread
+            // sees the slot it freed.
+            m_waiters.fetch_add(1);
+            const uint64_t seen = m_completed.load();
+            if (!try_push(msg, level))
+            {
+                m_completed.wait(seen);
+                m_waiters.fetch_sub(1);
+                continue;
+            }
+            m_waiters.fetch_sub(1);
+            break;
+        }
+
+        m_queued.fetch_add(1);
+        if (m_writer_idle.load())
+            m_queued.notify_one();
+    }
+
+    void async_sink::flush()
+    {
+        const uint64_t target = m_queued.load();
+        m_waiters.fetch_add(1);
+        for (uint64_t done = m_completed.load(); done < target; done = m_completed.load())
+            m_completed.wait(done);
+        m_waiters.fetch_sub(1);
+        m_sink->flush();
+    }
+
+    // Bounded MPMC ring (D. Vyukov): each slot's sequence says whether it is free for the producer at
+    // position pos (sequence == pos) or holds the message for the consumer at pos (sequence == pos + 1).
+    // The writer thread is the usual consumer; drop_oldest producers also consume to make room.
+    bool async_sink::try_push(const std::string& msg, log_level level)
+    {
+        size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            slot& s = m_slots[pos & m_mask];
+            const size_t sequence = s.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0)
+            {
+                if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    s.message.assign(msg); // Reuses the capacity left by an earlier message.
+                    s.level = level;
+                    s.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false; // Full.
+            }
+            else
+            {
+                pos = m_enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool async_sink::try_pop(std::string& msg, log_level& level)
+    {
+        size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            slot& s = m_slots[pos & m_mask];
+            const size_t sequence = s.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0)
+            {
+                if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    msg.swap(s.message); // The slot keeps the caller's old buffer for the next message.
+                    level = s.level;
+                    s.sequence.store(pos + m_mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false; // Empty.
+            }
+            else
+            {
+                pos = m_dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void async_sink::write(const std::string& msg, log_level level)
+    {
+        try
+        {
+            m_sink->log(msg, level);
+        }
+        catch (...)
+        {
+            // There is no caller to report to; losing the message beats losing the writer thread.
+        }
+    }
+
+    void async_sink::complete(uint64_t count)
+    {
+        m_completed.fetch_add(count);
+        if (m_waiters.load() > 0)
+            m_completed.notify_all();
+    }
+
+    void async_sink::run()
+    {
+        std::string msg;
+        log_level level = log_level::none;
+        while (true)
+        {
+            uint64_t written = 0;
+            while (try_pop(msg, level))
+            {
+                write(msg, level);
+                // Reported in batches, so blocked producers and flush() do not wait for the whole backlog.
+                if (++written == 64)
+                {
+                    complete(written);
+                    written = 0;
+                }
+            }
+            if (written > 0)
+                complete(written);
+
+            // Announced before reading the counter, so a producer either sees it and wakes the writer, or
+            // published its message before the check below.
+            m_writer_idle.store(true);
+            const uint64_t seen = m_queued.load();
+            if (try_pop(msg, level))
+            {
+                m_writer_idle.store(false);
+                write(msg, level);
+                complete(1);
+                continue;
+            }
+            if (m_stop.load())
+                break;
+
+            m_queued.wait(seen);
+            m_writer_idle.store(false);
+        }
+
+        try
+        {
+            m_sink->flush();
+        }
+        catch (...)
+        {
+        }
+    }
 }
\ No newline at end of file
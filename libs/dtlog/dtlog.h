@@ -24,6 +24,9 @@
 #include <algorithm> // std::for_each
 #include <vector>    // std::vector
 #include <filesystem>// std::filesystem
+#include <atomic>    // std::atomic
+#include <thread>    // std::thread
+#include <cstdint>   // uint64_t
 
 #define DTLOG_NODISCARD [[nodiscard]]   // I guess every modern compiler supports nodiscard attribute
 #define DTLOG_UNUSED(x) (void)(x)       // Just to suppress some warnings...
@@ -541,6 +544,11 @@ namespace dtlog
          */
         virtual void log(const std::string& final_message, log_level level) = 0;
 
+        /**
+         * @brief Writes out any buffered messages.
+         */
+        virtual void flush() {}
+
     protected:
         /**
          * @brief Checks if the buffer should be flushed based on the current message level.
@@ -566,6 +574,11 @@ namespace dtlog
          * @param level The log level (used for coloring).
          */
         void log(const std::string& msg, log_level level) override;
+
+        /**
+         * @brief Flushes stdout.
+         */
+        void flush() override;
     };
 
     /**
@@ -580,6 +593,11 @@ namespace dtlog
          * @param level The log level (used for coloring).
          */
         void log(const std::string& msg, log_level level) override;
+
+        /**
+         * @brief Flushes stderr.
+         */
+        void flush() override;
     };
 
     /**
@@ -628,6 +646,15 @@ namespace dtlog
             }
         }
 
+        /**
+         * @brief Flushes the file stream.
+         */
+        void flush() override
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_file.flush();
+        }
+
     private:
         std::ofstream m_file; ///< The file stream.
     };
@@ -682,6 +709,15 @@ namespace dtlog
             }
         }
 
+        /**
+         * @brief Flushes the current file.
+         */
+        void flush() override
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_file.flush();
+        }
+
     private:
         /**
          * @brief Opens the log file in append mode.
@@ -754,6 +790,104 @@ namespace dtlog
         std::ofstream m_file;        ///< The file stream.
     };
 
+    /**
+     * @brief What an async_sink does with a message when its queue is full.
+     */
+    enum class overflow_policy : uint8_t
+    {
+        block,      ///< Wait until the writer makes room. Nothing is lost.
+        drop,       ///< Discard the new message.
+        drop_oldest ///< Discard the oldest queued message to make room for the new one.
+    };
+
+    /**
+     * @brief A sink that hands messages to another sink on a background thread.
+     * * log() only copies the message into a bounded lock-free ring buffer (multi-producer, one writer
+     * thread), so the logging thread never waits for the wrapped sink's lock or its disk I/O. When the
+     * ring is full, the overflow_policy decides; dropped messages are counted (see dropped_count()).
+     * * The wrapped sink still decides when to flush (its flush_on() level), now on the writer thread.
+     * * Destroying the sink writes every message logged before, then flushes the wrapped sink.
+     */
+    class async_sink : public isink
+    {
+    public:
+        /**
+         * @brief Constructs an async sink and starts its writer thread.
+         * @param sink The sink that actually writes the messages.
+         * @param capacity Number of messages the ring buffer holds (rounded up to a power of two).
+         * @param policy What to do when the ring buffer is full.
+         * @throws std::invalid_argument if sink is null.
+         */
+        explicit async_sink(std::shared_ptr<isink> sink, size_t capacity = 8192, overflow_policy policy = overflow_policy::block);
+
+        /**
+         * @brief Writes the remaining messages, flushes the wrapped sink and stops the writer thread.
+         */
+        ~async_sink() override;
+
+        async_sink(const async_sink&) = delete;
+        async_sink& operator=(const async_sink&) = delete;
+
+        /**
+         * @brief Queues a message for the writer thread.
+         * @param msg The log message.
+         * @param level The log level.
+         */
+        void log(const std::string& msg, log_level level) override;
+
+        /**
+         * @brief Waits until every message queued before the call is written, then flushes the wrapped sink.
+         */
+        void flush() override;
+
+        /**
+         * @brief Number of messages discarded because the ring buffer was full.
+         */
+        DTLOG_NODISCARD uint64_t dropped_count() const
+        {
+            return m_dropped.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief The sink the messages are written to.
+         */
+        DTLOG_NODISCARD const std::shared_ptr<isink>& wrapped() const
+        {
+            return m_sink;
+        }
+
+    private:
+        struct slot
+        {
+            std::atomic<size_t> sequence{0}; ///< Tells producers and consumers whose turn the slot is.
+            std::string message;
+            log_level level = log_level::none;
+        };
+
+        bool try_push(const std::string& msg, log_level level);
+        bool try_pop(std::string& msg, log_level& level);
+        void write(const std::string& msg, log_level level);
+        void complete(uint64_t count);
+        void run();
+
+        std::shared_ptr<isink> m_sink;
+        overflow_policy m_policy;
+        std::unique_ptr<slot[]> m_slots;
+        size_t m_mask;
+
+        alignas(64) std::atomic<size_t> m_enqueue_pos{0};
+        alignas(64) std::atomic<size_t> m_dequeue_pos{0};
+
+        alignas(64) std::atomic<uint64_t> m_queued{0};    ///< Messages accepted; the writer waits on it.
+        std::atomic<bool> m_writer_idle{false};
+        alignas(64) std::atomic<uint64_t> m_completed{0}; ///< Messages written or dropped from the queue; flush() and blocked producers wait on it.
+        std::atomic<uint32_t> m_waiters{0};
+        std::atomic<uint64_t> m_dropped{0};
+        std::atomic<bool> m_stop{false};
+
+        std::thread m_writer;
+    };
+
     /**
      * @brief A class for logging messages with various log levels and formatting options.
      * @tparam DefaultSink The type of the sink to be added by default (default: console_sink).
@@ -801,6 +935,35 @@ namespace dtlog
             m_sinks.push_back(sink);
         }
 
+        /**
+         * @brief Gets the sinks of the logger.
+         */
+        DTLOG_NODISCARD const std::vector<std::shared_ptr<isink>>& get_sinks() const
+        {
+            return m_sinks;
+        }
+
+        /**
+         * @brief Replaces the sinks of the logger (e.g. to wrap them in async_sink).
+         * @note Like add_sink(), not safe while other threads are logging.
+         * @param sinks The new sinks.
+         */
+        void set_sinks(std::vector<std::shared_ptr<isink>> sinks)
+        {
+            m_sinks = std::move(sinks);
+        }
+
+        /**
+         * @brief Flushes every sink (for async sinks: waits until their queued messages are written).
+         */
+        void flush() const
+        {
+            for (auto& sink : m_sinks)
+            {
+                sink->flush();
+            }
+        }
+
         /**
          * @brief Logs a message with the specified log level.
          * @tparam Args Variadic template for message arguments.
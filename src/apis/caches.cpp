@@ -0,0 +1,45 @@
+﻿#include "gemini/apis/caches.h"
+#include "gemini/client.h"
+#include "gemini/url.h"
+
+namespace GeminiCPP
+{
+    Caches::Caches(Client* client)
+        : client_(client)
+    {
+    }
+
+    Result<CachedContent> Caches::create(const CachedContent& content)
+    {
+        return client_->post<CachedContent>("cachedContents", content.toJson());
+    }
+
+    Result<CachedContent> Caches::get(const std::string& name)
+    {
+        return client_->get<CachedContent>(ResourceName::CachedContent(name).str());
+    }
+
+    Result<ListCachedContentsResponse> Caches::list(int pageSize, const std::string& pageToken)
+    {
+        std::map<std::string, std::string> params;
+        params["pageSize"] = std::to_string(pageSize);
+        if (!pageToken.empty())
+            params["pageToken"] = pageToken;
+
+        return client_->get<ListCachedContentsResponse>("cachedContents", params);
+    }
+
+    Result<CachedContent> Caches::updateTtl(const std::string& name, const Duration& ttl)
+    {
+        nlohmann::json payload = {
+            {"ttl", ttl.toJson()}
+        };
+
+        return client_->patch<CachedContent>(ResourceName::CachedContent(name).str(), payload, {{"updateMask", "ttl"}});
+    }
+
+    Result<bool> Caches::deleteCache(const std::string& name)
+    {
+        return client_->deleteResource(ResourceName::CachedContent(name).str());
+    }
+}
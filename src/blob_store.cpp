@@ -0,0 +1,211 @@
+﻿#include "gemini/blob_store.h"
+
+#include <algorithm>
+#include <system_error>
+
+#include "gemini/internal/file_utils.h"
+#include "gemini/internal/sha256.h"
+#include "gemini/logger.h"
+#include "gemini/utils.h"
+
+namespace GeminiCPP
+{
+    namespace
+    {
+        bool isBlobReference(const nlohmann::json& inlineData)
+        {
+            return inlineData.is_object() && inlineData.contains("blobRef");
+        }
+
+        // Base64 length of size raw bytes, padded.
+        size_t base64Size(size_t size)
+        {
+            return (size + 2) / 3 * 4;
+        }
+
+        // Calls f(inlineData) for every "inlineData" object in j; stops early once f returns false.
+        template <typename Json, typename F>
+        bool forEachInlineData(Json& j, F& f)
+        {
+            if (j.is_object())
+            {
+                for (auto it = j.begin(); it != j.end(); ++it)
+                {
+                    if (it.key() == "inlineData" && it->is_object())
+                    {
+                        if (!f(*it))
+                            return false;
+                    }
+                    else if (!forEachInlineData(*it, f))
+                        return false;
+                }
+            }
+            else if (j.is_array())
+            {
+                for (auto& item : j)
+                {
+                    if (!forEachInlineData(item, f))
+                        return false;
+                }
+            }
+            return true;
+        }
+
+        // Sum of the blob sizes referenced by j, as base64.
+        size_t referencedBase64Size(const nlohmann::json& j)
+        {
+            size_t total = 0;
+            auto add = [&total](const nlohmann::json& inlineData) {
+                if (isBlobReference(inlineData))
+                    total += base64Size(inlineData.value("blobSize", size_t{0}));
+                return true;
+            };
+            forEachInlineData(j, add);
+            return total;
+        }
+    }
+
+    LocalBlobStore::LocalBlobStore(std::string rootPath, bool durable)
+        : rootPath_(std::move(rootPath)), durable_(durable)
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(rootPath_, ec);
+    }
+
+    std::optional<std::filesystem::path> LocalBlobStore::blobPath(const std::string& key) const
+    {
+        // Keys come from session files; only accept what put() produces so they cannot escape the root.
+        const bool valid = key.size() == 64 && std::all_of(key.begin(), key.end(), [](char c) {
+            return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+        });
+        if (!valid)
+            return std::nullopt;
+        return rootPath_ / key.substr(0, 2) / key;
+    }
+
+    std::optional<std::string> LocalBlobStore::put(std::string_view bytes)
+    {
+        std::string key = Internal::sha256Hex(bytes);
+        const auto path = *blobPath(key);
+
+        std::error_code ec;
+        if (std::filesystem::exists(path, ec))
+            return key;
+
+        std::filesystem::create_directories(path.parent_path(), ec);
+        if (!Internal::writeFileAtomic(path, bytes, durable_))
+        {
+            GEMINI_ERROR("Cannot write blob {}", path.string());
+            return std::nullopt;
+        }
+        return key;
+    }
+
+    std::optional<std::string> LocalBlobStore::get(const std::string& key)
+    {
+        const auto path = blobPath(key);
+        if (!path)
+            return std::nullopt;
+        return Internal::readFile(*path);
+    }
+
+    bool LocalBlobStore::contains(const std::string& key)
+    {
+        const auto path = blobPath(key);
+        std::error_code ec;
+        return path && std::filesystem::exists(*path, ec);
+    }
+
+    bool BlobOffload::offload(nlohmann::json& j, const BlobOffloadPolicy& policy)
+    {
+        if (!policy.enabled())
+            return false;
+
+        bool replaced = false;
+        auto offloadOne = [&](nlohmann::json& inlineData) {
+            const auto data = inlineData.find("data");
+            if (data == inlineData.end() || !data->is_string())
+                return true;
+
+            const auto& encoded = data->get_ref<const std::string&>();
+            if (encoded.size() < policy.minBytes)
+                return true;
+
+            const std::vector<unsigned char> raw = Utils::base64Decode(encoded);
+            if (Utils::base64Encode(raw) != encoded)
+            {
+                // Not canonical base64 (line breaks, missing padding, ...): keep it verbatim.
+                return true;
+            }
+
+            const auto key = policy.store->put(std::string_view(reinterpret_cast<const char*>(raw.data()), raw.size()));
+            if (!key)
+                return true;
+
+            inlineData.erase(data);
+            inlineData["blobRef"] = *key;
+            inlineData["blobSize"] = raw.size();
+            replaced = true;
+            return true;
+        };
+        forEachInlineData(j, offloadOne);
+        return replaced;
+    }
+
+    bool BlobOffload::hasReferences(const nlohmann::json& j)
+    {
+        bool found = false;
+        auto check = [&found](const nlohmann::json& inlineData) {
+            found = isBlobReference(inlineData);
+            return !found;
+        };
+        forEachInlineData(j, check);
+        return found;
+    }
+
+    bool BlobOffload::rehydrate(nlohmann::json& j, IBlobStore& store)
+    {
+        bool complete = true;
+        auto restore = [&](nlohmann::json& inlineData) {
+            if (!isBlobReference(inlineData))
+                return true;
+
+            const std::string key = inlineData["blobRef"].get<std::string>();
+            const auto bytes = store.get(key);
+            if (!bytes)
+            {
+                // The read may only have failed transiently: keep the reference so the data is not lost.
+                GEMINI_ERROR("Blob {} referenced by a session cannot be read", key);
+                complete = false;
+                return true;
+            }
+
+            inlineData.erase("blobRef");
+            inlineData.erase("blobSize");
+            inlineData["data"] = Utils::base64Encode(std::vector<unsigned char>(bytes->begin(), bytes->end()));
+            return true;
+        };
+        forEachInlineData(j, restore);
+        return complete;
+    }
+
+    void BlobOffload::appendTurn(History& history, nlohmann::json turn, const std::shared_ptr<IBlobStore>& store)
+    {
+        if (!hasReferences(turn))
+        {
+            history.push_back(Content::fromJson(turn));
+            return;
+        }
+
+        // Estimated: the inline base64 replaces the reference fields, which are only a few dozen bytes.
+        const size_t jsonSize = turn.dump().size() + referencedBase64Size(turn);
+        history.push_back_lazy(jsonSize, [turn = std::move(turn), store]() {
+            nlohmann::json j = turn;
+            if (!store)
+                throw History::IncompleteTurn("the turn references blobs but no blob store is configured", std::move(j));
+            if (!rehydrate(j, *store))
+                throw History::IncompleteTurn("a blob referenced by the turn cannot be read", std::move(j));
+            return j;
+        });
+    }
+}
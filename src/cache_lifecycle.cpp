@@ -0,0 +1,227 @@
+﻿#include "gemini/cache_lifecycle.h"
+
+#include <unordered_set>
+
+#include "gemini/client.h"
+#include "gemini/logger.h"
+#include "gemini/response.h"
+
+namespace GeminiCPP
+{
+    double CacheUsageStats::hitRate() const
+    {
+        const uint64_t total = hits + misses;
+        if (total == 0)
+            return 0.0;
+        
+        return static_cast<double>(hits) / static_cast<double>(total);
+    }
+
+    CacheLifecycleManager::CacheLifecycleManager(Client* client, CacheRegistry& registry, CacheLifecyclePolicy policy)
+        : client_(client), registry_(registry), policy_(std::move(policy))
+    {
+    }
+
+    CacheLifecycleManager::~CacheLifecycleManager()
+    {
+        stop();
+    }
+
+    void CacheLifecycleManager::start()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (running_)
+            return;
+        
+        running_ = true;
+        worker_ = std::thread(&CacheLifecycleManager::run, this);
+    }
+
+    void CacheLifecycleManager::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_ = false;
+        }
+        cv_.notify_all();
+        
+        if (worker_.joinable())
+            worker_.join();
+    }
+
+    void CacheLifecycleManager::run()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (running_)
+        {
+            if (cv_.wait_for(lock, policy_.sweepInterval, [this] { return !running_; }))
+                break;
+
+            lock.unlock();
+            try
+            {
+                sweep();
+            }
+            catch (const std::exception& e)
+            {
+                GEMINI_ERROR("Cache lifecycle sweep failed: {}", e.what());
+            }
+            lock.lock();
+        }
+    }
+
+    void CacheLifecycleManager::sweep()
+    {
+        using namespace std::chrono;
+        
+        const CacheLifecyclePolicy policy = getPolicy();
+        const auto wallNow = system_clock::now();
+        const auto now = steady_clock::now();
+
+        std::unordered_set<std::string> live;
+
+        for (const auto& alias : registry_.listAliases())
+        {
+            auto info = registry_.getCacheInfo(alias);
+            if (!info)
+                continue;
+
+            auto expiresAt = info->expiresAt();
+            if (expiresAt.has_value() && *expiresAt <= wallNow)
+            {
+                GEMINI_INFO("Cache '{}' expired, removing stale alias.", alias);
+                drop(*info, false);
+                continue;
+            }
+
+            CacheUsageStats usage;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto [it, inserted] = stats_.try_emplace(alias);
+                if (inserted)
+                    it->second.firstSeen = now;
+                usage = it->second;
+            }
+
+            const auto lastActivity = usage.hits > 0 ? usage.lastHit : usage.firstSeen;
+            const bool hot = usage.hits > 0 && now - usage.lastHit <= policy.hotWindow && usage.hitRate() >= policy.minHitRate;
+            const bool cold = now - lastActivity >= policy.coldAfter;
+
+            if (hot)
+            {
+                // Without a known expiry there is no way to tell whether a renewal is due (or did anything).
+                if (!expiresAt.has_value())
+                    GEMINI_DEBUG("Cache '{}' is hot but has no expiry time, not renewing.", alias);
+                else if (*expiresAt - wallNow <= policy.renewBefore)
+                    renew(*info);
+            }
+            else if (cold && policy.deleteCold)
+            {
+                GEMINI_INFO("Cache '{}' is cold ({} hits, {} misses), deleting.", alias, usage.hits, usage.misses);
+                drop(*info, true);
+                continue;
+            }
+
+            live.insert(alias);
+        }
+
+        // Forget counters of aliases that were unregistered outside the manager.
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::erase_if(stats_, [&live](const auto& entry) { return !live.contains(entry.first); });
+    }
+
+    void CacheLifecycleManager::renew(const CachedItemInfo& info)
+    {
+        if (!client_)
+            return;
+        
+        auto res = client_->caches.updateTtl(info.id, getPolicy().renewTtl);
+        if (res.success)
+        {
+            // The alias may have been pointed at another cache while the request was in flight.
+            if (registry_.updateCache(info.alias, info.id, *res))
+                GEMINI_DEBUG("Cache '{}' renewed until {}", info.alias, res->expireTime);
+            return;
+        }
+
+        if (res.statusCode == HttpMappedStatusCode::NOT_FOUND)
+        {
+            GEMINI_INFO("Cache '{}' no longer exists on the server, removing stale alias.", info.alias);
+            drop(info, false);
+            return;
+        }
+        
+        GEMINI_WARN("Cache '{}' TTL extension failed: {}", info.alias, res.errorMessage);
+    }
+
+    void CacheLifecycleManager::drop(const CachedItemInfo& info, bool deleteRemote)
+    {
+        if (deleteRemote && client_)
+        {
+            auto res = client_->caches.deleteCache(info.id);
+            if (!res.success && res.statusCode != HttpMappedStatusCode::NOT_FOUND)
+            {
+                GEMINI_WARN("Cache '{}' deletion failed: {}", info.alias, res.errorMessage);
+                return;
+            }
+        }
+
+        registry_.unregisterCache(info.alias);
+        
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.erase(info.alias);
+    }
+
+    void CacheLifecycleManager::recordUsage(const std::string& alias, int cachedContentTokenCount)
+    {
+        const auto now = std::chrono::steady_clock::now();
+        
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto [it, inserted] = stats_.try_emplace(alias);
+        auto& usage = it->second;
+        if (inserted)
+            usage.firstSeen = now;
+
+        if (cachedContentTokenCount > 0)
+        {
+            usage.hits++;
+            usage.cachedTokens += static_cast<uint64_t>(cachedContentTokenCount);
+            usage.lastHit = now;
+        }
+        else
+        {
+            usage.misses++;
+        }
+    }
+
+    void CacheLifecycleManager::recordUsage(const std::string& alias, const GenerationResult& result)
+    {
+        if (result.success)
+            recordUsage(alias, result.cachedTokens);
+    }
+
+    CacheUsageStats CacheLifecycleManager::stats(const std::string& alias) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = stats_.find(alias);
+        if (it == stats_.end())
+            return {};
+        
+        return it->second;
+    }
+
+    void CacheLifecycleManager::setPolicy(const CacheLifecyclePolicy& policy)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            policy_ = policy;
+        }
+        cv_.notify_all();
+    }
+
+    CacheLifecyclePolicy CacheLifecycleManager::getPolicy() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return policy_;
+    }
+}
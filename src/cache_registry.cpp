@@ -1,6 +1,11 @@
 ﻿#include "gemini/cache_registry.h"
 
 #include "gemini/logger.h"
+#include "gemini/support.h"
+#include "gemini/internal/file_utils.h"
+
+#include <algorithm>
+#include <ranges>
 
 namespace GeminiCPP
 {
@@ -24,14 +29,36 @@ namespace GeminiCPP
         };
     }
 
-    CacheRegistry::CacheRegistry(std::string registryPath)
-            : registryPath_(std::move(registryPath))
+    std::optional<std::chrono::system_clock::time_point> CachedItemInfo::expiresAt() const
     {
-        load();
+        if (expireTime.empty())
+            return std::nullopt;
+        
+        return Support::Timestamp::fromString(expireTime).to_time_point();
+    }
+
+    CacheRegistry::CacheRegistry(std::string registryPath, CacheRegistryOptions options)
+            : registryPath_(std::move(registryPath)), options_(options)
+    {
+        // Without the lock, the flusher's first write reads the entries in (retrying with backoff until it gets it).
+        if (!load())
+            ++mutationSeq_;
+        flusher_ = std::thread(&CacheRegistry::flushLoop, this);
+    }
+
+    CacheRegistry::~CacheRegistry()
+    {
+        {
+            std::lock_guard<std::mutex> lock(flushMutex_);
+            stopping_ = true;
+        }
+        flushCv_.notify_all();
+        
+        if (flusher_.joinable())
+            flusher_.join();
     }
 
     void CacheRegistry::registerCache(const std::string& alias, const CachedContent& content)
-    
     {
         CachedItemInfo info;
         info.id = content.name;
@@ -39,77 +66,261 @@ namespace GeminiCPP
         info.model = content.model;
         info.expireTime = content.expireTime;
 
-        registry_[alias] = info.toJson();
-        save();
+        std::unique_lock<std::shared_mutex> lock(entriesMutex_);
+        entries_[alias] = info;
+        enqueue(alias, std::move(info));
+    }
+
+    bool CacheRegistry::updateCache(const std::string& alias, const std::string& expectedId, const CachedContent& content)
+    {
+        std::unique_lock<std::shared_mutex> lock(entriesMutex_);
+        auto it = entries_.find(alias);
+        if (it == entries_.end() || it->second.id != expectedId)
+            return false;
+
+        CachedItemInfo info;
+        info.id = content.name.empty() ? expectedId : content.name;
+        info.alias = alias;
+        info.model = content.model.empty() ? it->second.model : content.model;
+        info.expireTime = content.expireTime;
+
+        it->second = info;
+        enqueue(alias, std::move(info));
+        return true;
     }
 
     std::optional<std::string> CacheRegistry::getCacheId(const std::string& alias) const
     {
-        if (registry_.contains(alias))
+        std::shared_lock<std::shared_mutex> lock(entriesMutex_);
+        auto it = entries_.find(alias);
+        if (it != entries_.end())
         {
-            return registry_[alias]["id"].get<std::string>();
+            return it->second.id;
         }
         return std::nullopt;
     }
 
     std::optional<CachedItemInfo> CacheRegistry::getCacheInfo(const std::string& alias) const
     {
-        if (registry_.contains(alias))
+        std::shared_lock<std::shared_mutex> lock(entriesMutex_);
+        auto it = entries_.find(alias);
+        if (it != entries_.end())
         {
-            return CachedItemInfo::fromJson(registry_[alias]);
+            return it->second;
         }
         return std::nullopt;
     }
 
     void CacheRegistry::unregisterCache(const std::string& alias)
     {
-        if (registry_.contains(alias))
+        std::unique_lock<std::shared_mutex> lock(entriesMutex_);
+        if (entries_.erase(alias) > 0)
         {
-            registry_.erase(alias);
-            save();
+            enqueue(alias, std::nullopt);
         }
     }
 
     std::vector<std::string> CacheRegistry::listAliases() const
     {
+        std::shared_lock<std::shared_mutex> lock(entriesMutex_);
         std::vector<std::string> aliases;
-        for (auto& [key, val] : registry_.items())
+        aliases.reserve(entries_.size());
+        for (const auto& key : std::views::keys(entries_))
         {
             aliases.push_back(key);
         }
         return aliases;
     }
 
-    void CacheRegistry::load()
+    bool CacheRegistry::flush()
+    {
+        std::unique_lock<std::mutex> lock(flushMutex_);
+        const uint64_t target = mutationSeq_;
+        if (persistedSeq_ >= target)
+            return true;
+        
+        // A failure from before this call does not count: the request makes the flusher retry right away.
+        const uint64_t failedBefore = failedWrites_;
+        flushRequested_ = true;
+        flushCv_.notify_all();
+        persistedCv_.wait(lock, [this, target, failedBefore] {
+            return persistedSeq_ >= target || (failedWrites_ != failedBefore && failedSeq_ >= target) || stopping_;
+        });
+        return persistedSeq_ >= target;
+    }
+
+    bool CacheRegistry::load()
+    {
+        if (options_.processLock)
+        {
+            Internal::FileLock fileLock(registryPath_ + ".lock");
+            if (!fileLock.locked())
+                return false;
+            entries_ = readFromDisk();
+        }
+        else
+        {
+            entries_ = readFromDisk();
+        }
+        return true;
+    }
+
+    void CacheRegistry::enqueue(const std::string& alias, std::optional<CachedItemInfo> info)
+    {
+        // Called with entriesMutex_ held so the queued value always matches the in-memory one.
+        {
+            std::lock_guard<std::mutex> lock(flushMutex_);
+            pending_[alias] = std::move(info);
+            ++mutationSeq_;
+        }
+        flushCv_.notify_all();
+    }
+
+    void CacheRegistry::flushLoop()
+    {
+        constexpr int kAttemptsWhenStopping = 3;
+        const auto firstRetryDelay = std::max(options_.flushDelay, std::chrono::milliseconds(100));
+        auto retryDelay = firstRetryDelay;
+        int stoppingAttempts = 0;
+
+        std::unique_lock<std::mutex> lock(flushMutex_);
+        while (true)
+        {
+            flushCv_.wait(lock, [this] { return stopping_ || mutationSeq_ != persistedSeq_; });
+            if (mutationSeq_ == persistedSeq_)
+                break; // Stopping with nothing left to write.
+
+            // Write-behind window: let a burst of mutations accumulate into a single write.
+            if (!stopping_ && !flushRequested_)
+                flushCv_.wait_for(lock, options_.flushDelay, [this] { return stopping_ || flushRequested_; });
+
+            PendingOps ops;
+            ops.swap(pending_);
+            const uint64_t seq = mutationSeq_;
+            flushRequested_ = false;
+            lock.unlock();
+
+            const bool ok = persist(ops);
+
+            lock.lock();
+            if (ok)
+            {
+                persistedSeq_ = seq;
+                retryDelay = firstRetryDelay;
+                persistedCv_.notify_all();
+                continue;
+            }
+
+            // Keep the failed operations for the next write unless they were superseded meanwhile.
+            for (auto& [alias, op] : ops)
+                pending_.try_emplace(alias, std::move(op));
+            failedSeq_ = seq;
+            ++failedWrites_;
+            persistedCv_.notify_all();
+
+            if (stopping_)
+            {
+                if (++stoppingAttempts >= kAttemptsWhenStopping)
+                {
+                    GEMINI_ERROR("Giving up on {} unsaved cache registry changes", pending_.size());
+                    break;
+                }
+                lock.unlock();
+                std::this_thread::sleep_for(firstRetryDelay);
+                lock.lock();
+                continue;
+            }
+
+            GEMINI_WARN("Cache registry write failed, retrying in {} ms", retryDelay.count());
+            flushCv_.wait_for(lock, retryDelay, [this] { return stopping_ || flushRequested_; });
+            retryDelay = std::min(retryDelay * 2, options_.maxRetryDelay);
+        }
+    }
+
+    bool CacheRegistry::persist(PendingOps& ops)
     {
-        if (std::filesystem::exists(registryPath_))
+        try
         {
-            try
+            if (!options_.processLock)
             {
-                std::ifstream file(registryPath_);
-                file >> registry_;
+                std::string data;
+                {
+                    std::shared_lock<std::shared_mutex> lock(entriesMutex_);
+                    data = serialize(entries_);
+                }
+                return Internal::writeFileAtomic(registryPath_, data);
             }
-            catch (const std::exception& e)
+
+            // Multi-process mode: re-read the file under the lock and apply only our own changes,
+            // so concurrent writers in other processes are not overwritten.
+            Internal::FileLock fileLock(registryPath_ + ".lock");
+            if (!fileLock.locked())
+                return false; // Retried by the flusher, like a failed write.
+            auto onDisk = readFromDisk();
+            for (const auto& [alias, op] : ops)
+            {
+                if (op.has_value())
+                    onDisk[alias] = *op;
+                else
+                    onDisk.erase(alias);
+            }
+
+            if (!Internal::writeFileAtomic(registryPath_, serialize(onDisk)))
+                return false;
+
+            // Pick up entries written by other processes without clobbering mutations queued since.
+            std::unique_lock<std::shared_mutex> entriesLock(entriesMutex_);
+            std::lock_guard<std::mutex> pendingLock(flushMutex_);
+            for (auto& [alias, info] : onDisk)
             {
-                GEMINI_WARN("Failed to load cache registry ({}). Starting fresh.", e.what());
-                registry_ = nlohmann::json::object();
+                if (!pending_.contains(alias))
+                    entries_[alias] = std::move(info);
             }
-        } else
+            std::erase_if(entries_, [this, &onDisk](const auto& entry) {
+                return !onDisk.contains(entry.first) && !pending_.contains(entry.first);
+            });
+            return true;
+        }
+        catch (const std::exception& e)
         {
-            registry_ = nlohmann::json::object();
+            GEMINI_ERROR("Failed to save cache registry: {}", e.what());
+            return false;
         }
     }
 
-    void CacheRegistry::save() const
+    std::unordered_map<std::string, CachedItemInfo> CacheRegistry::readFromDisk() const
     {
+        std::unordered_map<std::string, CachedItemInfo> result;
+        
+        auto data = Internal::readFile(registryPath_);
+        if (!data.has_value() || data->empty())
+            return result;
+        
         try
         {
-            std::ofstream file(registryPath_);
-            file << registry_.dump(4);
+            auto j = nlohmann::json::parse(*data);
+            for (auto& [key, val] : j.items())
+            {
+                CachedItemInfo info = CachedItemInfo::fromJson(val);
+                info.alias = key;
+                result.emplace(key, std::move(info));
+            }
         }
         catch (const std::exception& e)
         {
-            GEMINI_ERROR("Failed to save cache registry: {}", e.what());
+            GEMINI_WARN("Failed to load cache registry ({}). Starting fresh.", e.what());
+            result.clear();
+        }
+        return result;
+    }
+
+    std::string CacheRegistry::serialize(const std::unordered_map<std::string, CachedItemInfo>& entries)
+    {
+        nlohmann::json j = nlohmann::json::object();
+        for (const auto& [alias, info] : entries)
+        {
+            j[alias] = info.toJson();
         }
+        return j.dump(4);
     }
 }
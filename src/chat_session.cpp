@@ -1,10 +1,12 @@
 ﻿#include "gemini/chat_session.h"
 #include "gemini/client.h"
+#include <algorithm>
 #include <nlohmann/json.hpp>
 
 #include "gemini/uuid.h"
 #include "gemini/logger.h"
 #include "gemini/storage.h"
+#include "gemini/thread_pool.h"
 
 namespace GeminiCPP
 {
@@ -15,30 +17,80 @@ namespace GeminiCPP
     }
 
     ChatSession::ChatSession(const ChatSession& other)
-        : client_(other.client_), model_(other.model_), sessionId_(other.sessionId_),
-        systemInstruction_(other.systemInstruction_), history_(other.history_), tools_(other.tools_)
     {
+        std::lock_guard<std::mutex> lock(other.mutex_);
+        sessionId_ = other.sessionId_;
+        copyFrom(other);
+    }
+
+    ChatSession::~ChatSession()
+    {
+        std::unique_ptr<SerialExecutor> turnQueue;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            turnQueue = std::move(turnQueue_);
+        }
+        turnQueue.reset(); // Cancels the queued turns and waits for the running one, which still uses the session.
+        waitForCompaction();
     }
 
     ChatSession& ChatSession::operator=(const ChatSession& other)
     {
         if (std::addressof(other) == this)
             return *this;
+        std::scoped_lock lock(mutex_, other.mutex_);
+        copyFrom(other);
+        ++historyEpoch_;
+        return *this;
+    }
+
+    void ChatSession::copyFrom(const ChatSession& other)
+    {
         client_ = other.client_;
         model_ = other.model_;
         sessionName_ = other.sessionName_;
         systemInstruction_ = other.systemInstruction_;
+        cachedContent_ = other.cachedContent_;
         history_ = other.history_;
+        turnTokens_ = other.turnTokens_;
+        contextPolicy_ = other.contextPolicy_;
+        compactionPolicy_ = other.compactionPolicy_;
+        summary_ = other.summary_;
         tools_ = other.tools_;
-        return *this;
+        functionRegistry_ = other.functionRegistry_;
+        toolsJson_ = other.toolsJson_;
+        functionExecutionPolicy_ = other.functionExecutionPolicy_;
+        autoReply_ = other.autoReply_;
+        maxFunctionCallTurns_ = other.maxFunctionCallTurns_;
+        config_ = other.config_;
+        safetySettings_ = other.safetySettings_;
+        turnExecutor_ = other.turnExecutor_;
+        parentId_ = other.parentId_;
+        forkPoints_ = other.forkPoints_;
+    }
+
+    ChatSession ChatSession::fork(std::string sessionName, std::string sessionId) const
+    {
+        ChatSession branch(*this);
+        branch.sessionId_ = sessionId.empty() ? Uuid::generate() : std::move(sessionId);
+        if (!sessionName.empty())
+            branch.sessionName_ = std::move(sessionName);
+        branch.parentId_ = sessionId_;
+
+        // A fork at the same point as the previous one shares the same prefix.
+        const size_t point = branch.history_.size();
+        if (point > 0 && (branch.forkPoints_.empty() || branch.forkPoints_.back() < point))
+            branch.forkPoints_.push_back(point);
+        return branch;
     }
 
     GenerationResult ChatSession::send(const Content& content)
     {
+        std::lock_guard<std::mutex> turn(turnMutex_);
         int remainingTurns = 0;
         {
             std::lock_guard<std::mutex> lock(mutex_);
-            history_.push_back(content);
+            appendTurn(content);
             remainingTurns = maxFunctionCallTurns_;
         }
         
@@ -59,41 +111,29 @@ namespace GeminiCPP
                 return result;
 
             // --- FUNCTION CALLING AUTO-REPLY LOGIC ---
-            bool hasFunctionCall = false;
-            Content functionResponseContent = Content::Function();
+            // The calls of one turn run concurrently; responses come back in call order.
+            std::optional<FunctionExecutor> executor;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                executor.emplace(functionRegistry_, functionExecutionPolicy_);
+            }
 
             for (const auto& part : result.content.parts)
             {
-                if (part.isFunctionCall())
-                {
-                    hasFunctionCall = true;
-                    auto call = part.getFunctionCall();
-
-                    auto jsonResult = functionRegistry_.invoke(call->name, call->args);
-                    
-                    FunctionResponse response;
-                    response.name = call->name;
-                    
-                    if (jsonResult.has_value())
-                    {
-                        response.responseContent = jsonResult.value();
-                    } else
-                    {
-                        GEMINI_ERROR("Function invocation failed: {}", call->name);
-                        response.responseContent = {
-                            {"error", "Function execution failed or not found"}
-                        };
-                    }
-                    functionResponseContent.functionResponse(response);
-                }
+                if (const auto* call = part.getFunctionCall())
+                    executor->submit(*call);
             }
 
-            if (!hasFunctionCall)
+            if (executor->empty())
                 return result;
 
+            Content functionResponseContent = Content::Function();
+            for (auto& response : executor->wait())
+                functionResponseContent.functionResponse(std::move(response));
+
             {
                 std::lock_guard<std::mutex> lock(mutex_);
-                history_.push_back(functionResponseContent);
+                appendTurn(std::move(functionResponseContent));
             }
         }
 
@@ -107,11 +147,49 @@ namespace GeminiCPP
 
     GenerationResult ChatSession::stream(const Content& content, const StreamCallback& callback)
     {
+        std::lock_guard<std::mutex> turn(turnMutex_);
+        int remainingTurns = 0;
         {
             std::lock_guard<std::mutex> lock(mutex_);
-            history_.push_back(content);
+            appendTurn(content);
+            remainingTurns = maxFunctionCallTurns_;
         }
-        return streamInternal(callback);
+
+        while (remainingTurns--)
+        {
+            // Function calls are dispatched as soon as their part arrives, while the turn is still streaming.
+            std::optional<FunctionExecutor> executor;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (autoReply_)
+                    executor.emplace(functionRegistry_, functionExecutionPolicy_);
+            }
+
+            StreamPartCallback onPart;
+            if (executor)
+            {
+                onPart = [&executor](const Part& part) {
+                    if (const auto* call = part.getFunctionCall())
+                        executor->submit(*call);
+                };
+            }
+
+            GenerationResult result = streamInternal(callback, onPart);
+
+            if (!result.success || !executor || executor->empty())
+                return result;
+
+            Content functionResponseContent = Content::Function();
+            for (auto& response : executor->wait())
+                functionResponseContent.functionResponse(std::move(response));
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                appendTurn(std::move(functionResponseContent));
+            }
+        }
+
+        return GenerationResult::Failure("Max function call turns exceeded");
     }
 
     GenerationResult ChatSession::stream(const std::string& text, const StreamCallback& callback)
@@ -119,9 +197,39 @@ namespace GeminiCPP
         return stream(Content::User().text(text), callback);
     }
 
+    std::future<GenerationResult> ChatSession::enqueueTurn(std::function<GenerationResult()> turn)
+    {
+        SerialExecutor* queue;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!turnQueue_)
+                turnQueue_ = std::make_unique<SerialExecutor>(turnExecutor_);
+            queue = turnQueue_.get();
+        }
+
+        auto promise = std::make_shared<std::promise<GenerationResult>>();
+        std::future<GenerationResult> future = promise->get_future();
+        queue->submit(
+            [promise, turn = std::move(turn)]() {
+                try
+                {
+                    promise->set_value(turn());
+                }
+                catch (...)
+                {
+                    promise->set_exception(std::current_exception());
+                }
+            },
+            [promise]() {
+                promise->set_value(GenerationResult::Failure("Turn cancelled before it started",
+                    frenum::value(HttpMappedStatusCode::CANCELLED)));
+            });
+        return future;
+    }
+
     std::future<GenerationResult> ChatSession::sendAsync(const Content& content)
     {
-        return std::async(std::launch::async, [this, content]() {
+        return enqueueTurn([this, content]() {
             return this->send(content);
         });
     }
@@ -133,7 +241,7 @@ namespace GeminiCPP
 
     std::future<GenerationResult> ChatSession::streamAsync(const Content& content, const StreamCallback& callback)
     {
-        return std::async(std::launch::async, [this, content, callback]() {
+        return enqueueTurn([this, content, callback]() {
             return this->stream(content, callback);
         });
     }
@@ -143,11 +251,54 @@ namespace GeminiCPP
         return streamAsync(Content::User().text(text), callback);
     }
 
+    void ChatSession::setTurnExecutor(ThreadPool* pool)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        turnExecutor_ = pool;
+        if (turnQueue_)
+            turnQueue_->setPool(pool);
+    }
+
+    size_t ChatSession::queuedTurns() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return turnQueue_ ? turnQueue_->queued() : 0;
+    }
+
+    size_t ChatSession::cancelQueuedTurns()
+    {
+        SerialExecutor* queue;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue = turnQueue_.get();
+        }
+        // The queue lives as long as the session, and the cancelled futures are completed outside mutex_.
+        return queue ? queue->cancelAll() : 0;
+    }
+
+    SerialExecutorStats ChatSession::turnQueueStats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return turnQueue_ ? turnQueue_->stats() : SerialExecutorStats{};
+    }
+
     std::string ChatSession::getId() const
     {
         return sessionId_;
     }
 
+    std::string ChatSession::getParentId() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return parentId_;
+    }
+
+    size_t ChatSession::getForkPoint() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return forkPoints_.empty() ? 0 : forkPoints_.back();
+    }
+
     void ChatSession::setModel(std::string_view model)
     {
         std::lock_guard<std::mutex> lock(mutex_);
@@ -209,19 +360,31 @@ namespace GeminiCPP
     void ChatSession::addTool(const Tool& tool)
     {
         std::lock_guard<std::mutex> lock(mutex_);
-        tools_.push_back(tool);
+        auto tools = tools_ ? std::make_shared<std::vector<Tool>>(*tools_) : std::make_shared<std::vector<Tool>>();
+        tools->push_back(tool);
+        tools_ = std::move(tools);
+        toolsJson_.reset();
     }
 
     void ChatSession::setTools(const std::vector<Tool>& tools)
     {
         std::lock_guard<std::mutex> lock(mutex_);
-        tools_ = tools;
+        tools_ = std::make_shared<const std::vector<Tool>>(tools);
+        toolsJson_.reset();
     }
 
     void ChatSession::clearTools()
     {
         std::lock_guard<std::mutex> lock(mutex_);
-        tools_.clear();
+        tools_.reset();
+        toolsJson_.reset();
+    }
+
+    void ChatSession::registerWorkerFunction(FunctionDeclaration declaration, ToolWorkerOptions workerOptions, FunctionOptions options)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        functionRegistry_.registerWorkerFunction(std::move(declaration), std::move(workerOptions), options);
+        toolsJson_.reset();
     }
 
     void ChatSession::setSafetySettings(const std::vector<SafetySetting>& settings)
@@ -251,6 +414,18 @@ namespace GeminiCPP
         autoReply_ = enabled;
     }
 
+    void ChatSession::setFunctionExecutionPolicy(const FunctionExecutionPolicy& policy)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        functionExecutionPolicy_ = policy;
+    }
+
+    FunctionExecutionPolicy ChatSession::getFunctionExecutionPolicy() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return functionExecutionPolicy_;
+    }
+
     void ChatSession::setMaxFunctionCallTurns(int maxTurns)
     {
         std::lock_guard<std::mutex> lock(mutex_);
@@ -263,54 +438,167 @@ namespace GeminiCPP
         return maxFunctionCallTurns_;
     }
 
+    void ChatSession::setContextPolicy(const ContextWindowPolicy& policy)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        contextPolicy_ = policy;
+    }
+
+    ContextWindowPolicy ChatSession::getContextPolicy() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return contextPolicy_;
+    }
+
+    void ChatSession::setCompactionPolicy(const CompactionPolicy& policy)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        compactionPolicy_ = policy;
+    }
+
+    CompactionPolicy ChatSession::getCompactionPolicy() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return compactionPolicy_;
+    }
+
+    HistorySummary ChatSession::getHistorySummary() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return summary_;
+    }
+
+    void ChatSession::waitForCompaction() const
+    {
+        std::shared_future<void> task;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            task = compactionTask_;
+        }
+        if (task.valid())
+            task.wait();
+    }
+
     void ChatSession::clearHistory()
     {
         std::lock_guard<std::mutex> lock(mutex_);
         history_.clear();
+        turnTokens_.clear();
+        summary_ = HistorySummary{};
+        forkPoints_.clear();
+        ++historyEpoch_;
     }
 
     std::vector<Content> ChatSession::history() const
+    {
+        return historySnapshot().toVector();
+    }
+
+    History ChatSession::historySnapshot() const
     {
         std::lock_guard<std::mutex> lock(mutex_);
         return history_;
     }
     
-    nlohmann::json ChatSession::toJson() const
+    nlohmann::json ChatSessionSnapshot::toJson() const
     {
-        std::lock_guard<std::mutex> lock(mutex_);
         nlohmann::json j;
-        j["id"] = sessionId_;
-        j["name"] = sessionName_;
-        j["model"] = model_;
-        j["systemInstruction"] = systemInstruction_;
+        j["id"] = id;
+        j["name"] = name;
+        j["model"] = model;
+        j["systemInstruction"] = systemInstruction;
         
         nlohmann::json histArr = nlohmann::json::array();
-        for(const auto& content : history_) {
-            histArr.push_back(content.toJson());
+        for(const auto& content : history.turns()) {
+            histArr.push_back(content->toJson());
         }
         j["history"] = histArr;
+        j["turnTokens"] = turnTokens;
+        if (!summary.empty())
+            j["summary"] = summary.toJson();
+        if (!parentId.empty())
+            j["parentId"] = parentId;
+        if (!forkPoints.empty())
+            j["forkPoints"] = forkPoints;
 
         return j;
     }
 
-    ChatSession ChatSession::fromJson(Client* client, const nlohmann::json& j)
+    nlohmann::json ChatSession::toJson() const
     {
-        std::string modelName = j.value("model", "gemini-2.5-flash");
+        return snapshot().toJson();
+    }
+
+    ChatSessionSnapshot ChatSession::snapshot() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return ChatSessionSnapshot{sessionId_, sessionName_, model_, systemInstruction_, history_, turnTokens_, summary_,
+                                   parentId_, forkPoints_};
+    }
+
+    ChatSessionSnapshot ChatSessionSnapshot::fromJson(const nlohmann::json& j)
+    {
+        ChatSessionSnapshot snapshot;
+        snapshot.id = j.value("id", "");
+        snapshot.name = j.value("name", "");
+        snapshot.model = j.value("model", "gemini-2.5-flash");
+        snapshot.systemInstruction = j.value("systemInstruction", "");
 
-        ChatSession session(
-            client,
-            modelName,
-            j.value("name", ""),
-            j.value("id", "")
-        );
-        
         if(j.contains("history"))
         {
             for(const auto& item : j["history"])
             {
-                session.history_.push_back(Content::fromJson(item));
+                snapshot.history.push_back(Content::fromJson(item));
             }
         }
+
+        if (j.contains("turnTokens") && j["turnTokens"].is_array())
+        {
+            for (const auto& tokens : j["turnTokens"])
+                snapshot.turnTokens.push_back(tokens.get<int>());
+        }
+
+        if (j.contains("summary"))
+            snapshot.summary = HistorySummary::fromJson(j["summary"]);
+
+        snapshot.parentId = j.value("parentId", "");
+        if (j.contains("forkPoints") && j["forkPoints"].is_array())
+        {
+            for (const auto& point : j["forkPoints"])
+                snapshot.forkPoints.push_back(point.get<size_t>());
+        }
+        
+        return snapshot;
+    }
+
+    ChatSession ChatSession::fromJson(Client* client, const nlohmann::json& j)
+    {
+        return fromSnapshot(client, ChatSessionSnapshot::fromJson(j));
+    }
+
+    ChatSession ChatSession::fromSnapshot(Client* client, ChatSessionSnapshot snapshot)
+    {
+        ChatSession session(
+            client,
+            snapshot.model,
+            std::move(snapshot.name),
+            std::move(snapshot.id)
+        );
+
+        session.systemInstruction_ = std::move(snapshot.systemInstruction);
+        session.history_ = std::move(snapshot.history);
+        session.turnTokens_ = std::move(snapshot.turnTokens);
+        session.turnTokens_.resize(session.history_.size(), 0);
+
+        if (snapshot.summary.end <= session.history_.size())
+            session.summary_ = std::move(snapshot.summary);
+
+        session.parentId_ = std::move(snapshot.parentId);
+        for (size_t point : snapshot.forkPoints)
+        {
+            if (point > 0 && point <= session.history_.size() && (session.forkPoints_.empty() || session.forkPoints_.back() < point))
+                session.forkPoints_.push_back(point);
+        }
         
         return session;
     }
@@ -321,15 +609,22 @@ namespace GeminiCPP
             return GenerationResult::Failure("Client is null");
 
         GenerateContentRequestBody request;
+        std::vector<size_t> sentTurns;
+        int summaryTokens = 0;
+        uint64_t epoch = 0;
         
         {
             std::lock_guard<std::mutex> lock(mutex_);
             
-            // Populate Request Body using types
-            request.contents = history_;
+            // Populate Request Body using types (the history is shared, not copied).
+            // Only the turns that fit the context window are sent; history_ itself is never trimmed.
+            ContextWindowSelection window = selectContext();
+            request.history = std::move(window.history);
+            sentTurns = std::move(window.indices);
+            summaryTokens = summary_.empty() ? 0 : summary_.tokens;
+            epoch = historyEpoch_;
             
-            if (!systemInstruction_.empty())
-                request.systemInstruction = Content::User().text(systemInstruction_); // System instruction content
+            request.systemInstruction = buildSystemInstruction(); // System instruction content (plus the history summary)
             
             if (!cachedContent_.empty())
                 request.cachedContent = ResourceName::CachedContent(cachedContent_);
@@ -339,10 +634,8 @@ namespace GeminiCPP
             if (!safetySettings_.empty())
                 request.safetySettings = safetySettings_;
             
-            // Tools
-            std::vector<Tool> combinedTools = getCombinedTools();
-            if (!combinedTools.empty())
-                request.tools = combinedTools;
+            // Tools (serialized once and reused until they change)
+            request.toolsJson = getCombinedToolsJson();
         }
 
         // Call Client
@@ -351,25 +644,33 @@ namespace GeminiCPP
         if (result.success)
         {
             std::lock_guard<std::mutex> lock(mutex_);
-            history_.push_back(result.content);
+            recordUsage(sentTurns, summaryTokens, epoch, result);
+            appendTurn(result.content, result.outputTokens);
+            maybeStartCompaction();
         }
 
         return result;
     }
 
-    GenerationResult ChatSession::streamInternal(const StreamCallback& callback)
+    GenerationResult ChatSession::streamInternal(const StreamCallback& callback, const StreamPartCallback& onPart)
     {
         if (!client_) return GenerationResult::Failure("Client is null");
 
         StreamGenerateContentRequestBody request;
+        std::vector<size_t> sentTurns;
+        int summaryTokens = 0;
+        uint64_t epoch = 0;
         
         {
             std::lock_guard<std::mutex> lock(mutex_);
             
-            request.contents = history_;
+            ContextWindowSelection window = selectContext();
+            request.history = std::move(window.history);
+            sentTurns = std::move(window.indices);
+            summaryTokens = summary_.empty() ? 0 : summary_.tokens;
+            epoch = historyEpoch_;
             
-            if (!systemInstruction_.empty())
-                request.systemInstruction = Content::User().text(systemInstruction_);
+            request.systemInstruction = buildSystemInstruction();
             
             if (!cachedContent_.empty())
                 request.cachedContent = ResourceName::CachedContent(cachedContent_);
@@ -378,27 +679,189 @@ namespace GeminiCPP
             if (!safetySettings_.empty())
                 request.safetySettings = safetySettings_;
             
-            std::vector<Tool> combinedTools = getCombinedTools();
-            if (!combinedTools.empty())
-                request.tools = combinedTools;
+            request.toolsJson = getCombinedToolsJson();
         }
 
-        GenerationResult result = client_->streamGenerateContent(model_, request, callback);
+        GenerationResult result = client_->streamGenerateContent(model_, request, callback, onPart);
 
         if (result.success)
         {
             std::lock_guard<std::mutex> lock(mutex_);
-            history_.push_back(result.content);
+            recordUsage(sentTurns, summaryTokens, epoch, result);
+            appendTurn(result.content, result.outputTokens);
+            maybeStartCompaction();
         }
 
         return result;
     }
 
-    std::vector<Tool> ChatSession::getCombinedTools() const
+    std::shared_ptr<const std::string> ChatSession::getCombinedToolsJson() const
     {
-        std::vector<Tool> combined = tools_;
+        if (toolsJson_ || ((!tools_ || tools_->empty()) && functionRegistry_.empty()))
+            return toolsJson_;
+
+        std::string json = "[";
+        if (tools_)
+        {
+            for (const auto& tool : *tools_)
+            {
+                if (json.size() > 1)
+                    json += ',';
+                json += tool.toJson().dump();
+            }
+        }
         if (!functionRegistry_.empty())
-            combined.push_back(functionRegistry_.getTool());
-        return combined;
+        {
+            if (json.size() > 1)
+                json += ',';
+            json += *functionRegistry_.toolJson();
+        }
+        json += ']';
+
+        toolsJson_ = std::make_shared<const std::string>(std::move(json));
+        return toolsJson_;
+    }
+
+    void ChatSession::appendTurn(Content content, int tokens)
+    {
+        history_.push_back(std::move(content));
+        turnTokens_.push_back(tokens);
+    }
+
+    void ChatSession::recordUsage(const std::vector<size_t>& sentTurns, int summaryTokens, uint64_t epoch, const GenerationResult& result)
+    {
+        // The indices are those of the history the request was built from; once it was replaced (e.g. cleared
+        // and appended to again), they may name unrelated turns.
+        if (epoch != historyEpoch_)
+            return;
+
+        // promptTokenCount covers every turn that was sent (plus system instruction and tools). Turns that
+        // were already measured are subtracted; the remainder is split across the unmeasured ones by size.
+        // Attributing the fixed overhead to new turns overestimates slightly, which keeps the window safe.
+        int remaining = result.inputTokens - result.cachedTokens - summaryTokens;
+        std::vector<size_t> unknown;
+        for (size_t index : sentTurns)
+        {
+            if (index >= turnTokens_.size())
+                return;
+            if (turnTokens_[index] > 0)
+                remaining -= turnTokens_[index];
+            else
+                unknown.push_back(index);
+        }
+
+        if (unknown.empty() || remaining <= 0)
+            return;
+
+        const std::vector<size_t> sizes = history_.turnJsonSizes();
+        size_t unknownBytes = 0;
+        for (size_t index : unknown)
+            unknownBytes += sizes[index];
+
+        for (size_t index : unknown)
+        {
+            const double share = unknownBytes > 0 ? static_cast<double>(sizes[index]) / static_cast<double>(unknownBytes)
+                                                  : 1.0 / static_cast<double>(unknown.size());
+            turnTokens_[index] = std::max(1, static_cast<int>(remaining * share + 0.5));
+        }
+    }
+
+    ContextWindowSelection ChatSession::selectContext() const
+    {
+        if (summary_.empty())
+            return ContextWindow::select(history_, turnTokens_, contextPolicy_);
+
+        // Summarized turns are replaced by the summary (sent with the system instruction).
+        std::vector<size_t> visible;
+        std::vector<int> tokens;
+        for (size_t i = 0; i < history_.size(); ++i)
+        {
+            if (i >= summary_.begin && i < summary_.end)
+                continue;
+            visible.push_back(i);
+            tokens.push_back(i < turnTokens_.size() ? turnTokens_[i] : 0);
+        }
+
+        ContextWindowSelection selection = ContextWindow::select(history_.select(visible), tokens, contextPolicy_);
+        for (auto& index : selection.indices)
+            index = visible[index];
+        return selection;
+    }
+
+    std::optional<Content> ChatSession::buildSystemInstruction() const
+    {
+        if (summary_.empty())
+        {
+            if (systemInstruction_.empty())
+                return std::nullopt;
+            return Content::User().text(systemInstruction_);
+        }
+
+        std::string text = systemInstruction_;
+        if (!text.empty())
+            text += "\n\n";
+        text += "Summary of the earlier conversation:\n" + summary_.text;
+        return Content::User().text(text);
+    }
+
+    void ChatSession::maybeStartCompaction()
+    {
+        if (!compactionPolicy_.enabled || compactionRunning_ || !client_)
+            return;
+
+        const std::vector<size_t> sizes = history_.turnJsonSizes();
+        int tokens = summary_.empty() ? 0 : summary_.tokens;
+        for (size_t i = 0; i < sizes.size(); ++i)
+        {
+            if (i >= summary_.begin && i < summary_.end)
+                continue;
+            tokens += (i < turnTokens_.size() && turnTokens_[i] > 0) ? turnTokens_[i] : ContextWindow::estimateTokens(sizes[i], contextPolicy_.bytesPerToken);
+        }
+        if (tokens <= compactionPolicy_.triggerTokens)
+            return;
+
+        const size_t count = history_.size();
+        const size_t begin = summary_.empty() ? std::min(contextPolicy_.pinnedTurns, count) : summary_.begin;
+        const size_t limit = count > compactionPolicy_.keepRecentTurns ? count - compactionPolicy_.keepRecentTurns : 0;
+        const size_t end = HistoryCompactor::findCut(history_, begin, limit);
+        if (end <= std::max(begin, summary_.end))
+            return; // Nothing new to summarize yet.
+
+        compactionRunning_ = true;
+        ThreadPool& executor = compactionPolicy_.executor ? *compactionPolicy_.executor : ThreadPool::shared();
+        compactionTask_ = executor.submit([this, snapshot = history_, previous = summary_, begin, end, epoch = historyEpoch_, policy = compactionPolicy_]() {
+            runCompaction(snapshot, previous, begin, end, epoch, policy);
+        }).share();
+    }
+
+    void ChatSession::runCompaction(History snapshot, HistorySummary previous, size_t begin, size_t end, uint64_t epoch, CompactionPolicy policy)
+    {
+        const size_t from = previous.empty() ? begin : previous.end;
+        GenerateContentRequestBody request = HistoryCompactor::buildRequest(snapshot, from, end, previous.text, policy);
+        GenerationResult result = client_->generateContent(policy.model, request);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        compactionRunning_ = false;
+
+        if (!result.success || result.text().empty())
+        {
+            GEMINI_WARN("History compaction failed for session {}: {}", sessionId_, result.errorMessage);
+            return;
+        }
+
+        // Only swap in the summary if the history it was built from is still the one in use.
+        if (epoch != historyEpoch_ || summary_.begin != previous.begin || summary_.end != previous.end || end > history_.size())
+        {
+            GEMINI_DEBUG("Discarding stale history summary for session {}", sessionId_);
+            return;
+        }
+
+        HistorySummary summary;
+        summary.begin = begin;
+        summary.end = end;
+        summary.text = result.text();
+        summary.tokens = result.outputTokens > 0 ? result.outputTokens : ContextWindow::estimateTokens(summary.text.size(), contextPolicy_.bytesPerToken);
+        summary_ = std::move(summary);
+        GEMINI_INFO("Compacted turns [{}, {}) of session {} into a {}-token summary", begin, end, sessionId_, summary_.tokens);
     }
 }
@@ -49,7 +49,7 @@ namespace GeminiCPP
     }
     
     Client::Client(std::string api_key) 
-        : files(this), models(this), tokens(this), api_key_(std::move(api_key)) 
+        : files(this), models(this), tokens(this), caches(this), api_key_(std::move(api_key)) 
     {}
 
     void Client::setRetryConfig(const Support::RetryConfig& config) { retryConfig_ = config; }
@@ -60,15 +60,16 @@ namespace GeminiCPP
     GenerationResult Client::generateContent(const std::string& model, const GenerateContentRequestBody& request)
     {
         Url url(ResourceName::Model(model), GM_GENERATE_CONTENT);
-        // Type-safe JSON conversion
-        return submitRequest(url, request.toJson());
+        // Type-safe JSON conversion (history turns are spliced from their cached serialization)
+        return submitRequest(url, request.dump());
     }
 
-    GenerationResult Client::streamGenerateContent(const std::string& model, const StreamGenerateContentRequestBody& request, const StreamCallback& callback)
+    GenerationResult Client::streamGenerateContent(const std::string& model, const StreamGenerateContentRequestBody& request, const StreamCallback& callback,
+                                                   const StreamPartCallback& onPart)
     {
         Url url(ResourceName::Model(model), GM_STREAM_GENERATE_CONTENT);
         url.addQuery("alt", "sse");
-        return submitStreamRequest(url, request.toJson(), callback);
+        return submitStreamRequest(url, request.dump(), callback, onPart);
     }
 
     // --- CONVENIENCE OVERLOADS ---
@@ -140,7 +141,7 @@ namespace GeminiCPP
         return result;
     }
 
-    GenerationResult Client::submitRequest(const Url& url, const nlohmann::json& payload)
+    GenerationResult Client::submitRequest(const Url& url, const std::string& body)
     {
         int attempt = 0;
         while (true)
@@ -151,7 +152,7 @@ namespace GeminiCPP
                     {"Content-Type", "application/json"},
                     {"x-goog-api-key", api_key_}
                 },
-                cpr::Body{payload.dump()},
+                cpr::Body{body},
                 cpr::VerifySsl(false)
             );
 
@@ -186,7 +187,7 @@ namespace GeminiCPP
                     // Note: In some API versions groundingMetadata is inside candidate, in types we put it there.
                     grounding = candidate.groundingMetadata;
 
-                    return GenerationResult::Success(
+                    GenerationResult result = GenerationResult::Success(
                         candidate.content,
                         static_cast<int>(r.status_code),
                         responseBody.usageMetadata.promptTokenCount,
@@ -194,6 +195,8 @@ namespace GeminiCPP
                         candidate.finishReason.value_or(FinishReason::FINISH_REASON_UNSPECIFIED),
                         grounding
                     );
+                    result.cachedTokens = responseBody.usageMetadata.cachedContentTokenCount;
+                    return result;
                 }
                 catch (const std::exception& e)
                 {
@@ -215,16 +218,17 @@ namespace GeminiCPP
         }
     }
 
-    GenerationResult Client::submitStreamRequest(const Url& url, const nlohmann::json& payload, const StreamCallback& callback)
+    GenerationResult Client::submitStreamRequest(const Url& url, const std::string& body, const StreamCallback& callback, const StreamPartCallback& onPart)
     {
         int attempt = 0;
         
         while (true)
         {
-            std::string fullTextAccumulator;
+            Content finalContent = Content::Model();
             std::string buffer;
             int inputTokens = 0;
             int outputTokens = 0;
+            int cachedTokens = 0;
             bool dataReceived = false;
             FinishReason lastFinishReason = FinishReason::FINISH_REASON_UNSPECIFIED;
 
@@ -281,17 +285,30 @@ namespace GeminiCPP
                         {
                             const auto& candidate = responseChunk.response.candidates[0];
                             
-                            // Text extraction logic
+                            // Text deltas are merged into the previous text part; every other part arrives whole
                             for (const auto& part : candidate.content.parts)
                             {
-                                if (part.isText())
+                                if (const auto* txtData = part.getText())
                                 {
-                                    if (const auto* txtData = part.getText())
+                                    if (callback) callback(txtData->text);
+
+                                    Part* last = finalContent.parts.empty() ? nullptr : &finalContent.parts.back();
+                                    if (last && last->isText() && last->thought == part.thought)
+                                    {
+                                        std::get<TextData>(last->data).text += txtData->text;
+                                        if (part.thoughtSignature.has_value())
+                                            last->thoughtSignature = part.thoughtSignature;
+                                    }
+                                    else
                                     {
-                                        if (callback) callback(txtData->text);
-                                        fullTextAccumulator += txtData->text;
+                                        finalContent.parts.push_back(part);
                                     }
                                 }
+                                else
+                                {
+                                    finalContent.parts.push_back(part);
+                                    if (onPart) onPart(part);
+                                }
                             }
                             
                             if (candidate.finishReason.has_value())
@@ -303,6 +320,7 @@ namespace GeminiCPP
                         {
                             inputTokens = responseChunk.response.usageMetadata.promptTokenCount;
                             outputTokens = responseChunk.response.usageMetadata.candidatesTokenCount;
+                            cachedTokens = responseChunk.response.usageMetadata.cachedContentTokenCount;
                         }
                     }
                     catch (const std::exception& e)
@@ -319,15 +337,16 @@ namespace GeminiCPP
                     {"Content-Type", "application/json"},
                     {"x-goog-api-key", api_key_}
                 },
-                cpr::Body{payload.dump()},
+                cpr::Body{body},
                 cpr::WriteCallback(write_func),
                 cpr::VerifySsl(false)
             );
 
             if (HttpMappedStatusCodeHelper::isSuccess(r.status_code))
             {
-                Content finalContent = Content::Model().text(fullTextAccumulator);
-                return GenerationResult::Success(finalContent, static_cast<int>(r.status_code), inputTokens, outputTokens, lastFinishReason);
+                GenerationResult result = GenerationResult::Success(finalContent, static_cast<int>(r.status_code), inputTokens, outputTokens, lastFinishReason);
+                result.cachedTokens = cachedTokens;
+                return result;
             }
 
             if (HttpMappedStatusCodeHelper::isRetryable(r.status_code) && attempt < retryConfig_.maxRetries && !dataReceived)
@@ -377,6 +396,26 @@ namespace GeminiCPP
         statusCode = r.status_code;
     }
 
+    void Client::patchHelper(const Url& url, const nlohmann::json& payload, const std::map<std::string, std::string>& params, std::string& text, long& statusCode)
+    {
+        cpr::Parameters cprParams;
+        for(const auto& [k, v] : params) cprParams.Add({k, v});
+
+        cpr::Response r = cpr::Patch(
+            cpr::Url{url.str()},
+            cpr::Header{
+                {"Content-Type", "application/json"},
+                {"x-goog-api-key", api_key_}
+            },
+            cpr::Body{payload.dump()},
+            cprParams,
+            cpr::VerifySsl(false)
+        );
+
+        text = r.text;
+        statusCode = r.status_code;
+    }
+
     void Client::multipartHelper(const Url& url, const std::string& filePath, const std::string& mimeType, const nlohmann::json& metadata, std::string& text, long& statusCode)
     {
         cpr::Response r = cpr::Post(
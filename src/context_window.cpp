@@ -0,0 +1,113 @@
+﻿#include "gemini/context_window.h"
+
+#include <algorithm>
+#include <numeric>
+
+#include "gemini/logger.h"
+
+namespace GeminiCPP
+{
+    namespace
+    {
+        bool hasPart(const Content& content, bool (Part::*predicate)() const)
+        {
+            return std::any_of(content.parts.begin(), content.parts.end(), [predicate](const Part& part) {
+                return (part.*predicate)();
+            });
+        }
+    }
+
+    ContextWindowSelection ContextWindow::select(const History& history, const std::vector<int>& turnTokens, const ContextWindowPolicy& policy)
+    {
+        ContextWindowSelection selection;
+        const size_t count = history.size();
+
+        const std::vector<size_t> sizes = history.turnJsonSizes();
+        std::vector<int> costs(count);
+        for (size_t i = 0; i < count; ++i)
+            costs[i] = (i < turnTokens.size() && turnTokens[i] > 0) ? turnTokens[i] : estimateTokens(sizes[i], policy.bytesPerToken);
+
+        const int total = std::accumulate(costs.begin(), costs.end(), 0);
+
+        auto sendAll = [&]() {
+            selection.history = history;
+            selection.indices.resize(count);
+            std::iota(selection.indices.begin(), selection.indices.end(), size_t{0});
+            selection.tokens = total;
+            return selection;
+        };
+
+        if (policy.maxTokens <= 0 || total <= policy.maxTokens)
+            return sendAll();
+
+        // Split the history into units that must be kept or dropped as a whole.
+        const auto turns = history.turns();
+        std::vector<size_t> unitStarts;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const bool answersCall = policy.keepFunctionPairs && i > 0
+                && hasPart(*turns[i], &Part::isFunctionResponse)
+                && hasPart(*turns[i - 1], &Part::isFunctionCall);
+            if (!answersCall)
+                unitStarts.push_back(i);
+        }
+
+        // The pinned prefix ends on a unit boundary.
+        size_t pinnedEnd = 0;
+        if (policy.pinnedTurns > 0)
+        {
+            const auto it = std::upper_bound(unitStarts.begin(), unitStarts.end(), std::min(policy.pinnedTurns, count) - 1);
+            pinnedEnd = (it == unitStarts.end()) ? count : *it;
+        }
+
+        const size_t firstUnit = static_cast<size_t>(std::lower_bound(unitStarts.begin(), unitStarts.end(), pinnedEnd) - unitStarts.begin());
+        if (firstUnit >= unitStarts.size())
+            return sendAll();
+
+        int used = std::accumulate(costs.begin(), costs.begin() + static_cast<std::ptrdiff_t>(pinnedEnd), 0);
+
+        // Grow the suffix unit by unit, newest first. The last unit is always included.
+        size_t start = count;
+        for (size_t u = unitStarts.size(); u-- > firstUnit;)
+        {
+            const size_t unitStart = unitStarts[u];
+            const int unitCost = std::accumulate(costs.begin() + static_cast<std::ptrdiff_t>(unitStart),
+                                                 costs.begin() + static_cast<std::ptrdiff_t>(start), 0);
+            if (start != count && used + unitCost > policy.maxTokens)
+                break;
+            used += unitCost;
+            start = unitStart;
+        }
+
+        // Prefer a suffix that starts with a user turn, without giving up the most recent unit.
+        const size_t lastUnitStart = unitStarts.back();
+        size_t aligned = start;
+        while (aligned < lastUnitStart && turns[aligned]->role != Role::USER)
+            aligned = *std::upper_bound(unitStarts.begin(), unitStarts.end(), aligned);
+        if (aligned < lastUnitStart || turns[aligned]->role == Role::USER)
+        {
+            used -= std::accumulate(costs.begin() + static_cast<std::ptrdiff_t>(start),
+                                    costs.begin() + static_cast<std::ptrdiff_t>(aligned), 0);
+            start = aligned;
+        }
+
+        if (used > policy.maxTokens)
+            GEMINI_WARN("Context window: most recent turns need {} tokens, budget is {}", used, policy.maxTokens);
+
+        for (size_t i = 0; i < pinnedEnd; ++i)
+            selection.indices.push_back(i);
+        for (size_t i = start; i < count; ++i)
+            selection.indices.push_back(i);
+
+        selection.history = history.select(selection.indices);
+        selection.tokens = used;
+        return selection;
+    }
+
+    int ContextWindow::estimateTokens(size_t jsonBytes, size_t bytesPerToken)
+    {
+        if (bytesPerToken == 0)
+            bytesPerToken = 4;
+        return static_cast<int>((jsonBytes + bytesPerToken - 1) / bytesPerToken);
+    }
+}
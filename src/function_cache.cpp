@@ -0,0 +1,80 @@
+﻿#include "gemini/function_cache.h"
+
+namespace GeminiCPP
+{
+    FunctionResultCache::FunctionResultCache(FunctionCachePolicy policy) : policy_(policy)
+    {
+    }
+
+    std::string FunctionResultCache::canonicalKey(const nlohmann::json& args)
+    {
+        // nlohmann::json keeps object members in a std::map, so dump() is already order-independent.
+        return args.is_null() ? std::string("{}") : args.dump();
+    }
+
+    std::optional<nlohmann::json> FunctionResultCache::get(const std::string& key)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const auto it = index_.find(key);
+        if (it == index_.end())
+        {
+            ++stats_.misses;
+            return std::nullopt;
+        }
+
+        const auto entry = it->second;
+        if (policy_.ttl.count() > 0 && Clock::now() >= entry->expires)
+        {
+            index_.erase(it);
+            entries_.erase(entry);
+            ++stats_.expirations;
+            ++stats_.misses;
+            return std::nullopt;
+        }
+
+        entries_.splice(entries_.begin(), entries_, entry);
+        ++stats_.hits;
+        return entry->result;
+    }
+
+    void FunctionResultCache::put(std::string key, const nlohmann::json& result)
+    {
+        if (policy_.maxEntries == 0 || (result.is_object() && result.contains("error")))
+            return;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        const auto expires = Clock::now() + policy_.ttl;
+        if (const auto it = index_.find(key); it != index_.end())
+        {
+            it->second->result = result;
+            it->second->expires = expires;
+            entries_.splice(entries_.begin(), entries_, it->second);
+            return;
+        }
+
+        entries_.push_front(Entry{std::move(key), result, expires});
+        index_.emplace(entries_.front().key, entries_.begin());
+
+        while (entries_.size() > policy_.maxEntries)
+        {
+            index_.erase(entries_.back().key);
+            entries_.pop_back();
+            ++stats_.evictions;
+        }
+    }
+
+    void FunctionResultCache::clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        index_.clear();
+        entries_.clear();
+    }
+
+    FunctionCacheStats FunctionResultCache::stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        FunctionCacheStats stats = stats_;
+        stats.entries = entries_.size();
+        return stats;
+    }
+}
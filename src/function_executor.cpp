@@ -0,0 +1,242 @@
+﻿#include "gemini/function_executor.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+#include "gemini/logger.h"
+#include "gemini/thread_pool.h"
+
+namespace GeminiCPP
+{
+    namespace
+    {
+        using Clock = std::chrono::steady_clock;
+
+        struct PendingCall
+        {
+            FunctionCall call;
+            std::shared_ptr<const FunctionRegistry::RegisteredFunction> function; ///< nullptr if the function is not registered.
+            bool dispatched = false; ///< Runs through FunctionRegistry::invokeAsync() instead of a worker.
+            bool started = false;    ///< A worker picked it up.
+            Clock::time_point submitted;
+            std::optional<nlohmann::json> result;
+        };
+
+        nlohmann::json invoke(const FunctionCall& call, const std::shared_ptr<const FunctionRegistry::RegisteredFunction>& function)
+        {
+            if (!function)
+            {
+                GEMINI_ERROR("Function invocation failed: {}", call.name);
+                return {{"error", "Function execution failed or not found"}};
+            }
+            return function->call(call.args);
+        }
+    }
+
+    struct FunctionExecutor::State
+    {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<PendingCall> calls; // deque: references stay valid while calls are appended
+        size_t next = 0;               ///< Index of the next call to start.
+        size_t activeWorkers = 0;
+    };
+
+    FunctionExecutor::FunctionExecutor(FunctionRegistry registry, FunctionExecutionPolicy policy)
+        : registry_(std::move(registry)), policy_(policy), state_(std::make_shared<State>())
+    {
+    }
+
+    bool FunctionExecutor::sequential() const
+    {
+        return policy_.maxParallelism <= 1 && policy_.callTimeout.count() == 0;
+    }
+
+    void FunctionExecutor::submit(FunctionCall call)
+    {
+        PendingCall pending;
+        pending.submitted = Clock::now();
+        if (auto function = registry_.findShared(call.name))
+        {
+            pending.dispatched = function->needsDispatch();
+            pending.function = std::move(function);
+        }
+        pending.call = std::move(call);
+
+        if (pending.dispatched)
+        {
+            // Asynchronous or limited functions do not occupy a worker; the registry completes them.
+            pending.started = true;
+            const std::string name = pending.call.name;
+            const nlohmann::json args = pending.call.args;
+            size_t index;
+            {
+                std::lock_guard<std::mutex> lock(state_->mutex);
+                index = state_->calls.size();
+                state_->calls.push_back(std::move(pending));
+            }
+            registry_.invokeAsync(name, args, [state = state_, index](nlohmann::json result) {
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    auto& slot = state->calls[index];
+                    if (!slot.result)
+                        slot.result = std::move(result);
+                }
+                state->cv.notify_all();
+            });
+            return;
+        }
+
+        bool start = false;
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            state_->calls.push_back(std::move(pending));
+            if (!sequential() && state_->activeWorkers < std::max<size_t>(policy_.maxParallelism, 1))
+            {
+                ++state_->activeWorkers;
+                start = true;
+            }
+        }
+
+        if (start)
+            startWorker();
+    }
+
+    ThreadPool& FunctionExecutor::defaultPool()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    void FunctionExecutor::startWorker()
+    {
+        ThreadPool& executor = policy_.executor ? *policy_.executor : defaultPool();
+
+        // Each worker keeps pulling calls until none are left.
+        (void)executor.submit([state = state_]() {
+            while (true)
+            {
+                PendingCall* pending;
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    if (state->next >= state->calls.size())
+                    {
+                        --state->activeWorkers;
+                        return;
+                    }
+                    pending = &state->calls[state->next++];
+                    if (pending->dispatched || pending->result)
+                        continue; // Dispatched, or timed out while queued.
+                    pending->started = true;
+                }
+
+                nlohmann::json result = invoke(pending->call, pending->function);
+
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    if (!pending->result)
+                        pending->result = std::move(result);
+                }
+                state->cv.notify_all();
+            }
+        });
+    }
+
+    std::vector<FunctionResponse> FunctionExecutor::wait()
+    {
+        if (sequential())
+        {
+            for (size_t i = 0; i < size(); ++i)
+            {
+                PendingCall* pending;
+                {
+                    std::lock_guard<std::mutex> lock(state_->mutex);
+                    pending = &state_->calls[i];
+                    if (pending->dispatched)
+                        continue;
+                }
+                nlohmann::json result = invoke(pending->call, pending->function);
+                std::lock_guard<std::mutex> lock(state_->mutex);
+                pending->result = std::move(result);
+            }
+        }
+
+        // Sequential mode only has dispatched calls left to wait for here.
+        {
+            std::unique_lock<std::mutex> lock(state_->mutex);
+            while (true)
+            {
+                bool done = true;
+                std::optional<Clock::time_point> nextDeadline;
+                const auto now = Clock::now();
+
+                // Indexed loop: the lock is released while a replacement worker is started.
+                for (size_t i = 0; i < state_->calls.size(); ++i)
+                {
+                    auto& pending = state_->calls[i];
+                    if (pending.result)
+                        continue;
+                    if (policy_.callTimeout.count() == 0)
+                    {
+                        done = false;
+                        continue;
+                    }
+
+                    const auto deadline = pending.submitted + policy_.callTimeout;
+                    if (now >= deadline)
+                    {
+                        GEMINI_WARN("Function call timed out after {} ms: {}", policy_.callTimeout.count(), pending.call.name);
+                        pending.result = nlohmann::json{{"error", "Function execution timed out"}};
+                        if (pending.started && !pending.dispatched)
+                        {
+                            // The stuck worker still occupies its slot and its thread; start another one for the
+                            // remaining calls, on a thread of its own if the pool is ours.
+                            ++state_->activeWorkers;
+                            lock.unlock();
+                            if (!policy_.executor)
+                                defaultPool().grow();
+                            startWorker();
+                            lock.lock();
+                        }
+                    }
+                    else
+                    {
+                        done = false;
+                        if (!nextDeadline || deadline < *nextDeadline)
+                            nextDeadline = deadline;
+                    }
+                }
+
+                if (done)
+                    break;
+
+                if (nextDeadline)
+                    state_->cv.wait_until(lock, *nextDeadline);
+                else
+                    state_->cv.wait(lock);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        std::vector<FunctionResponse> responses;
+        responses.reserve(state_->calls.size());
+        for (const auto& pending : state_->calls)
+        {
+            FunctionResponse response;
+            response.id = pending.call.id;
+            response.name = pending.call.name;
+            response.responseContent = *pending.result;
+            responses.push_back(std::move(response));
+        }
+        return responses;
+    }
+
+    size_t FunctionExecutor::size() const
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        return state_->calls.size();
+    }
+}
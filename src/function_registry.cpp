@@ -0,0 +1,248 @@
+﻿#include "gemini/function_registry.h"
+
+#include <algorithm>
+#include <future>
+
+#include "gemini/function_executor.h"
+
+namespace GeminiCPP
+{
+    namespace
+    {
+        size_t hashName(std::string_view name)
+        {
+            return std::hash<std::string_view>{}(name);
+        }
+    }
+
+    const FunctionRegistry::RegisteredFunction* FunctionRegistry::find(std::string_view name) const
+    {
+        if (!table_ || table_->count == 0)
+            return nullptr;
+
+        const size_t hash = hashName(name);
+        const size_t mask = table_->slots.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask)
+        {
+            const Slot& slot = table_->slots[i];
+            if (!slot.function)
+                return nullptr;
+            if (slot.hash == hash && slot.function->declaration.name == name)
+                return slot.function.get();
+        }
+    }
+
+    nlohmann::json FunctionRegistry::RegisteredFunction::call(const nlohmann::json& args) const
+    {
+        if (!cache)
+            return invoker(args);
+
+        std::string key = FunctionResultCache::canonicalKey(args);
+        if (auto cached = cache->get(key))
+            return std::move(*cached);
+
+        nlohmann::json result = invoker(args);
+        cache->put(std::move(key), result);
+        return result;
+    }
+
+    std::shared_ptr<const FunctionRegistry::RegisteredFunction> FunctionRegistry::findShared(std::string_view name) const
+    {
+        const auto* function = find(name);
+        // Aliasing constructor: keeps the whole table (and with it the entry) alive.
+        return function ? std::shared_ptr<const RegisteredFunction>(table_, function) : nullptr;
+    }
+
+    void FunctionRegistry::registerWorkerFunction(FunctionDeclaration declaration, ToolWorkerOptions workerOptions, FunctionOptions options)
+    {
+        const std::string name = declaration.name;
+        auto pool = std::make_shared<ToolWorkerPool>(name, std::move(workerOptions));
+
+        RegisteredFunction entry;
+        entry.declaration = std::move(declaration);
+        entry.options = options;
+        if (options.maxConcurrency > 0)
+            entry.gate = std::make_shared<Internal::ConcurrencyGate>(options.maxConcurrency);
+        if (options.cache.maxEntries > 0)
+            entry.cache = std::make_shared<FunctionResultCache>(options.cache);
+        entry.asyncInvoker = [pool](const nlohmann::json& args, Internal::FunctionCompletion done) {
+            pool->call(args, std::move(done));
+        };
+
+        insert(std::move(entry));
+        GEMINI_INFO("Worker function registered: {}", name);
+    }
+
+    std::optional<nlohmann::json> FunctionRegistry::invoke(const std::string& name, const nlohmann::json& args) const
+    {
+        const auto* function = find(name);
+        if (!function)
+            return std::nullopt;
+        if (!function->needsDispatch())
+            return function->call(args);
+
+        auto promise = std::make_shared<std::promise<nlohmann::json>>();
+        auto future = promise->get_future();
+        invokeAsync(name, args, [promise](nlohmann::json result) { promise->set_value(std::move(result)); });
+        return future.get();
+    }
+
+    void FunctionRegistry::invokeAsync(std::string_view name, const nlohmann::json& args, Internal::FunctionCompletion done) const
+    {
+        auto function = findShared(name);
+        if (!function)
+        {
+            GEMINI_ERROR("Function not found: {}", name);
+            done(Internal::functionError("NOT_FOUND", "Function not found: " + std::string(name)));
+            return;
+        }
+
+        if (function->cache)
+        {
+            std::string key = FunctionResultCache::canonicalKey(args);
+            if (auto cached = function->cache->get(key))
+            {
+                done(std::move(*cached));
+                return;
+            }
+            done = [cache = function->cache, key = std::move(key), done = std::move(done)](nlohmann::json result) {
+                cache->put(key, result);
+                done(std::move(result));
+            };
+        }
+
+        auto completion = std::make_shared<Internal::OnceCompletion>(std::move(done));
+
+        Internal::AsyncWatcher::TimerId deadline = 0;
+        if (const auto timeout = function->options.timeout; timeout.count() > 0)
+        {
+            deadline = Internal::AsyncWatcher::instance().schedule(Internal::AsyncWatcher::Clock::now() + timeout, [function, completion, timeout]() {
+                const auto& fname = function->declaration.name;
+                if (completion->complete(Internal::functionError("DEADLINE_EXCEEDED",
+                        "Function " + fname + " did not finish within " + std::to_string(timeout.count()) + " ms")))
+                {
+                    GEMINI_WARN("Function {} timed out after {} ms", fname, timeout.count());
+                }
+            });
+        }
+
+        auto start = [function, args, completion, deadline]() {
+            // The slot is held until the call really finishes, even if its deadline already fired.
+            auto finish = [function, completion, deadline](nlohmann::json result) {
+                if (completion->complete(std::move(result)) && deadline != 0)
+                    Internal::AsyncWatcher::instance().cancel(deadline);
+                if (function->gate)
+                    function->gate->release();
+            };
+
+            if (completion->done())
+            {
+                // Timed out while waiting for a slot; do not start it at all.
+                if (function->gate)
+                    function->gate->release();
+                return;
+            }
+
+            if (function->isAsync())
+            {
+                function->asyncInvoker(args, std::move(finish));
+            }
+            else
+            {
+                (void)FunctionExecutor::defaultPool().submit([function, args, finish = std::move(finish)]() {
+                    finish(function->invoker(args));
+                });
+            }
+        };
+
+        if (function->gate)
+            function->gate->acquire(std::move(start));
+        else
+            start();
+    }
+
+    std::optional<FunctionCacheStats> FunctionRegistry::cacheStats(std::string_view name) const
+    {
+        const auto* function = find(name);
+        if (!function || !function->cache)
+            return std::nullopt;
+        return function->cache->stats();
+    }
+
+    void FunctionRegistry::clearCaches() const
+    {
+        if (!table_)
+            return;
+        for (const auto& slot : table_->slots)
+        {
+            if (slot.function && slot.function->cache)
+                slot.function->cache->clear();
+        }
+    }
+
+    Tool FunctionRegistry::getTool() const
+    {
+        return table_ ? *table_->tool : Tool{};
+    }
+
+    std::shared_ptr<const Tool> FunctionRegistry::tool() const
+    {
+        static const auto emptyTool = std::make_shared<const Tool>();
+        return table_ ? table_->tool : emptyTool;
+    }
+
+    std::shared_ptr<const std::string> FunctionRegistry::toolJson() const
+    {
+        static const auto emptyJson = std::make_shared<const std::string>(Tool{}.toJson().dump());
+        return table_ ? table_->toolJson : emptyJson;
+    }
+
+    size_t FunctionRegistry::size() const
+    {
+        return table_ ? table_->count : 0;
+    }
+
+    void FunctionRegistry::insert(RegisteredFunction function)
+    {
+        // Collect the current entries (replacing one with the same name), then rebuild the table.
+        std::vector<std::shared_ptr<const RegisteredFunction>> functions;
+        functions.reserve(size() + 1);
+        if (table_)
+        {
+            for (const auto& slot : table_->slots)
+            {
+                if (slot.function && slot.function->declaration.name != function.declaration.name)
+                    functions.push_back(slot.function);
+            }
+        }
+        functions.push_back(std::make_shared<const RegisteredFunction>(std::move(function)));
+
+        // Declarations are sent sorted by name, so the tool JSON does not depend on registration order.
+        std::sort(functions.begin(), functions.end(), [](const auto& a, const auto& b) {
+            return a->declaration.name < b->declaration.name;
+        });
+
+        auto table = std::make_shared<Table>();
+        size_t capacity = 8;
+        while (capacity < functions.size() * 2)
+            capacity *= 2;
+        table->slots.resize(capacity);
+
+        Tool tool;
+        for (const auto& entry : functions)
+        {
+            const size_t hash = hashName(entry->declaration.name);
+            size_t i = hash & (capacity - 1);
+            while (table->slots[i].function)
+                i = (i + 1) & (capacity - 1);
+            table->slots[i] = Slot{hash, entry};
+
+            tool.functionDeclarations.push_back(entry->declaration);
+        }
+        table->count = functions.size();
+        table->toolJson = std::make_shared<const std::string>(tool.toJson().dump());
+        table->tool = std::make_shared<const Tool>(std::move(tool));
+
+        table_ = std::move(table);
+    }
+}
@@ -0,0 +1,255 @@
+﻿#include "gemini/history.h"
+
+#include <algorithm>
+
+#include "gemini/logger.h"
+
+namespace GeminiCPP
+{
+    History::Node::Node(std::shared_ptr<const Node> prev_, std::shared_ptr<const Turn> turn_)
+        : prev(std::move(prev_)), turn(std::move(turn_)),
+          size(prev ? prev->size + 1 : 1), jsonBytes((prev ? prev->jsonBytes : 0) + turn->jsonSize)
+    {
+    }
+
+    History::Node::~Node()
+    {
+        // Unlink the chain iteratively: releasing a long list recursively could overflow the stack.
+        std::shared_ptr<const Node> next = std::move(prev);
+        while (next && next.use_count() == 1)
+        {
+            // Nodes are only ever created non-const (make_shared<Node>), so detaching prev is well defined.
+            std::shared_ptr<const Node> after = std::move(const_cast<Node&>(*next).prev);
+            next = std::move(after);
+        }
+    }
+
+    bool History::Turn::ensureDecoded() const
+    {
+        if (!decode || decoded.load(std::memory_order_acquire))
+            return true;
+
+        std::lock_guard<std::mutex> lock(decodeMutex);
+        if (decoded.load(std::memory_order_relaxed))
+            return true;
+
+        try
+        {
+            const nlohmann::json j = decode();
+            content = Content::fromJson(j);
+            json = j.dump();
+        }
+        catch (const IncompleteTurn& e)
+        {
+            // Served as read (e.g. still referencing its blobs), so a rewrite of the session keeps the
+            // references instead of replacing them with the missing data.
+            GEMINI_ERROR("Cannot fully decode history turn, retrying on next use: {}", e.what());
+            unreadable.store(false, std::memory_order_relaxed);
+            if (!hasFallback.load(std::memory_order_relaxed))
+            {
+                fallbackContent = Content::fromJson(e.turn);
+                fallbackJson = e.turn.dump();
+                hasFallback.store(true, std::memory_order_release);
+            }
+            return false;
+        }
+        catch (const std::exception& e)
+        {
+            // Not cached: storage checks readable() and refuses to write the placeholder over the stored turn.
+            if (!unreadable.exchange(true, std::memory_order_relaxed))
+                GEMINI_ERROR("Cannot decode history turn, it is served empty and not written back: {}", e.what());
+            if (!hasFallback.load(std::memory_order_relaxed))
+            {
+                fallbackJson = fallbackContent.toJson().dump();
+                hasFallback.store(true, std::memory_order_release);
+            }
+            return false;
+        }
+        unreadable.store(false, std::memory_order_relaxed);
+        decoded.store(true, std::memory_order_release);
+        return true;
+    }
+
+    void History::push_back(Content content)
+    {
+        auto turn = std::make_shared<Turn>();
+        turn->json = content.toJson().dump();
+        turn->jsonSize = turn->json.size();
+        turn->content = std::move(content);
+        head_ = std::make_shared<Node>(head_, std::move(turn));
+    }
+
+    void History::push_back_lazy(size_t jsonSize, std::function<nlohmann::json()> decode)
+    {
+        auto turn = std::make_shared<Turn>();
+        turn->jsonSize = jsonSize;
+        turn->decode = std::move(decode);
+        head_ = std::make_shared<Node>(head_, std::move(turn));
+    }
+
+    void History::clear()
+    {
+        head_.reset();
+    }
+
+    size_t History::size() const
+    {
+        return head_ ? head_->size : 0;
+    }
+
+    bool History::empty() const
+    {
+        return !head_;
+    }
+
+    std::shared_ptr<const Content> History::back() const
+    {
+        if (!head_)
+            return nullptr;
+        
+        return {head_->turn, &head_->turn->getContent()};
+    }
+
+    std::vector<std::shared_ptr<const Content>> History::turns() const
+    {
+        std::vector<std::shared_ptr<const Content>> result;
+        result.reserve(size());
+        
+        for (auto node = head_; node; node = node->prev)
+            result.emplace_back(node->turn, &node->turn->getContent());
+        
+        std::reverse(result.begin(), result.end());
+        return result;
+    }
+
+    void History::appendJson(std::string& out) const
+    {
+        if (!head_)
+            return;
+
+        const auto chain = nodes();
+        out.reserve(out.size() + head_->jsonBytes + head_->size);
+        for (size_t i = 0; i < chain.size(); ++i)
+        {
+            if (i > 0)
+                out += ',';
+            out += chain[i]->turn->getJson();
+        }
+    }
+
+    size_t History::jsonBytes() const
+    {
+        return head_ ? head_->jsonBytes : 0;
+    }
+
+    std::vector<size_t> History::turnJsonSizes() const
+    {
+        std::vector<size_t> result;
+        result.reserve(size());
+
+        for (const Node* node : nodes())
+            result.push_back(node->turn->jsonSize);
+
+        return result;
+    }
+
+    History History::select(const std::vector<size_t>& indices) const
+    {
+        const auto chain = nodes();
+
+        History result;
+        for (size_t index : indices)
+        {
+            if (index < chain.size())
+                result.head_ = std::make_shared<Node>(result.head_, chain[index]->turn);
+        }
+        return result;
+    }
+
+    History History::prefix(size_t count) const
+    {
+        History result;
+        result.head_ = head_;
+        while (result.head_ && result.head_->size > count)
+            result.head_ = result.head_->prev;
+        return result;
+    }
+
+    void History::append(const History& other, size_t from)
+    {
+        std::vector<const Node*> added;
+        for (const Node* node = other.head_.get(); node && node->size > from; node = node->prev.get())
+            added.push_back(node);
+
+        for (auto it = added.rbegin(); it != added.rend(); ++it)
+            head_ = std::make_shared<Node>(head_, (*it)->turn);
+    }
+
+    bool History::readable(size_t from) const
+    {
+        for (const Node* node = head_.get(); node && node->size > from; node = node->prev.get())
+        {
+            if (!node->turn->ensureDecoded() && node->turn->unreadable.load(std::memory_order_relaxed))
+                return false;
+        }
+        return true;
+    }
+
+    History::Mark History::mark() const
+    {
+        Mark mark;
+        mark.node_ = head_;
+        mark.size_ = size();
+        return mark;
+    }
+
+    bool History::extends(const Mark& mark) const
+    {
+        if (mark.size_ == 0)
+            return true;
+        if (mark.size_ > size())
+            return false;
+
+        const auto marked = mark.node_.lock();
+        if (!marked)
+            return false;
+
+        const Node* node = head_.get();
+        while (node && node->size > mark.size_)
+            node = node->prev.get();
+        return node == marked.get();
+    }
+
+    std::vector<std::string_view> History::jsonSince(size_t from) const
+    {
+        std::vector<std::string_view> result;
+        for (const Node* node = head_.get(); node && node->size > from; node = node->prev.get())
+            result.emplace_back(node->turn->getJson());
+
+        std::reverse(result.begin(), result.end());
+        return result;
+    }
+
+    std::vector<const History::Node*> History::nodes() const
+    {
+        std::vector<const Node*> result;
+        result.reserve(size());
+
+        for (const Node* node = head_.get(); node; node = node->prev.get())
+            result.push_back(node);
+
+        std::reverse(result.begin(), result.end());
+        return result;
+    }
+
+    std::vector<Content> History::toVector() const
+    {
+        std::vector<Content> result;
+        result.reserve(size());
+        
+        for (const auto& turn : turns())
+            result.push_back(*turn);
+        
+        return result;
+    }
+}
@@ -0,0 +1,108 @@
+﻿#include "gemini/history_compaction.h"
+
+#include <algorithm>
+
+namespace GeminiCPP
+{
+    namespace
+    {
+        bool answersCall(const Content& previous, const Content& current)
+        {
+            const bool hasCall = std::any_of(previous.parts.begin(), previous.parts.end(), [](const Part& part) {
+                return part.isFunctionCall();
+            });
+            const bool hasResponse = std::any_of(current.parts.begin(), current.parts.end(), [](const Part& part) {
+                return part.isFunctionResponse();
+            });
+            return hasCall && hasResponse;
+        }
+    }
+
+    HistorySummary HistorySummary::fromJson(const nlohmann::json& j)
+    {
+        HistorySummary summary;
+        summary.begin = j.value("begin", size_t{0});
+        summary.end = j.value("end", size_t{0});
+        summary.text = j.value("text", "");
+        summary.tokens = j.value("tokens", 0);
+        return summary;
+    }
+
+    nlohmann::json HistorySummary::toJson() const
+    {
+        return {
+            {"begin", begin},
+            {"end", end},
+            {"text", text},
+            {"tokens", tokens}
+        };
+    }
+
+    size_t HistoryCompactor::findCut(const History& history, size_t begin, size_t limit)
+    {
+        const auto turns = history.turns();
+        limit = std::min(limit, turns.size());
+
+        for (size_t cut = limit; cut > begin; --cut)
+        {
+            if (cut == turns.size())
+                continue; // Always leave at least one turn uncompacted.
+            if (turns[cut]->role != Role::USER)
+                continue;
+            if (answersCall(*turns[cut - 1], *turns[cut]))
+                continue;
+            return cut;
+        }
+        return begin;
+    }
+
+    GenerateContentRequestBody HistoryCompactor::buildRequest(const History& history, size_t from, size_t end,
+                                                              const std::string& previousSummary, const CompactionPolicy& policy)
+    {
+        std::string prompt;
+        if (!previousSummary.empty())
+            prompt += "Previous summary:\n" + previousSummary + "\n\n";
+        prompt += "New transcript:\n" + transcript(history, from, end);
+
+        GenerateContentRequestBody request;
+        request.systemInstruction = Content::User().text(policy.instruction);
+        request.contents.push_back(Content::User().text(prompt));
+        return request;
+    }
+
+    std::string HistoryCompactor::transcript(const History& history, size_t from, size_t end)
+    {
+        const auto turns = history.turns();
+        end = std::min(end, turns.size());
+
+        std::string out;
+        for (size_t i = from; i < end; ++i)
+        {
+            const Content& content = *turns[i];
+            const char* speaker = content.role == Role::MODEL ? "Assistant" : (content.role == Role::FUNCTION ? "Tool" : "User");
+
+            for (const auto& part : content.parts)
+            {
+                if (part.thought.value_or(false))
+                    continue;
+
+                out += speaker;
+                out += ": ";
+                if (const auto* text = part.getText())
+                    out += text->text;
+                else if (const auto* call = part.getFunctionCall())
+                    out += "[calls " + call->name + "(" + call->args.dump() + ")]";
+                else if (const auto* response = part.getFunctionResponse())
+                    out += "[" + response->name + " returned " + response->responseContent.dump() + "]";
+                else if (const auto* blob = part.getBlob())
+                    out += "[" + blob->mimeType + " attachment]";
+                else if (const auto* file = part.getFileData())
+                    out += "[file " + file->fileUri + "]";
+                else
+                    out += "[non-text part]";
+                out += '\n';
+            }
+        }
+        return out;
+    }
+}
@@ -0,0 +1,230 @@
+﻿#include "gemini/internal/async_utils.h"
+
+#include <algorithm>
+#include <future>
+#include <optional>
+
+#include "gemini/function_executor.h"
+#include "gemini/function_registry.h"
+#include "gemini/thread_pool.h"
+
+namespace GeminiCPP::Internal
+{
+    nlohmann::json functionError(std::string_view status, std::string_view message)
+    {
+        return {
+            {"error", {
+                {"status", std::string(status)},
+                {"message", std::string(message)}
+            }}
+        };
+    }
+
+    nlohmann::json functionErrorFromException(std::exception_ptr error)
+    {
+        try
+        {
+            std::rethrow_exception(error);
+        }
+        catch (const FunctionCancelled& e)
+        {
+            return functionError("CANCELLED", e.what());
+        }
+        catch (const std::future_error& e)
+        {
+            // e.g. broken_promise: the producer went away without delivering a result
+            return functionError("CANCELLED", e.what());
+        }
+        catch (const std::exception& e)
+        {
+            return functionError("INTERNAL", e.what());
+        }
+        catch (...)
+        {
+            return functionError("INTERNAL", "Unknown exception");
+        }
+    }
+
+    void ConcurrencyGate::acquire(std::function<void()> start)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (active_ >= limit_)
+            {
+                waiting_.push_back(std::move(start));
+                return;
+            }
+            ++active_;
+        }
+        start();
+    }
+
+    void ConcurrencyGate::release()
+    {
+        std::function<void()> next;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (waiting_.empty())
+            {
+                --active_;
+                return;
+            }
+            // The slot passes directly to the next waiter.
+            next = std::move(waiting_.front());
+            waiting_.pop_front();
+        }
+        (void)FunctionExecutor::defaultPool().submit(std::move(next));
+    }
+
+    size_t ConcurrencyGate::active() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return active_;
+    }
+
+    size_t ConcurrencyGate::waiting() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return waiting_.size();
+    }
+
+    AsyncWatcher& AsyncWatcher::instance()
+    {
+        static AsyncWatcher watcher;
+        return watcher;
+    }
+
+    AsyncWatcher::AsyncWatcher()
+        : thread_([this]() { run(); })
+    {
+    }
+
+    AsyncWatcher::~AsyncWatcher()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        if (thread_.joinable())
+            thread_.join();
+    }
+
+    void AsyncWatcher::watch(std::function<bool()> poll)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            polls_.push_back(std::move(poll));
+        }
+        cv_.notify_one();
+    }
+
+    AsyncWatcher::TimerId AsyncWatcher::schedule(Clock::time_point when, std::function<void()> fn)
+    {
+        TimerId id;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            id = ++lastTimer_;
+            timerCallbacks_.emplace(id, std::move(fn));
+            timers_.push_back(Timer{when, id});
+            std::push_heap(timers_.begin(), timers_.end(), std::greater<>{});
+        }
+        cv_.notify_one();
+        return id;
+    }
+
+    bool AsyncWatcher::cancel(TimerId id)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (timerCallbacks_.erase(id) == 0)
+            return false;
+
+        // Deadlines are mostly cancelled long before they are due; rebuild the heap before they pile up.
+        if (timers_.size() > 2 * timerCallbacks_.size() + 64)
+        {
+            std::erase_if(timers_, [this](const Timer& timer) { return !timerCallbacks_.contains(timer.id); });
+            std::make_heap(timers_.begin(), timers_.end(), std::greater<>{});
+        }
+        else
+        {
+            popCancelledTimers();
+        }
+        return true;
+    }
+
+    void AsyncWatcher::popCancelledTimers()
+    {
+        while (!timers_.empty() && !timerCallbacks_.contains(timers_.front().id))
+        {
+            std::pop_heap(timers_.begin(), timers_.end(), std::greater<>{});
+            timers_.pop_back();
+        }
+    }
+
+    void AsyncWatcher::run()
+    {
+        // Futures have no completion callback, so they are polled; the interval backs off while nothing completes.
+        constexpr auto minInterval = std::chrono::microseconds(200);
+        constexpr auto maxInterval = std::chrono::milliseconds(10);
+        std::chrono::microseconds interval = minInterval;
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stopping_)
+        {
+            std::vector<std::function<bool()>> polls;
+            polls.swap(polls_);
+
+            std::vector<std::function<void()>> due;
+            const auto now = Clock::now();
+            while (!timers_.empty() && timers_.front().when <= now)
+            {
+                const TimerId id = timers_.front().id;
+                std::pop_heap(timers_.begin(), timers_.end(), std::greater<>{});
+                timers_.pop_back();
+                if (auto node = timerCallbacks_.extract(id))
+                    due.push_back(std::move(node.mapped()));
+            }
+
+            // Callbacks run without the lock; they may watch()/schedule() again.
+            lock.unlock();
+            for (auto& fn : due)
+                fn();
+
+            bool progressed = !due.empty();
+            std::vector<std::function<bool()>> pending;
+            for (auto& poll : polls)
+            {
+                if (poll())
+                    progressed = true;
+                else
+                    pending.push_back(std::move(poll));
+            }
+            lock.lock();
+
+            polls_.insert(polls_.end(), std::make_move_iterator(pending.begin()), std::make_move_iterator(pending.end()));
+            interval = progressed ? minInterval : std::min<std::chrono::microseconds>(interval * 2, maxInterval);
+
+            // Recomputed under the lock: timers may have been added or cancelled while the callbacks ran.
+            popCancelledTimers();
+            std::optional<Clock::time_point> nextTimer;
+            if (!timers_.empty())
+                nextTimer = timers_.front().when;
+
+            if (!polls_.empty())
+            {
+                auto wakeUp = Clock::now() + interval;
+                if (nextTimer && *nextTimer < wakeUp)
+                    wakeUp = *nextTimer;
+                cv_.wait_until(lock, wakeUp);
+            }
+            else if (nextTimer)
+            {
+                cv_.wait_until(lock, *nextTimer);
+            }
+            else
+            {
+                cv_.wait(lock, [this]() { return stopping_ || !polls_.empty() || !timers_.empty(); });
+            }
+        }
+    }
+}
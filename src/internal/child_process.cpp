@@ -0,0 +1,324 @@
+﻿#include "gemini/internal/child_process.h"
+
+#include <algorithm>
+#include <thread>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+#endif
+
+#include "gemini/logger.h"
+
+namespace GeminiCPP::Internal
+{
+    namespace
+    {
+#ifdef _WIN32
+        // Quotes one argument following the rules of CommandLineToArgvW.
+        std::string quoteArgument(const std::string& arg)
+        {
+            if (!arg.empty() && arg.find_first_of(" \t\n\v\"") == std::string::npos)
+                return arg;
+
+            std::string quoted = "\"";
+            size_t backslashes = 0;
+            for (char c : arg)
+            {
+                if (c == '\\')
+                {
+                    ++backslashes;
+                    continue;
+                }
+                if (c == '"')
+                    backslashes = backslashes * 2 + 1;
+                quoted.append(backslashes, '\\');
+                backslashes = 0;
+                quoted += c;
+            }
+            quoted.append(backslashes * 2, '\\');
+            quoted += '"';
+            return quoted;
+        }
+#else
+        // Creates a pipe whose ends are both close-on-exec from the start, so neither leaks into a child
+        // spawned concurrently by another thread.
+        bool openPipe(int fds[2])
+        {
+#ifdef __APPLE__
+            // No pipe2(): the window between pipe() and fcntl() remains.
+            if (::pipe(fds) != 0)
+                return false;
+            ::fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+            ::fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+            return true;
+#else
+            return ::pipe2(fds, O_CLOEXEC) == 0;
+#endif
+        }
+#endif
+    }
+
+    std::unique_ptr<ChildProcess> ChildProcess::spawn(const std::vector<std::string>& command)
+    {
+        if (command.empty())
+            return nullptr;
+
+        std::unique_ptr<ChildProcess> child(new ChildProcess());
+
+#ifdef _WIN32
+        SECURITY_ATTRIBUTES attributes{sizeof(SECURITY_ATTRIBUTES), nullptr, TRUE};
+        HANDLE childIn = nullptr, parentIn = nullptr, parentOut = nullptr, childOut = nullptr;
+        if (!::CreatePipe(&childIn, &parentIn, &attributes, 0))
+            return nullptr;
+        if (!::CreatePipe(&parentOut, &childOut, &attributes, 0))
+        {
+            ::CloseHandle(childIn);
+            ::CloseHandle(parentIn);
+            return nullptr;
+        }
+        // Only the child's ends are inherited.
+        ::SetHandleInformation(parentIn, HANDLE_FLAG_INHERIT, 0);
+        ::SetHandleInformation(parentOut, HANDLE_FLAG_INHERIT, 0);
+
+        std::string commandLine;
+        for (const auto& arg : command)
+        {
+            if (!commandLine.empty())
+                commandLine += ' ';
+            commandLine += quoteArgument(arg);
+        }
+
+        STARTUPINFOA startup{};
+        startup.cb = sizeof(startup);
+        startup.dwFlags = STARTF_USESTDHANDLES;
+        startup.hStdInput = childIn;
+        startup.hStdOutput = childOut;
+        startup.hStdError = ::GetStdHandle(STD_ERROR_HANDLE);
+
+        PROCESS_INFORMATION info{};
+        const BOOL created = ::CreateProcessA(nullptr, commandLine.data(), nullptr, nullptr, TRUE,
+                                              CREATE_NO_WINDOW, nullptr, nullptr, &startup, &info);
+        ::CloseHandle(childIn);
+        ::CloseHandle(childOut);
+        if (!created)
+        {
+            GEMINI_ERROR("Cannot start process: {}", commandLine);
+            ::CloseHandle(parentIn);
+            ::CloseHandle(parentOut);
+            return nullptr;
+        }
+        ::CloseHandle(info.hThread);
+
+        child->process_ = reinterpret_cast<intptr_t>(info.hProcess);
+        child->stdin_ = reinterpret_cast<intptr_t>(parentIn);
+        child->stdout_ = reinterpret_cast<intptr_t>(parentOut);
+#else
+        // All four ends are close-on-exec; dup2 in the spawned child clears the flag on its stdin/stdout copies.
+        int inPipe[2], outPipe[2];
+        if (!openPipe(inPipe))
+            return nullptr;
+        if (!openPipe(outPipe))
+        {
+            ::close(inPipe[0]);
+            ::close(inPipe[1]);
+            return nullptr;
+        }
+
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, inPipe[0], STDIN_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, outPipe[1], STDOUT_FILENO);
+        posix_spawn_file_actions_addclose(&actions, inPipe[0]);
+        posix_spawn_file_actions_addclose(&actions, outPipe[1]);
+
+        std::vector<char*> argv;
+        argv.reserve(command.size() + 1);
+        for (const auto& arg : command)
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        argv.push_back(nullptr);
+
+        pid_t pid = -1;
+        const int error = ::posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+        posix_spawn_file_actions_destroy(&actions);
+        ::close(inPipe[0]);
+        ::close(outPipe[1]);
+        if (error != 0)
+        {
+            GEMINI_ERROR("Cannot start process {}: error {}", command[0], error);
+            ::close(inPipe[1]);
+            ::close(outPipe[0]);
+            return nullptr;
+        }
+
+        child->process_ = pid;
+        child->stdin_ = inPipe[1];
+        child->stdout_ = outPipe[0];
+#endif
+        return child;
+    }
+
+    ChildProcess::~ChildProcess()
+    {
+        terminate();
+#ifdef _WIN32
+        if (stdin_ != -1)
+            ::CloseHandle(reinterpret_cast<HANDLE>(stdin_));
+        if (stdout_ != -1)
+            ::CloseHandle(reinterpret_cast<HANDLE>(stdout_));
+        if (process_ != -1)
+            ::CloseHandle(reinterpret_cast<HANDLE>(process_));
+#else
+        if (stdin_ != -1)
+            ::close(static_cast<int>(stdin_));
+        if (stdout_ != -1)
+            ::close(static_cast<int>(stdout_));
+#endif
+    }
+
+    bool ChildProcess::writeLine(std::string_view line)
+    {
+        std::string data(line);
+        data += '\n';
+
+#ifdef _WIN32
+        const HANDLE pipe = reinterpret_cast<HANDLE>(stdin_);
+        size_t written = 0;
+        while (written < data.size())
+        {
+            DWORD chunk = 0;
+            if (!::WriteFile(pipe, data.data() + written, static_cast<DWORD>(data.size() - written), &chunk, nullptr))
+                return false;
+            written += chunk;
+        }
+        return true;
+#else
+        // A child that exited would raise SIGPIPE; block it for this thread and consume it if it was raised.
+        sigset_t pipeSignal, previous;
+        sigemptyset(&pipeSignal);
+        sigaddset(&pipeSignal, SIGPIPE);
+        ::pthread_sigmask(SIG_BLOCK, &pipeSignal, &previous);
+
+        bool ok = true;
+        size_t written = 0;
+        while (written < data.size())
+        {
+            const ssize_t chunk = ::write(static_cast<int>(stdin_), data.data() + written, data.size() - written);
+            if (chunk < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                ok = false;
+                break;
+            }
+            written += static_cast<size_t>(chunk);
+        }
+
+        if (!ok && errno == EPIPE)
+        {
+            sigset_t pending;
+            sigpending(&pending);
+            if (sigismember(&pending, SIGPIPE))
+            {
+                int signal;
+                sigwait(&pipeSignal, &signal);
+            }
+        }
+        ::pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+        return ok;
+#endif
+    }
+
+    ChildProcess::ReadStatus ChildProcess::readLine(std::string& line, Clock::time_point deadline)
+    {
+        while (true)
+        {
+            if (const size_t newline = buffer_.find('\n'); newline != std::string::npos)
+            {
+                line.assign(buffer_, 0, newline);
+                if (!line.empty() && line.back() == '\r')
+                    line.pop_back();
+                buffer_.erase(0, newline + 1);
+                return ReadStatus::Line;
+            }
+
+            char chunk[4096];
+#ifdef _WIN32
+            // Anonymous pipes do not support overlapped I/O, so wait by peeking.
+            const HANDLE pipe = reinterpret_cast<HANDLE>(stdout_);
+            DWORD available = 0;
+            if (!::PeekNamedPipe(pipe, nullptr, 0, nullptr, &available, nullptr))
+                return ReadStatus::Closed;
+            if (available == 0)
+            {
+                if (Clock::now() >= deadline)
+                    return ReadStatus::Timeout;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+
+            DWORD count = 0;
+            if (!::ReadFile(pipe, chunk, std::min<DWORD>(available, sizeof(chunk)), &count, nullptr) || count == 0)
+                return ReadStatus::Closed;
+            buffer_.append(chunk, count);
+#else
+            const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+            if (remaining <= 0)
+                return ReadStatus::Timeout;
+
+            pollfd descriptor{static_cast<int>(stdout_), POLLIN, 0};
+            const int ready = ::poll(&descriptor, 1, static_cast<int>(std::min<long long>(remaining, 60000)));
+            if (ready < 0 && errno != EINTR)
+                return ReadStatus::Closed;
+            if (ready <= 0)
+                continue;
+
+            const ssize_t count = ::read(static_cast<int>(stdout_), chunk, sizeof(chunk));
+            if (count < 0 && errno == EINTR)
+                continue;
+            if (count <= 0)
+                return ReadStatus::Closed;
+            buffer_.append(chunk, static_cast<size_t>(count));
+#endif
+        }
+    }
+
+    bool ChildProcess::running()
+    {
+        if (exited_ || process_ == -1)
+            return false;
+#ifdef _WIN32
+        exited_ = ::WaitForSingleObject(reinterpret_cast<HANDLE>(process_), 0) != WAIT_TIMEOUT;
+#else
+        int status = 0;
+        exited_ = ::waitpid(static_cast<pid_t>(process_), &status, WNOHANG) != 0;
+#endif
+        return !exited_;
+    }
+
+    void ChildProcess::terminate()
+    {
+        if (!running())
+            return;
+#ifdef _WIN32
+        const HANDLE process = reinterpret_cast<HANDLE>(process_);
+        ::TerminateProcess(process, 1);
+        ::WaitForSingleObject(process, INFINITE);
+#else
+        ::kill(static_cast<pid_t>(process_), SIGKILL);
+        int status = 0;
+        ::waitpid(static_cast<pid_t>(process_), &status, 0);
+#endif
+        exited_ = true;
+    }
+}
@@ -0,0 +1,201 @@
+﻿#include "gemini/internal/file_utils.h"
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+#include "gemini/logger.h"
+
+namespace GeminiCPP::Internal
+{
+    namespace
+    {
+        bool syncStream(std::FILE* file)
+        {
+            if (std::fflush(file) != 0)
+                return false;
+#ifdef _WIN32
+            return _commit(_fileno(file)) == 0;
+#else
+            return ::fsync(fileno(file)) == 0;
+#endif
+        }
+
+        std::filesystem::path tempPathFor(const std::filesystem::path& path)
+        {
+            static std::atomic<uint64_t> counter{0};
+#ifdef _WIN32
+            const auto pid = static_cast<uint64_t>(::GetCurrentProcessId());
+#else
+            const auto pid = static_cast<uint64_t>(::getpid());
+#endif
+            std::filesystem::path tmp = path;
+            tmp += ".tmp." + std::to_string(pid) + "." + std::to_string(counter.fetch_add(1));
+            return tmp;
+        }
+    }
+
+    bool writeFileAtomic(const std::filesystem::path& path, std::string_view data, bool durable)
+    {
+        const std::filesystem::path tmp = tempPathFor(path);
+
+        std::FILE* file = std::fopen(tmp.string().c_str(), "wb");
+        if (!file)
+        {
+            GEMINI_ERROR("Atomic write failed, cannot open {}", tmp.string());
+            return false;
+        }
+
+        bool ok = std::fwrite(data.data(), 1, data.size(), file) == data.size();
+        if (ok && durable)
+            ok = syncStream(file);
+        ok = (std::fclose(file) == 0) && ok;
+
+        std::error_code ec;
+        if (ok)
+        {
+            std::filesystem::rename(tmp, path, ec);
+            ok = !ec;
+        }
+
+        if (!ok)
+        {
+            GEMINI_ERROR("Atomic write of {} failed{}", path.string(), ec ? ": " + ec.message() : "");
+            std::filesystem::remove(tmp, ec);
+            return false;
+        }
+
+        if (durable)
+            syncDirectory(path.has_parent_path() ? path.parent_path() : std::filesystem::path("."));
+        
+        return true;
+    }
+
+    bool appendFile(const std::filesystem::path& path, std::string_view data, bool durable)
+    {
+        std::FILE* file = std::fopen(path.string().c_str(), "ab");
+        if (!file)
+        {
+            GEMINI_ERROR("Append failed, cannot open {}", path.string());
+            return false;
+        }
+
+        bool ok = std::fwrite(data.data(), 1, data.size(), file) == data.size();
+        if (ok && durable)
+            ok = syncStream(file);
+        ok = (std::fclose(file) == 0) && ok;
+
+        if (!ok)
+            GEMINI_ERROR("Append failed: {}", path.string());
+        return ok;
+    }
+
+    bool syncFile(const std::filesystem::path& path)
+    {
+        std::FILE* file = std::fopen(path.string().c_str(), "ab");
+        if (!file)
+        {
+            GEMINI_ERROR("Sync failed, cannot open {}", path.string());
+            return false;
+        }
+
+        const bool ok = syncStream(file);
+        return (std::fclose(file) == 0) && ok;
+    }
+
+    std::optional<std::string> readFile(const std::filesystem::path& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open())
+            return std::nullopt;
+
+        return std::string(std::istreambuf_iterator<char>(file), {});
+    }
+
+    std::optional<std::string> readFileRange(const std::filesystem::path& path, uint64_t offset, size_t length)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open())
+            return std::nullopt;
+
+        std::string data(length, '\0');
+        file.seekg(static_cast<std::streamoff>(offset));
+        if (!file.read(data.data(), static_cast<std::streamsize>(length)))
+            return std::nullopt;
+        return data;
+    }
+
+    bool syncDirectory(const std::filesystem::path& dir)
+    {
+#ifdef _WIN32
+        (void)dir;
+        return true;
+#else
+        int fd = ::open(dir.string().c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        
+        bool ok = ::fsync(fd) == 0;
+        ::close(fd);
+        return ok;
+#endif
+    }
+
+    FileLock::FileLock(const std::filesystem::path& lockPath)
+    {
+#ifdef _WIN32
+        HANDLE h = ::CreateFileW(lockPath.wstring().c_str(), GENERIC_READ | GENERIC_WRITE,
+            FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (h == INVALID_HANDLE_VALUE)
+        {
+            GEMINI_ERROR("Cannot open lock file: {}", lockPath.string());
+            return;
+        }
+        
+        OVERLAPPED overlapped{};
+        locked_ = ::LockFileEx(h, LOCKFILE_EXCLUSIVE_LOCK, 0, MAXDWORD, MAXDWORD, &overlapped) != 0;
+        handle_ = reinterpret_cast<intptr_t>(h);
+#else
+        int fd = ::open(lockPath.string().c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0)
+        {
+            GEMINI_ERROR("Cannot open lock file: {}", lockPath.string());
+            return;
+        }
+        
+        locked_ = ::flock(fd, LOCK_EX) == 0;
+        handle_ = fd;
+#endif
+        if (!locked_)
+            GEMINI_WARN("Failed to acquire lock: {}", lockPath.string());
+    }
+
+    FileLock::~FileLock()
+    {
+        if (handle_ == -1)
+            return;
+#ifdef _WIN32
+        HANDLE h = reinterpret_cast<HANDLE>(handle_);
+        if (locked_)
+        {
+            OVERLAPPED overlapped{};
+            ::UnlockFileEx(h, 0, MAXDWORD, MAXDWORD, &overlapped);
+        }
+        ::CloseHandle(h);
+#else
+        if (locked_)
+            ::flock(static_cast<int>(handle_), LOCK_UN);
+        ::close(static_cast<int>(handle_));
+#endif
+    }
+}
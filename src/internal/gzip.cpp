@@ -0,0 +1,36 @@
+﻿#include "gemini/internal/gzip.h"
+
+#ifdef GEMINI_HAS_ZLIB
+#include <zlib.h>
+#endif
+
+namespace GeminiCPP::Internal
+{
+    std::optional<std::string> gzipCompress(std::string_view data)
+    {
+#ifdef GEMINI_HAS_ZLIB
+        z_stream stream{};
+        // 15 window bits + 16 selects the gzip wrapper instead of zlib's.
+        if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            return std::nullopt;
+
+        std::string out(deflateBound(&stream, static_cast<uLong>(data.size())) + 32, '\0');
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+        stream.avail_in = static_cast<uInt>(data.size());
+        stream.next_out = reinterpret_cast<Bytef*>(out.data());
+        stream.avail_out = static_cast<uInt>(out.size());
+
+        const int status = deflate(&stream, Z_FINISH);
+        const size_t size = stream.total_out;
+        deflateEnd(&stream);
+        if (status != Z_STREAM_END)
+            return std::nullopt;
+
+        out.resize(size);
+        return out;
+#else
+        (void)data;
+        return std::nullopt;
+#endif
+    }
+}
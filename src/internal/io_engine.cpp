@@ -0,0 +1,411 @@
+﻿#include "gemini/internal/io_engine.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+#include "gemini/internal/file_utils.h"
+#include "gemini/logger.h"
+
+#if defined(GEMINI_USE_IO_URING) && defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define GEMINI_IO_URING 1
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace GeminiCPP::Internal
+{
+    namespace
+    {
+        std::vector<bool> appendBatchStdio(const std::vector<FileAppend>& appends, bool sync)
+        {
+            std::vector<bool> results;
+            results.reserve(appends.size());
+            for (const auto& append : appends)
+            {
+                bool ok = append.data.empty() || appendFile(append.path, append.data, false);
+                if (ok && sync)
+                    ok = syncFile(append.path);
+                results.push_back(ok);
+            }
+            return results;
+        }
+    }
+
+#ifdef GEMINI_IO_URING
+    /**
+     * @brief Minimal io_uring over the raw system calls (no liburing dependency).
+     * * Batches are submitted in chunks of at most the ring size, and every chunk is fully reaped before the
+     * next one, so the completion queue (twice the ring size) can never overflow.
+     */
+    struct IoEngine::Ring
+    {
+        static constexpr unsigned ENTRIES = 256;
+
+        /**
+         * @brief Outcome of run().
+         */
+        enum class Status
+        {
+            Completed,    ///< Every operation completed; results are valid.
+            NotSubmitted, ///< Nothing reached the kernel; the caller can redo the operations another way.
+            Interrupted   ///< Some operations may have run; the ones without a result are -ECANCELED.
+        };
+
+        int fd = -1;
+        unsigned entries = 0;
+        std::atomic<bool> broken{false}; ///< The ring failed; it is no longer used.
+
+        void* sqRing = MAP_FAILED;
+        size_t sqRingSize = 0;
+        void* cqRing = MAP_FAILED;
+        size_t cqRingSize = 0;
+        io_uring_sqe* sqes = nullptr;
+        size_t sqesSize = 0;
+
+        unsigned* sqTail = nullptr;
+        unsigned* sqMask = nullptr;
+        unsigned* sqArray = nullptr;
+        unsigned* cqHead = nullptr;
+        unsigned* cqTail = nullptr;
+        unsigned* cqMask = nullptr;
+        io_uring_cqe* cqes = nullptr;
+
+        std::mutex mutex; ///< One batch at a time.
+
+        static std::unique_ptr<Ring> create()
+        {
+            auto ring = std::make_unique<Ring>();
+            io_uring_params params{};
+            ring->fd = static_cast<int>(::syscall(__NR_io_uring_setup, ENTRIES, &params));
+            if (ring->fd < 0)
+            {
+                GEMINI_DEBUG("io_uring unavailable ({}), using blocking file I/O", std::strerror(errno));
+                return nullptr;
+            }
+
+            // Appends rely on writes at the current file position (offset -1), available since Linux 5.6.
+            if (!(params.features & IORING_FEAT_RW_CUR_POS))
+            {
+                GEMINI_DEBUG("io_uring too old, using blocking file I/O");
+                return nullptr;
+            }
+
+            ring->entries = params.sq_entries;
+            ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            const bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+            if (singleMmap)
+                ring->sqRingSize = ring->cqRingSize = std::max(ring->sqRingSize, ring->cqRingSize);
+
+            ring->sqRing = ::mmap(nullptr, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+            if (ring->sqRing == MAP_FAILED)
+                return nullptr;
+            if (singleMmap)
+            {
+                ring->cqRing = ring->sqRing;
+            }
+            else
+            {
+                ring->cqRing = ::mmap(nullptr, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+                if (ring->cqRing == MAP_FAILED)
+                    return nullptr;
+            }
+
+            ring->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+            void* sqes = ::mmap(nullptr, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+            if (sqes == MAP_FAILED)
+                return nullptr;
+            ring->sqes = static_cast<io_uring_sqe*>(sqes);
+
+            auto* sq = static_cast<char*>(ring->sqRing);
+            auto* cq = static_cast<char*>(ring->cqRing);
+            ring->sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+            ring->sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+            ring->sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+            ring->cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+            ring->cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+            ring->cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+            ring->cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+            return ring;
+        }
+
+        ~Ring()
+        {
+            if (sqes)
+                ::munmap(sqes, sqesSize);
+            if (cqRing != MAP_FAILED && cqRing != sqRing)
+                ::munmap(cqRing, cqRingSize);
+            if (sqRing != MAP_FAILED)
+                ::munmap(sqRing, sqRingSize);
+            if (fd >= 0)
+                ::close(fd);
+        }
+
+        int enter(unsigned toSubmit, unsigned minComplete, unsigned flags) const
+        {
+            return static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+        }
+
+        // Copies the completions the kernel has posted into results. Expects mutex to be held.
+        unsigned reapAvailable(std::vector<int>& results)
+        {
+            unsigned head = *cqHead;
+            const unsigned available = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+            unsigned reaped = 0;
+            for (; head != available; ++head, ++reaped)
+            {
+                const io_uring_cqe& cqe = cqes[head & *cqMask];
+                if (cqe.user_data < results.size())
+                    results[cqe.user_data] = cqe.res;
+            }
+            __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+            return reaped;
+        }
+
+        /**
+         * @brief Submits the operations and waits for all of them.
+         * @param results Receives each operation's result (bytes transferred or -errno).
+         * @details Operations that were submitted are never left running on return while they can still be
+         * observed completing: after a failed wait, completions are polled from the ring memory for a while.
+         */
+        Status run(const std::vector<io_uring_sqe>& ops, std::vector<int>& results)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            results.assign(ops.size(), -ECANCELED);
+            if (broken)
+                return Status::NotSubmitted;
+
+            for (size_t first = 0; first < ops.size(); first += entries)
+            {
+                const auto count = static_cast<unsigned>(std::min<size_t>(entries, ops.size() - first));
+
+                // Single producer (under mutex), so the tail can be read plainly; the kernel reads it with acquire.
+                unsigned tail = *sqTail;
+                for (unsigned i = 0; i < count; ++i)
+                {
+                    const unsigned index = tail & *sqMask;
+                    sqes[index] = ops[first + i];
+                    sqes[index].user_data = first + i;
+                    sqArray[index] = index;
+                    ++tail;
+                }
+                __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+
+                unsigned pending = count;
+                while (pending > 0)
+                {
+                    const int submitted = enter(pending, 0, 0);
+                    if (submitted < 0)
+                    {
+                        if (errno == EINTR || errno == EAGAIN)
+                            continue;
+                        GEMINI_ERROR("io_uring submission failed ({}), falling back to blocking file I/O", std::strerror(errno));
+                        broken = true;
+                        if (first == 0 && pending == count)
+                            return Status::NotSubmitted;
+                        awaitSubmitted(count - pending, results);
+                        return Status::Interrupted;
+                    }
+                    pending -= static_cast<unsigned>(submitted);
+                }
+
+                unsigned reaped = 0;
+                while (reaped < count)
+                {
+                    const unsigned got = reapAvailable(results);
+                    reaped += got;
+                    if (got > 0 || reaped == count)
+                        continue;
+
+                    if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+                    {
+                        GEMINI_ERROR("io_uring wait failed ({}), falling back to blocking file I/O", std::strerror(errno));
+                        broken = true;
+                        awaitSubmitted(count - reaped, results);
+                        return Status::Interrupted;
+                    }
+                }
+            }
+            return Status::Completed;
+        }
+
+        // The kernel still posts completions without io_uring_enter(): poll for the outstanding ones, so
+        // their buffers and fds are not released under them. Expects mutex to be held.
+        void awaitSubmitted(unsigned outstanding, std::vector<int>& results)
+        {
+            const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+            while (outstanding > 0)
+            {
+                const unsigned got = reapAvailable(results);
+                outstanding -= std::min(got, outstanding);
+                if (outstanding == 0)
+                    break;
+                if (std::chrono::steady_clock::now() > deadline)
+                {
+                    GEMINI_ERROR("{} io_uring operations did not complete", outstanding);
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    };
+
+    namespace
+    {
+        io_uring_sqe makeSqe(uint8_t opcode, int fd, const void* buffer, size_t length, uint64_t offset)
+        {
+            io_uring_sqe sqe{};
+            sqe.opcode = opcode;
+            sqe.fd = fd;
+            sqe.addr = reinterpret_cast<uint64_t>(buffer);
+            sqe.len = static_cast<uint32_t>(length);
+            sqe.off = offset;
+            return sqe;
+        }
+
+        // Finishes a short write synchronously.
+        bool writeRemainder(int fd, const char* data, size_t length)
+        {
+            while (length > 0)
+            {
+                const ssize_t written = ::write(fd, data, length);
+                if (written < 0 && errno == EINTR)
+                    continue;
+                if (written <= 0)
+                    return false;
+                data += written;
+                length -= static_cast<size_t>(written);
+            }
+            return true;
+        }
+    }
+#else
+    struct IoEngine::Ring
+    {
+    };
+#endif
+
+    IoEngine& IoEngine::instance()
+    {
+        static IoEngine engine;
+        return engine;
+    }
+
+    IoEngine::IoEngine()
+    {
+#ifdef GEMINI_IO_URING
+        ring_ = Ring::create();
+        if (ring_)
+            GEMINI_DEBUG("File I/O uses io_uring");
+#endif
+    }
+
+    IoEngine::~IoEngine() = default;
+
+    bool IoEngine::usesIoUring() const
+    {
+#ifdef GEMINI_IO_URING
+        return ring_ != nullptr && !ring_->broken;
+#else
+        return false;
+#endif
+    }
+
+    std::vector<bool> IoEngine::appendBatch(const std::vector<FileAppend>& appends, bool sync)
+    {
+#ifdef GEMINI_IO_URING
+        if (usesIoUring() && !appends.empty())
+        {
+            std::vector<int> fds(appends.size(), -1);
+            std::vector<bool> results(appends.size(), false);
+            auto closeAll = [&fds]() {
+                for (const int fd : fds)
+                {
+                    if (fd >= 0)
+                        ::close(fd);
+                }
+            };
+
+            // Phase 1: every write at once. Phase 2: every fsync at once, after all writes completed.
+            std::vector<io_uring_sqe> writes;
+            std::vector<size_t> writeOwners;
+            for (size_t i = 0; i < appends.size(); ++i)
+            {
+                fds[i] = ::open(appends[i].path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+                if (fds[i] < 0)
+                {
+                    GEMINI_ERROR("Append failed, cannot open {}", appends[i].path.string());
+                    continue;
+                }
+                results[i] = true;
+                if (!appends[i].data.empty())
+                {
+                    writes.push_back(makeSqe(IORING_OP_WRITE, fds[i], appends[i].data.data(), appends[i].data.size(), static_cast<uint64_t>(-1)));
+                    writeOwners.push_back(i);
+                }
+            }
+
+            std::vector<int> completions;
+            const Ring::Status status = ring_->run(writes, completions);
+            if (status == Ring::Status::NotSubmitted)
+            {
+                closeAll();
+                return appendBatchStdio(appends, sync);
+            }
+            // Interrupted: writes without a result may or may not have happened. They fail below (-ECANCELED)
+            // and are never written again, so a journal record cannot end up appended twice.
+
+            std::vector<io_uring_sqe> syncs;
+            std::vector<size_t> syncOwners;
+            for (size_t w = 0; w < writes.size(); ++w)
+            {
+                const size_t i = writeOwners[w];
+                const int res = completions[w];
+                const auto& data = appends[i].data;
+                if (res < 0 || (static_cast<size_t>(res) < data.size() && !writeRemainder(fds[i], data.data() + res, data.size() - static_cast<size_t>(res))))
+                {
+                    GEMINI_ERROR("Append failed: {}", appends[i].path.string());
+                    results[i] = false;
+                }
+            }
+
+            if (sync)
+            {
+                for (size_t i = 0; i < appends.size(); ++i)
+                {
+                    if (results[i])
+                    {
+                        syncs.push_back(makeSqe(IORING_OP_FSYNC, fds[i], nullptr, 0, 0));
+                        syncOwners.push_back(i);
+                    }
+                }
+
+                if (ring_->run(syncs, completions) != Ring::Status::Completed)
+                {
+                    for (const size_t i : syncOwners)
+                        results[i] = ::fsync(fds[i]) == 0;
+                }
+                else
+                {
+                    for (size_t s = 0; s < syncs.size(); ++s)
+                        results[syncOwners[s]] = completions[s] == 0;
+                }
+            }
+
+            closeAll();
+            return results;
+        }
+#endif
+        return appendBatchStdio(appends, sync);
+    }
+}
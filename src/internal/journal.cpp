@@ -0,0 +1,89 @@
+﻿#include "gemini/internal/journal.h"
+
+#include <array>
+#include <charconv>
+
+#include "gemini/internal/file_utils.h"
+
+namespace GeminiCPP::Internal
+{
+    namespace
+    {
+        constexpr size_t CHECKSUM_DIGITS = 8;
+
+        std::array<uint32_t, 256> makeCrcTable()
+        {
+            std::array<uint32_t, 256> table{};
+            for (uint32_t i = 0; i < 256; ++i)
+            {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k)
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                table[i] = c;
+            }
+            return table;
+        }
+    }
+
+    uint32_t crc32(std::string_view data, uint32_t crc)
+    {
+        static const auto table = makeCrcTable();
+
+        crc = ~crc;
+        for (unsigned char byte : data)
+            crc = table[(crc ^ byte) & 0xFFu] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    std::string encodeJournalRecord(std::string_view payload)
+    {
+        static constexpr char digits[] = "0123456789abcdef";
+        const uint32_t crc = crc32(payload);
+
+        std::string record(CHECKSUM_DIGITS + 1, ' ');
+        for (size_t i = 0; i < CHECKSUM_DIGITS; ++i)
+            record[i] = digits[(crc >> (28 - 4 * i)) & 0xFu];
+        record.reserve(record.size() + payload.size() + 1);
+        record += payload;
+        record += '\n';
+        return record;
+    }
+
+    JournalContents readJournal(const std::filesystem::path& path)
+    {
+        const auto data = readFile(path);
+        if (!data)
+            return {};
+        return parseJournal(*data);
+    }
+
+    JournalContents parseJournal(std::string_view view)
+    {
+        JournalContents contents;
+        size_t offset = 0;
+        while (offset < view.size())
+        {
+            const size_t end = view.find('\n', offset);
+            if (end == std::string_view::npos || end - offset < CHECKSUM_DIGITS + 1 || view[offset + CHECKSUM_DIGITS] != ' ')
+                break;
+
+            uint32_t expected = 0;
+            const char* first = view.data() + offset;
+            const auto [ptr, ec] = std::from_chars(first, first + CHECKSUM_DIGITS, expected, 16);
+            if (ec != std::errc() || ptr != first + CHECKSUM_DIGITS)
+                break;
+
+            const std::string_view payload = view.substr(offset + CHECKSUM_DIGITS + 1, end - offset - CHECKSUM_DIGITS - 1);
+            if (crc32(payload) != expected)
+                break;
+
+            contents.records.emplace_back(payload);
+            offset = end + 1;
+            contents.recordEnds.push_back(offset);
+        }
+
+        contents.validBytes = offset;
+        contents.torn = offset < view.size();
+        return contents;
+    }
+}
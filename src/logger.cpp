@@ -21,4 +21,19 @@ namespace GeminiCPP
         return logger_;
     }
 
+    void Log::enableAsync(size_t capacity, dtlog::overflow_policy policy)
+    {
+        init();
+
+        std::vector<std::shared_ptr<dtlog::isink>> sinks;
+        for (const auto& sink : logger_->get_sinks())
+        {
+            if (std::dynamic_pointer_cast<dtlog::async_sink>(sink))
+                sinks.push_back(sink);
+            else
+                sinks.push_back(std::make_shared<dtlog::async_sink>(sink, capacity, policy));
+        }
+        logger_->set_sinks(std::move(sinks));
+    }
+
 } // namespace GeminiCPP
\ No newline at end of file
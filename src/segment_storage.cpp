@@ -0,0 +1,580 @@
+﻿#include "gemini/segment_storage.h"
+
+#include <algorithm>
+#include <charconv>
+#include <system_error>
+
+#include "gemini/internal/file_utils.h"
+#include "gemini/internal/journal.h"
+#include "gemini/logger.h"
+#include "gemini/http_mapped_status_code.h"
+
+using namespace std::string_literals;
+
+namespace GeminiCPP
+{
+    namespace
+    {
+        // crc32 (4) | type (1) | id length (4) | payload length (4) | id | payload, integers little endian.
+        // The checksum covers everything after itself.
+        constexpr size_t RECORD_HEADER_SIZE = 4 + 1 + 4 + 4;
+
+        void putU32(std::string& out, uint32_t value)
+        {
+            for (int shift = 0; shift < 32; shift += 8)
+                out += static_cast<char>((value >> shift) & 0xFFu);
+        }
+
+        uint32_t getU32(std::string_view data, size_t offset)
+        {
+            uint32_t value = 0;
+            for (int i = 0; i < 4; ++i)
+                value |= static_cast<uint32_t>(static_cast<uint8_t>(data[offset + i])) << (8 * i);
+            return value;
+        }
+
+        void appendRecord(std::string& out, uint8_t type, std::string_view id, std::string_view payload)
+        {
+            const size_t begin = out.size();
+            out.append(4, '\0');
+            out += static_cast<char>(type);
+            putU32(out, static_cast<uint32_t>(id.size()));
+            putU32(out, static_cast<uint32_t>(payload.size()));
+            out += id;
+            out += payload;
+
+            const uint32_t crc = Internal::crc32(std::string_view(out).substr(begin + 4));
+            for (int i = 0; i < 4; ++i)
+                out[begin + i] = static_cast<char>((crc >> (8 * i)) & 0xFFu);
+        }
+
+        struct ParsedRecord
+        {
+            uint8_t type = 0;
+            std::string_view id;
+            std::string_view payload;
+            size_t length = 0;
+        };
+
+        // Parses the record at offset; nullopt if it is incomplete or fails its checksum.
+        std::optional<ParsedRecord> parseRecord(std::string_view data, size_t offset)
+        {
+            if (data.size() - offset < RECORD_HEADER_SIZE)
+                return std::nullopt;
+
+            const uint32_t idLength = getU32(data, offset + 5);
+            const uint32_t payloadLength = getU32(data, offset + 9);
+            const uint64_t length = RECORD_HEADER_SIZE + uint64_t{idLength} + payloadLength;
+            if (length > data.size() - offset)
+                return std::nullopt;
+
+            if (Internal::crc32(data.substr(offset + 4, static_cast<size_t>(length) - 4)) != getU32(data, offset))
+                return std::nullopt;
+
+            ParsedRecord record;
+            record.type = static_cast<uint8_t>(data[offset + 4]);
+            record.id = data.substr(offset + RECORD_HEADER_SIZE, idLength);
+            record.payload = data.substr(offset + RECORD_HEADER_SIZE + idLength, payloadLength);
+            record.length = static_cast<size_t>(length);
+            return record;
+        }
+
+        std::optional<uint64_t> segmentNumber(const std::filesystem::path& path)
+        {
+            const std::string name = path.filename().string();
+            if (name.size() <= 8 || name.rfind("seg-", 0) != 0 || path.extension() != ".log")
+                return std::nullopt;
+
+            uint64_t number = 0;
+            const char* first = name.data() + 4;
+            const char* last = name.data() + name.size() - 4;
+            const auto [ptr, ec] = std::from_chars(first, last, number);
+            if (ec != std::errc() || ptr != last)
+                return std::nullopt;
+            return number;
+        }
+    }
+
+    SegmentStorage::SegmentStorage(std::string rootPath, SegmentStorageOptions options)
+        : rootPath_(std::move(rootPath)), options_(std::move(options))
+    {
+        open();
+        writer_ = std::thread([this]() { run(); });
+    }
+
+    SegmentStorage::~SegmentStorage()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        if (writer_.joinable())
+            writer_.join();
+    }
+
+    std::filesystem::path SegmentStorage::segmentPath(uint64_t segment) const
+    {
+        return rootPath_ / ("seg-" + std::to_string(segment) + ".log");
+    }
+
+    void SegmentStorage::open()
+    {
+        std::filesystem::create_directories(rootPath_);
+
+        std::vector<uint64_t> numbers;
+        for (const auto& entry : std::filesystem::directory_iterator(rootPath_))
+        {
+            if (const auto number = segmentNumber(entry.path()))
+                numbers.push_back(*number);
+        }
+        std::sort(numbers.begin(), numbers.end());
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!numbers.empty())
+            nextSegment_ = numbers.back() + 1;
+        for (const uint64_t number : numbers)
+        {
+            const auto path = segmentPath(number);
+            const auto data = Internal::readFile(path);
+            if (!data)
+            {
+                GEMINI_ERROR("Cannot read session segment {}", path.string());
+                continue;
+            }
+
+            Segment& segment = segments_[number];
+            size_t offset = 0;
+            while (offset < data->size())
+            {
+                const auto record = parseRecord(*data, offset);
+                if (!record)
+                    break;
+
+                segment.bytes += record->length;
+                place(std::string(record->id), static_cast<RecordType>(record->type),
+                      Location{number, offset, static_cast<uint32_t>(record->length)});
+                offset += record->length;
+            }
+
+            if (offset < data->size())
+            {
+                if (number == numbers.back())
+                {
+                    // A save interrupted by a crash; it never completed, so drop it.
+                    GEMINI_WARN("Discarding the incomplete end of session segment {}", path.string());
+                    std::filesystem::resize_file(path, offset);
+                }
+                else
+                {
+                    GEMINI_ERROR("Session segment {} is corrupt after offset {}, ignoring the rest", path.string(), offset);
+                }
+            }
+        }
+
+        // The active segment is always one that was read: an unreadable newest one is left alone (and its
+        // number never reused), so nothing is appended after data the index does not know about.
+        if (segments_.empty() || segments_.rbegin()->first != numbers.back())
+        {
+            const uint64_t active = nextSegment_++;
+            segments_[active] = Segment{};
+            Internal::appendFile(segmentPath(active), {}, options_.durable);
+            if (options_.durable)
+                Internal::syncDirectory(rootPath_);
+        }
+        GEMINI_DEBUG("Opened {} sessions in {} segments", index_.size(), segments_.size());
+    }
+
+    void SegmentStorage::place(const std::string& id, RecordType type, const Location& location)
+    {
+        if (const auto it = index_.find(id); it != index_.end())
+        {
+            if (const auto previous = segments_.find(it->second.segment); previous != segments_.end())
+                previous->second.liveBytes -= it->second.length;
+        }
+
+        if (type == RecordType::Remove)
+        {
+            index_.erase(id);
+            return;
+        }
+
+        index_[id] = location;
+        segments_[location.segment].liveBytes += location.length;
+    }
+
+    std::future<bool> SegmentStorage::enqueue(RecordType type, std::string id, std::string payload)
+    {
+        std::promise<bool> promise;
+        auto future = promise.get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++submitted_;
+
+            // A newer write of the same session replaces the queued one; both complete with the batch.
+            if (const auto it = queued_.find(id); it != queued_.end())
+            {
+                PendingWrite& pending = queue_[it->second];
+                pending.type = type;
+                pending.payload = std::move(payload);
+                pending.done.push_back(std::move(promise));
+                return future;
+            }
+
+            queued_.emplace(id, queue_.size());
+            PendingWrite write{type, std::move(id), std::move(payload), {}};
+            write.done.push_back(std::move(promise));
+            queue_.push_back(std::move(write));
+        }
+        cv_.notify_one();
+        return future;
+    }
+
+    void SegmentStorage::run()
+    {
+        auto nextCompaction = std::chrono::steady_clock::now() + options_.compactionInterval;
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true)
+        {
+            cv_.wait_until(lock, nextCompaction, [this]() { return stopping_ || !queue_.empty(); });
+
+            if (!queue_.empty())
+            {
+                std::vector<PendingWrite> batch = std::move(queue_);
+                queue_.clear();
+                queued_.clear();
+                lock.unlock();
+
+                bool ok = false;
+                try
+                {
+                    ok = commit(batch);
+                }
+                catch (const std::exception& e)
+                {
+                    GEMINI_ERROR("SegmentStorage write error: {}", e.what());
+                }
+
+                uint64_t completed = 0;
+                for (auto& write : batch)
+                {
+                    for (auto& done : write.done)
+                    {
+                        done.set_value(ok);
+                        ++completed;
+                    }
+                }
+
+                lock.lock();
+                committed_ += completed;
+                flushed_.notify_all();
+            }
+            else if (stopping_)
+            {
+                break;
+            }
+
+            // Checked after writes too, so a storage that is never idle still gets compacted.
+            if (std::chrono::steady_clock::now() >= nextCompaction)
+            {
+                lock.unlock();
+                try
+                {
+                    compactOne();
+                }
+                catch (const std::exception& e)
+                {
+                    GEMINI_ERROR("SegmentStorage compaction error: {}", e.what());
+                }
+                lock.lock();
+                nextCompaction = std::chrono::steady_clock::now() + options_.compactionInterval;
+            }
+        }
+    }
+
+    bool SegmentStorage::commit(std::vector<PendingWrite>& batch)
+    {
+        std::string data;
+        std::vector<size_t> recordSizes;
+        recordSizes.reserve(batch.size());
+        for (const auto& write : batch)
+        {
+            const size_t before = data.size();
+            appendRecord(data, static_cast<uint8_t>(write.type), write.id, write.payload);
+            recordSizes.push_back(data.size() - before);
+        }
+
+        std::vector<Location> locations;
+        if (!appendRecords(data, locations, recordSizes, options_.durable))
+            return false;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i = 0; i < batch.size(); ++i)
+            place(batch[i].id, batch[i].type, locations[i]);
+        return true;
+    }
+
+    bool SegmentStorage::appendRecords(const std::string& data, std::vector<Location>& locations, const std::vector<size_t>& recordSizes, bool durable)
+    {
+        uint64_t active;
+        uint64_t offset;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            active = segments_.rbegin()->first;
+            offset = segments_.rbegin()->second.bytes;
+        }
+
+        if (offset > 0 && offset + data.size() > options_.maxSegmentBytes)
+        {
+            rollSegment();
+            ++active;
+            offset = 0;
+        }
+
+        // One write and (if durable) one fsync for the whole batch.
+        if (!Internal::appendFile(segmentPath(active), data, durable))
+        {
+            // The segment may now end in a partial record; seal it so later records are not written after it.
+            std::error_code ec;
+            const auto size = std::filesystem::file_size(segmentPath(active), ec);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                segments_[active].bytes = ec ? offset : size;
+            }
+            rollSegment();
+            return false;
+        }
+
+        locations.reserve(recordSizes.size());
+        for (const size_t size : recordSizes)
+        {
+            locations.push_back(Location{active, offset, static_cast<uint32_t>(size)});
+            offset += size;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        segments_[active].bytes = offset;
+        return true;
+    }
+
+    void SegmentStorage::rollSegment()
+    {
+        uint64_t next;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            next = nextSegment_++;
+            segments_[next] = Segment{};
+        }
+
+        Internal::appendFile(segmentPath(next), {}, options_.durable);
+        if (options_.durable)
+            Internal::syncDirectory(rootPath_);
+    }
+
+    bool SegmentStorage::compactOne()
+    {
+        // Compacted segments whose deletion failed earlier (e.g. a reader still had them open on Windows).
+        for (auto it = obsolete_.begin(); it != obsolete_.end();)
+        {
+            std::error_code ec;
+            std::filesystem::remove(segmentPath(*it), ec);
+            it = ec ? std::next(it) : obsolete_.erase(it);
+        }
+
+        uint64_t victim = 0;
+        bool hasOlder = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            double lowest = options_.compactionThreshold;
+            const uint64_t active = segments_.rbegin()->first;
+            for (const auto& [number, segment] : segments_)
+            {
+                if (number == active)
+                    break;
+                const double live = segment.bytes == 0 ? 0.0 : static_cast<double>(segment.liveBytes) / static_cast<double>(segment.bytes);
+                if (live < lowest || segment.bytes == 0)
+                {
+                    lowest = live;
+                    victim = number;
+                }
+            }
+            if (victim == 0)
+                return false;
+
+            hasOlder = segments_.begin()->first < victim ||
+                       std::any_of(obsolete_.begin(), obsolete_.end(), [victim](uint64_t number) { return number < victim; });
+        }
+
+        const auto path = segmentPath(victim);
+        const auto data = Internal::readFile(path);
+        if (!data)
+            return false;
+
+        // Only this thread changes the index, so a record still indexed here stays live while it is copied.
+        std::string live;
+        std::vector<size_t> recordSizes;
+        std::vector<std::pair<std::string, RecordType>> records;
+        size_t offset = 0;
+        while (offset < data->size())
+        {
+            const auto record = parseRecord(*data, offset);
+            if (!record)
+                break;
+
+            const std::string id(record->id);
+            const auto type = static_cast<RecordType>(record->type);
+            bool keep;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                const auto it = index_.find(id);
+                if (type == RecordType::Put)
+                    keep = it != index_.end() && it->second.segment == victim && it->second.offset == offset;
+                else
+                    keep = it == index_.end() && hasOlder; // Still shadows a Put in an older segment.
+            }
+
+            if (keep)
+            {
+                live.append(*data, offset, record->length);
+                recordSizes.push_back(record->length);
+                records.emplace_back(id, type);
+            }
+            offset += record->length;
+        }
+
+        if (!live.empty())
+        {
+            // Always durable, and the directory too (the copies may have started a new segment): the victim
+            // is deleted next, and its records may have been the only copies that were safely on disk.
+            std::vector<Location> locations;
+            if (!appendRecords(live, locations, recordSizes, true) || !Internal::syncDirectory(rootPath_))
+                return false;
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (size_t i = 0; i < records.size(); ++i)
+                place(records[i].first, records[i].second, locations[i]);
+        }
+
+        GEMINI_DEBUG("Compacted session segment {}: kept {} of {} bytes", victim, live.size(), data->size());
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            segments_.erase(victim);
+        }
+
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+        if (ec)
+            obsolete_.push_back(victim);
+        return true;
+    }
+
+    bool SegmentStorage::save(const ChatSession& session)
+    {
+        return saveAsync(session).get();
+    }
+
+    std::future<bool> SegmentStorage::saveAsync(const ChatSession& session)
+    {
+        // Encoding happens on the caller's thread, so the single writer only does I/O.
+        try
+        {
+            const ChatSessionSnapshot snapshot = session.snapshot();
+            // The stored record would be replaced by one holding the placeholders of undecodable turns.
+            if (!snapshot.history.readable())
+                throw std::runtime_error("a history turn of session " + snapshot.id + " cannot be decoded");
+            return enqueue(RecordType::Put, snapshot.id, SessionCodec::encode(snapshot, options_.encoding, nlohmann::json::object(), options_.blobs));
+        }
+        catch (const std::exception& e)
+        {
+            GEMINI_ERROR("SegmentStorage Save Error: {}", e.what());
+        }
+
+        std::promise<bool> failed;
+        failed.set_value(false);
+        return failed.get_future();
+    }
+
+    bool SegmentStorage::remove(const std::string& sessionId)
+    {
+        return enqueue(RecordType::Remove, sessionId, {}).get();
+    }
+
+    void SegmentStorage::flush()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        const uint64_t target = submitted_;
+        flushed_.wait(lock, [this, target]() { return committed_ >= target; });
+    }
+
+    Result<ChatSession> SegmentStorage::load(const std::string& sessionId, Client* client)
+    {
+        // A second attempt covers a record moved by compaction between the lookup and the read.
+        for (int attempt = 0; attempt < 2; ++attempt)
+        {
+            Location location;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                const auto it = index_.find(sessionId);
+                if (it == index_.end())
+                    return Result<ChatSession>::Failure("Session not found: " + sessionId, frenum::value(HttpMappedStatusCode::NOT_FOUND));
+                location = it->second;
+            }
+
+            const auto data = Internal::readFileRange(segmentPath(location.segment), location.offset, location.length);
+            if (!data)
+                continue;
+
+            const auto record = parseRecord(*data, 0);
+            if (!record || record->id != sessionId)
+                return Result<ChatSession>::Failure("Corrupt session record: " + sessionId);
+
+            try
+            {
+                auto payload = std::make_shared<const std::string>(record->payload);
+                auto snapshot = SessionCodec::decode(std::move(payload), nullptr, options_.blobs.store);
+                if (!snapshot)
+                    return Result<ChatSession>::Failure("Corrupt session record: " + sessionId);
+                return Result<ChatSession>::Success(ChatSession::fromSnapshot(client, std::move(*snapshot)));
+            }
+            catch (const std::exception& e)
+            {
+                return Result<ChatSession>::Failure("Load Error: "s + e.what());
+            }
+        }
+        return Result<ChatSession>::Failure("Cannot read session: " + sessionId);
+    }
+
+    std::vector<std::string> SegmentStorage::listSessions()
+    {
+        std::vector<std::string> sessions;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            sessions.reserve(index_.size());
+            for (const auto& [id, location] : index_)
+                sessions.push_back(id);
+        }
+        std::sort(sessions.begin(), sessions.end());
+        return sessions;
+    }
+
+    size_t SegmentStorage::segmentCount() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return segments_.size();
+    }
+
+    std::future<Result<ChatSession>> SegmentStorage::loadAsync(const std::string& sessionId, Client* client)
+    {
+        return std::async(std::launch::async, [this, sessionId, client]() {
+            return load(sessionId, client);
+        });
+    }
+
+    std::future<std::vector<std::string>> SegmentStorage::listSessionsAsync()
+    {
+        return std::async(std::launch::async, [this]() {
+            return listSessions();
+        });
+    }
+}
@@ -0,0 +1,150 @@
+﻿#include "gemini/serial_executor.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "gemini/logger.h"
+#include "gemini/thread_pool.h"
+
+namespace GeminiCPP
+{
+    SerialExecutor::SerialExecutor(ThreadPool* pool) : pool_(pool ? pool : &defaultPool())
+    {
+    }
+
+    SerialExecutor::~SerialExecutor()
+    {
+        cancelAll();
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_.wait(lock, [this]() { return !scheduled_; });
+    }
+
+    ThreadPool& SerialExecutor::defaultPool()
+    {
+        // Tasks mostly wait on the network, so there are more workers than cores.
+        static ThreadPool pool(4 * std::max(2u, std::thread::hardware_concurrency()));
+        return pool;
+    }
+
+    SerialExecutor::TaskId SerialExecutor::submit(std::function<void()> task, std::function<void()> onCancel)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const TaskId id = ++nextId_;
+        queue_.push_back(Task{id, std::move(task), std::move(onCancel)});
+        ++stats_.submitted;
+        stats_.maxQueued = std::max(stats_.maxQueued, queue_.size());
+        schedule();
+        return id;
+    }
+
+    bool SerialExecutor::cancel(TaskId id)
+    {
+        std::function<void()> onCancel;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            const auto it = std::find_if(queue_.begin(), queue_.end(), [id](const Task& task) { return task.id == id; });
+            if (it == queue_.end())
+                return false;
+
+            onCancel = std::move(it->onCancel);
+            queue_.erase(it);
+            ++stats_.cancelled;
+        }
+
+        if (onCancel)
+            onCancel();
+        return true;
+    }
+
+    size_t SerialExecutor::cancelAll()
+    {
+        std::deque<Task> cancelled;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cancelled.swap(queue_);
+            stats_.cancelled += cancelled.size();
+        }
+
+        for (auto& task : cancelled)
+        {
+            if (task.onCancel)
+                task.onCancel();
+        }
+        return cancelled.size();
+    }
+
+    void SerialExecutor::wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_.wait(lock, [this]() { return !scheduled_; });
+    }
+
+    void SerialExecutor::setPool(ThreadPool* pool)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pool_ = pool ? pool : &defaultPool();
+    }
+
+    size_t SerialExecutor::queued() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return queue_.size();
+    }
+
+    SerialExecutorStats SerialExecutor::stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        SerialExecutorStats stats = stats_;
+        stats.queued = queue_.size();
+        return stats;
+    }
+
+    void SerialExecutor::schedule()
+    {
+        if (scheduled_ || queue_.empty())
+            return;
+
+        scheduled_ = true;
+        (void)pool_->submit([this]() { runNext(); });
+    }
+
+    void SerialExecutor::runNext()
+    {
+        Task task;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (queue_.empty())
+            {
+                // Everything was cancelled after this run was scheduled.
+                scheduled_ = false;
+                idle_.notify_all();
+                return;
+            }
+
+            task = std::move(queue_.front());
+            queue_.pop_front();
+            stats_.running = true;
+        }
+
+        try
+        {
+            task.run();
+        }
+        catch (const std::exception& e)
+        {
+            GEMINI_ERROR("SerialExecutor: task threw: {}", e.what());
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.running = false;
+        ++stats_.completed;
+
+        // Back to the end of the pool's queue, behind the other executors.
+        scheduled_ = false;
+        schedule();
+        if (!scheduled_)
+            idle_.notify_all();
+    }
+}
@@ -0,0 +1,380 @@
+﻿#include "gemini/session_cache.h"
+
+#include "gemini/logger.h"
+
+namespace GeminiCPP
+{
+    CachedStorage::CachedStorage(std::shared_ptr<IChatStorage> backend, SessionCacheOptions options)
+        : backend_(std::move(backend)), options_(std::move(options))
+    {
+        if (options_.writeMode == CacheWriteMode::WriteBack)
+            writer_ = std::thread([this]() { run(); });
+    }
+
+    CachedStorage::~CachedStorage()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        if (writer_.joinable())
+            writer_.join();
+    }
+
+    size_t CachedStorage::entryBytes(const ChatSessionSnapshot& snapshot)
+    {
+        return sizeof(Entry) + 2 * snapshot.id.size() + snapshot.name.size() + snapshot.model.size()
+            + snapshot.systemInstruction.size() + snapshot.summary.text.size()
+            + snapshot.turnTokens.size() * sizeof(int) + snapshot.history.jsonBytes();
+    }
+
+    Result<ChatSession> CachedStorage::toSession(const LoadResult& result, Client* client)
+    {
+        if (!result)
+            return Result<ChatSession>::Failure(result.errorMessage, frenum::value(result.statusCode));
+        return Result<ChatSession>::Success(ChatSession::fromSnapshot(client, *result.value));
+    }
+
+    bool CachedStorage::save(const ChatSession& session)
+    {
+        ChatSessionSnapshot snapshot = session.snapshot();
+
+        if (options_.writeMode == CacheWriteMode::WriteBack)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            insert(std::move(snapshot), true, false);
+            if (bytes_ > options_.maxBytes)
+                cv_.notify_one();
+            return true;
+        }
+
+        const bool ok = backend_->save(session);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (ok)
+        {
+            insert(std::move(snapshot), false, false);
+        }
+        else
+        {
+            // The backend may or may not have the new version; read it back next time.
+            if (const auto it = index_.find(snapshot.id); it != index_.end() && !it->second->dirty)
+                erase(it->second);
+            onDisk_.erase(snapshot.id);
+            demoting_.erase(snapshot.id);
+        }
+        return ok;
+    }
+
+    Result<ChatSession> CachedStorage::load(const std::string& sessionId, Client* client)
+    {
+        std::promise<LoadResult> promise;
+        std::shared_future<LoadResult> pending;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (const auto it = index_.find(sessionId); it != index_.end())
+            {
+                entries_.splice(entries_.begin(), entries_, it->second);
+                ++stats_.hits;
+                ChatSessionSnapshot snapshot = it->second->snapshot;
+                return Result<ChatSession>::Success(ChatSession::fromSnapshot(client, std::move(snapshot)));
+            }
+
+            if (const auto it = inflight_.find(sessionId); it != inflight_.end())
+            {
+                ++stats_.coalescedLoads;
+                pending = it->second;
+            }
+            else
+            {
+                inflight_.emplace(sessionId, promise.get_future().share());
+            }
+        }
+
+        if (pending.valid())
+            return toSession(pending.get(), client);
+
+        LoadResult result = fetch(sessionId);
+        promise.set_value(result);
+        return toSession(result, client);
+    }
+
+    CachedStorage::LoadResult CachedStorage::fetch(const std::string& sessionId)
+    {
+        bool fromDisk;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            fromDisk = options_.diskTier && onDisk_.contains(sessionId);
+        }
+
+        LoadResult result;
+        try
+        {
+            if (fromDisk)
+            {
+                Result<ChatSession> loaded = options_.diskTier->load(sessionId, nullptr);
+                if (loaded)
+                    result = LoadResult::Success(loaded->snapshot());
+                else
+                    GEMINI_WARN("Session cache: disk tier could not load '{}': {}", sessionId, loaded.errorMessage);
+            }
+
+            if (!result)
+            {
+                fromDisk = false;
+                Result<ChatSession> loaded = backend_->load(sessionId, nullptr);
+                result = loaded
+                    ? LoadResult::Success(loaded->snapshot())
+                    : LoadResult::Failure(loaded.errorMessage, frenum::value(loaded.statusCode));
+            }
+        }
+        catch (const std::exception& e)
+        {
+            result = LoadResult::Failure(std::string("Load Error: ") + e.what());
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        inflight_.erase(sessionId);
+        ++(fromDisk ? stats_.diskHits : stats_.misses);
+        if (!result)
+            return result;
+
+        // A save that completed while the session was being fetched is newer than what was fetched.
+        if (const auto it = index_.find(sessionId); it != index_.end())
+            return LoadResult::Success(it->second->snapshot);
+
+        insert(*result.value, false, fromDisk);
+        return result;
+    }
+
+    std::vector<std::string> CachedStorage::listSessions()
+    {
+        std::vector<std::string> sessions = backend_->listSessions();
+        if (options_.writeMode != CacheWriteMode::WriteBack)
+            return sessions;
+
+        std::unordered_set<std::string_view> listed(sessions.begin(), sessions.end());
+        std::vector<std::string> unwritten;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto& entry : entries_)
+            {
+                if (entry.dirty && !listed.contains(entry.id))
+                    unwritten.push_back(entry.id);
+            }
+        }
+        sessions.insert(sessions.end(), unwritten.begin(), unwritten.end());
+        return sessions;
+    }
+
+    std::future<bool> CachedStorage::saveAsync(const ChatSession& session)
+    {
+        if (options_.writeMode == CacheWriteMode::WriteBack)
+        {
+            std::promise<bool> done;
+            done.set_value(save(session));
+            return done.get_future();
+        }
+
+        return std::async(std::launch::async, [this, snapshot = session.snapshot()]() {
+            return save(ChatSession::fromSnapshot(nullptr, snapshot));
+        });
+    }
+
+    std::future<Result<ChatSession>> CachedStorage::loadAsync(const std::string& sessionId, Client* client)
+    {
+        return std::async(std::launch::async, [this, sessionId, client]() {
+            return load(sessionId, client);
+        });
+    }
+
+    std::future<std::vector<std::string>> CachedStorage::listSessionsAsync()
+    {
+        return std::async(std::launch::async, [this]() {
+            return listSessions();
+        });
+    }
+
+    bool CachedStorage::flush()
+    {
+        if (!writer_.joinable())
+            return true;
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        const uint64_t ticket = ++flushRequested_;
+        cv_.notify_one();
+        flushed_.wait(lock, [&]() { return flushCompleted_ >= ticket; });
+        return lastRoundOk_;
+    }
+
+    void CachedStorage::invalidate(const std::string& sessionId)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (const auto it = index_.find(sessionId); it != index_.end() && !it->second->dirty)
+            erase(it->second);
+        onDisk_.erase(sessionId);
+        demoting_.erase(sessionId);
+    }
+
+    SessionCacheStats CachedStorage::stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        SessionCacheStats stats = stats_;
+        stats.entries = entries_.size();
+        stats.bytes = bytes_;
+        for (const auto& entry : entries_)
+            stats.dirty += entry.dirty ? 1 : 0;
+        return stats;
+    }
+
+    void CachedStorage::insert(ChatSessionSnapshot snapshot, bool dirty, bool onDisk)
+    {
+        if (const auto it = index_.find(snapshot.id); it != index_.end())
+            erase(it->second);
+
+        // Only a session just read from the disk tier matches its copy there; any other version supersedes it.
+        if (onDisk)
+        {
+            onDisk_.insert(snapshot.id);
+        }
+        else
+        {
+            onDisk_.erase(snapshot.id);
+            demoting_.erase(snapshot.id);
+        }
+
+        Entry entry;
+        entry.id = snapshot.id;
+        entry.bytes = entryBytes(snapshot);
+        entry.snapshot = std::move(snapshot);
+        entry.version = ++nextVersion_;
+        entry.dirty = dirty;
+        entry.onDisk = onDisk;
+
+        bytes_ += entry.bytes;
+        entries_.push_front(std::move(entry));
+        index_.emplace(entries_.front().id, entries_.begin());
+        evict();
+    }
+
+    void CachedStorage::erase(std::list<Entry>::iterator entry)
+    {
+        bytes_ -= entry->bytes;
+        index_.erase(entry->id);
+        entries_.erase(entry);
+    }
+
+    void CachedStorage::evict()
+    {
+        // Least recently used first; dirty sessions stay until the writer has saved them.
+        auto it = entries_.end();
+        while (bytes_ > options_.maxBytes && it != entries_.begin())
+        {
+            const auto victim = std::prev(it);
+            if (victim->dirty)
+            {
+                it = victim;
+                continue;
+            }
+
+            if (options_.diskTier && !victim->onDisk)
+                demote(*victim);
+            erase(victim);
+            ++stats_.evictions;
+        }
+    }
+
+    void CachedStorage::demote(const Entry& entry)
+    {
+        const uint64_t version = entry.version;
+        demoting_[entry.id] = version;
+
+        (void)demoter_.submit([this, snapshot = entry.snapshot, version]() {
+            bool ok = false;
+            try
+            {
+                ok = options_.diskTier->save(ChatSession::fromSnapshot(nullptr, snapshot));
+            }
+            catch (const std::exception& e)
+            {
+                GEMINI_WARN("Session cache: disk tier could not save '{}': {}", snapshot.id, e.what());
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            const auto it = demoting_.find(snapshot.id);
+            if (it == demoting_.end() || it->second != version)
+                return; // Superseded while it was being written.
+            demoting_.erase(it);
+            if (ok)
+                onDisk_.insert(snapshot.id);
+        });
+    }
+
+    void CachedStorage::run()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true)
+        {
+            cv_.wait_for(lock, options_.writeBackInterval, [this]() {
+                return stopping_ || flushRequested_ > flushCompleted_ || (bytes_ > options_.maxBytes && lastRoundOk_);
+            });
+
+            const uint64_t requested = flushRequested_;
+            const bool stopping = stopping_;
+
+            std::vector<std::pair<uint64_t, ChatSessionSnapshot>> batch;
+            for (const auto& entry : entries_)
+            {
+                if (entry.dirty)
+                    batch.emplace_back(entry.version, entry.snapshot);
+            }
+
+            bool ok = true;
+            if (!batch.empty())
+            {
+                lock.unlock();
+                std::vector<char> written(batch.size(), 0);
+                for (size_t i = 0; i < batch.size(); ++i)
+                {
+                    try
+                    {
+                        written[i] = backend_->save(ChatSession::fromSnapshot(nullptr, batch[i].second));
+                    }
+                    catch (const std::exception& e)
+                    {
+                        GEMINI_ERROR("Session cache: write-back of '{}' failed: {}", batch[i].second.id, e.what());
+                    }
+                }
+                lock.lock();
+
+                for (size_t i = 0; i < batch.size(); ++i)
+                {
+                    if (!written[i])
+                    {
+                        ok = false;
+                        ++stats_.writeBackFailures;
+                        continue;
+                    }
+
+                    // Saved again meanwhile: the newer version stays dirty.
+                    const auto it = index_.find(batch[i].second.id);
+                    if (it != index_.end() && it->second->version == batch[i].first)
+                        it->second->dirty = false;
+                }
+                evict();
+            }
+
+            lastRoundOk_ = ok;
+            flushCompleted_ = requested;
+            flushed_.notify_all();
+
+            if (stopping)
+            {
+                if (!ok)
+                    GEMINI_ERROR("Session cache: some sessions could not be written back before shutdown");
+                break;
+            }
+        }
+    }
+}
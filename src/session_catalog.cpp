@@ -0,0 +1,330 @@
+﻿#include "gemini/session_catalog.h"
+
+#include <algorithm>
+#include <system_error>
+
+#include "gemini/internal/file_utils.h"
+#include "gemini/internal/journal.h"
+#include "gemini/logger.h"
+
+namespace GeminiCPP
+{
+    namespace
+    {
+        constexpr size_t MIN_COMPACTION_RECORDS = 1024;
+        constexpr size_t HEAD_BYTES = 64; ///< Covers the generation record a rewrite starts with.
+
+        // Strict weak ordering of the query: the sort key, then the id.
+        bool precedes(const SessionInfo& a, const SessionInfo& b, SessionSortKey key, bool descending)
+        {
+            auto ordered = [&](const auto& x, const auto& y) {
+                if (x != y)
+                    return descending ? y < x : x < y;
+                return a.id < b.id;
+            };
+
+            switch (key)
+            {
+            case SessionSortKey::Name:      return ordered(a.name, b.name);
+            case SessionSortKey::TurnCount: return ordered(a.turnCount, b.turnCount);
+            case SessionSortKey::Bytes:     return ordered(a.bytes, b.bytes);
+            case SessionSortKey::Id:        return descending ? b.id < a.id : a.id < b.id;
+            case SessionSortKey::UpdatedAt:
+            default:                        return ordered(a.updatedAt, b.updatedAt);
+            }
+        }
+
+        bool matches(const SessionInfo& info, const SessionQuery& query)
+        {
+            if (!query.model.empty() && info.model != query.model)
+                return false;
+            if (query.updatedAfter && info.updatedAt <= *query.updatedAfter)
+                return false;
+            if (query.updatedBefore && info.updatedAt >= *query.updatedBefore)
+                return false;
+            return query.nameContains.empty() || info.name.find(query.nameContains) != std::string::npos;
+        }
+    }
+
+    nlohmann::json SessionInfo::toJson() const
+    {
+        return {
+            {"id", id},
+            {"name", name},
+            {"model", model},
+            {"turns", turnCount},
+            {"updated", std::chrono::duration_cast<std::chrono::milliseconds>(updatedAt.time_since_epoch()).count()},
+            {"bytes", bytes}
+        };
+    }
+
+    SessionInfo SessionInfo::fromJson(const nlohmann::json& j)
+    {
+        SessionInfo info;
+        info.id = j.value("id", "");
+        info.name = j.value("name", "");
+        info.model = j.value("model", "");
+        info.turnCount = j.value("turns", size_t{0});
+        info.updatedAt = std::chrono::system_clock::time_point(
+            std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::milliseconds(j.value("updated", int64_t{0}))));
+        info.bytes = j.value("bytes", size_t{0});
+        return info;
+    }
+
+    SessionCatalog::SessionCatalog(std::filesystem::path path, bool durable)
+        : path_(std::move(path)), durable_(durable)
+    {
+        lockPath_ = path_;
+        lockPath_ += ".lock";
+    }
+
+    bool SessionCatalog::open()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        reset();
+
+        std::error_code ec;
+        if (!std::filesystem::exists(path_, ec))
+            return false;
+
+        // With the lock, a torn end is left by a crash, not by another writer's append in progress.
+        Internal::FileLock fileLock(lockPath_);
+        catchUp(fileLock.locked());
+        return true;
+    }
+
+    void SessionCatalog::refresh()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        catchUp(false);
+    }
+
+    void SessionCatalog::reset()
+    {
+        entries_.clear();
+        records_ = 0;
+        openBatches_.clear();
+        readBytes_ = 0;
+        head_.clear();
+    }
+
+    void SessionCatalog::catchUp(bool repair)
+    {
+        std::error_code ec;
+        const uint64_t size = std::filesystem::file_size(path_, ec);
+        if (ec)
+            return;
+
+        // A rewrite replaces the file and starts it with a new generation record: read it from the start.
+        if (readBytes_ > 0 && (size < readBytes_ || Internal::readFileRange(path_, 0, head_.size()) != head_))
+            reset();
+        if (size == readBytes_)
+            return;
+
+        const auto data = Internal::readFileRange(path_, readBytes_, static_cast<size_t>(size - readBytes_));
+        if (!data)
+            return;
+
+        const auto journal = Internal::parseJournal(*data);
+        for (const auto& payload : journal.records)
+        {
+            const auto record = nlohmann::json::parse(payload, nullptr, false);
+            if (!record.is_discarded() && record.is_object())
+                apply(record);
+        }
+        if (readBytes_ == 0)
+            head_ = data->substr(0, std::min(HEAD_BYTES, journal.validBytes));
+        readBytes_ += journal.validBytes;
+
+        if (journal.torn && repair)
+        {
+            GEMINI_WARN("Discarding the incomplete end of the session catalog {}", path_.string());
+            std::filesystem::resize_file(path_, readBytes_, ec);
+        }
+    }
+
+    void SessionCatalog::apply(const nlohmann::json& record)
+    {
+        if (const auto batch = record.find("batch"); batch != record.end())
+        {
+            openBatches_[batch->get<uint64_t>()] = record.value("sessions", std::vector<std::string>{});
+            ++records_;
+            return;
+        }
+        if (const auto ended = record.find("ended"); ended != record.end())
+        {
+            openBatches_.erase(ended->get<uint64_t>());
+            ++records_;
+            return;
+        }
+        if (!record.contains("id"))
+            return; // e.g. the generation record of a rewrite
+
+        const std::string id = record["id"].get<std::string>();
+        if (record.value("removed", false))
+            entries_.erase(id);
+        else
+            entries_[id] = SessionInfo::fromJson(record);
+        ++records_;
+    }
+
+    bool SessionCatalog::upsert(const SessionInfo& info)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return append(info.toJson());
+    }
+
+    bool SessionCatalog::remove(const std::string& id)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        catchUp(false);
+        if (entries_.find(id) == entries_.end())
+            return true;
+        return append({{"id", id}, {"removed", true}});
+    }
+
+    uint64_t SessionCatalog::beginBatch(const std::vector<std::string>& ids, bool sync)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const uint64_t batch = random_();
+        append({{"batch", batch}, {"sessions", ids}}, sync);
+        return batch;
+    }
+
+    void SessionCatalog::endBatch(uint64_t batch)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (openBatches_.contains(batch) && !append({{"ended", batch}}))
+            openBatches_.erase(batch);
+    }
+
+    std::vector<std::string> SessionCatalog::unfinished() const
+    {
+        std::vector<std::string> ids;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto& [batch, sessions] : openBatches_)
+                ids.insert(ids.end(), sessions.begin(), sessions.end());
+        }
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        return ids;
+    }
+
+    void SessionCatalog::clearUnfinished()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (!openBatches_.empty())
+        {
+            const uint64_t batch = openBatches_.begin()->first;
+            if (!append({{"ended", batch}}))
+                openBatches_.erase(batch);
+        }
+    }
+
+    bool SessionCatalog::append(const nlohmann::json& record, bool sync)
+    {
+        Internal::FileLock fileLock(lockPath_);
+        if (!fileLock.locked())
+        {
+            GEMINI_ERROR("Cannot lock the session catalog {}", path_.string());
+            return false;
+        }
+
+        // Records other writers appended come first: the index (and a rewrite of it) must include them.
+        catchUp(true);
+
+        const std::string encoded = Internal::encodeJournalRecord(record.dump());
+        if (!Internal::appendFile(path_, encoded, durable_ || sync))
+        {
+            GEMINI_ERROR("Cannot update the session catalog {}", path_.string());
+            // The file may now end in a partial record that would hide later ones; rewrite it.
+            compact();
+            return false;
+        }
+
+        if (readBytes_ == 0)
+            head_ = encoded.substr(0, HEAD_BYTES);
+        readBytes_ += encoded.size();
+        apply(record); // Only now: catchUp() may have rebuilt the index from a rewrite.
+
+        if (records_ > std::max(MIN_COMPACTION_RECORDS, 2 * entries_.size()))
+            compact();
+        return true;
+    }
+
+    bool SessionCatalog::compact()
+    {
+        std::string data = Internal::encodeJournalRecord(nlohmann::json{{"generation", random_()}}.dump());
+        for (const auto& [id, info] : entries_)
+            data += Internal::encodeJournalRecord(info.toJson().dump());
+        for (const auto& [batch, sessions] : openBatches_)
+            data += Internal::encodeJournalRecord(nlohmann::json{{"batch", batch}, {"sessions", sessions}}.dump());
+
+        // Always durable: unlike a lost append, a rewrite lost to a crash could leave an empty catalog behind.
+        if (!Internal::writeFileAtomic(path_, data, true))
+        {
+            GEMINI_WARN("Cannot compact the session catalog {}", path_.string());
+            return false;
+        }
+        records_ = entries_.size() + openBatches_.size();
+        readBytes_ = data.size();
+        head_ = data.substr(0, HEAD_BYTES);
+        return true;
+    }
+
+    std::optional<SessionInfo> SessionCatalog::find(const std::string& id) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const auto it = entries_.find(id);
+        if (it == entries_.end())
+            return std::nullopt;
+        return it->second;
+    }
+
+    SessionPage SessionCatalog::query(const SessionQuery& query) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        std::vector<const SessionInfo*> matching;
+        for (const auto& [id, info] : entries_)
+        {
+            if (matches(info, query))
+                matching.push_back(&info);
+        }
+
+        SessionPage page;
+        page.total = matching.size();
+        if (query.offset >= matching.size() || query.limit == 0)
+            return page;
+
+        // Only the entries up to the end of the requested page need to be ordered.
+        const size_t end = query.offset + std::min(query.limit, matching.size() - query.offset);
+        std::partial_sort(matching.begin(), matching.begin() + static_cast<std::ptrdiff_t>(end), matching.end(),
+                          [&](const SessionInfo* a, const SessionInfo* b) { return precedes(*a, *b, query.sortBy, query.descending); });
+
+        page.sessions.reserve(end - query.offset);
+        for (size_t i = query.offset; i < end; ++i)
+            page.sessions.push_back(*matching[i]);
+        return page;
+    }
+
+    std::vector<std::string> SessionCatalog::ids() const
+    {
+        std::vector<std::string> ids;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ids.reserve(entries_.size());
+            for (const auto& [id, info] : entries_)
+                ids.push_back(id);
+        }
+        std::sort(ids.begin(), ids.end());
+        return ids;
+    }
+
+    size_t SessionCatalog::size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return entries_.size();
+    }
+}
@@ -0,0 +1,146 @@
+﻿#include "gemini/session_codec.h"
+
+#include "gemini/logger.h"
+
+namespace GeminiCPP
+{
+    namespace
+    {
+        constexpr std::string_view MAGIC = "GSES";
+        constexpr uint8_t VERSION = 1;
+        constexpr size_t PREAMBLE_SIZE = 4 + 1 + 1 + 4; // magic, version, encoding, header length
+
+        void appendEncoded(std::string& out, const nlohmann::json& j, SessionEncoding encoding)
+        {
+            if (encoding == SessionEncoding::Cbor)
+                nlohmann::json::to_cbor(j, out);
+            else
+                nlohmann::json::to_msgpack(j, out);
+        }
+
+        nlohmann::json parseEncoded(const char* first, const char* last, SessionEncoding encoding)
+        {
+            if (encoding == SessionEncoding::Cbor)
+                return nlohmann::json::from_cbor(first, last);
+            return nlohmann::json::from_msgpack(first, last);
+        }
+    }
+
+    std::string SessionCodec::encode(const ChatSessionSnapshot& snapshot, SessionEncoding encoding, const nlohmann::json& attributes,
+                                     const BlobOffloadPolicy& blobs)
+    {
+        if (encoding == SessionEncoding::Json)
+            encoding = SessionEncoding::MessagePack;
+
+        std::string turns;
+        nlohmann::json index = nlohmann::json::array();
+        for (const std::string_view json : snapshot.history.jsonSince(0))
+        {
+            const size_t offset = turns.size();
+            nlohmann::json turn = nlohmann::json::parse(json);
+            BlobOffload::offload(turn, blobs);
+            appendEncoded(turns, turn, encoding);
+            index.push_back({offset, turns.size() - offset, json.size()});
+        }
+
+        nlohmann::json header;
+        header["id"] = snapshot.id;
+        header["name"] = snapshot.name;
+        header["model"] = snapshot.model;
+        header["systemInstruction"] = snapshot.systemInstruction;
+        header["turnTokens"] = snapshot.turnTokens;
+        if (!snapshot.summary.empty())
+            header["summary"] = snapshot.summary.toJson();
+        if (!snapshot.parentId.empty())
+            header["parentId"] = snapshot.parentId;
+        if (!snapshot.forkPoints.empty())
+            header["forkPoints"] = snapshot.forkPoints;
+        header["attributes"] = attributes;
+        header["turns"] = std::move(index);
+
+        std::string encodedHeader;
+        appendEncoded(encodedHeader, header, encoding);
+
+        std::string out;
+        out.reserve(PREAMBLE_SIZE + encodedHeader.size() + turns.size());
+        out += MAGIC;
+        out += static_cast<char>(VERSION);
+        out += static_cast<char>(encoding);
+        const auto headerSize = static_cast<uint32_t>(encodedHeader.size());
+        for (int shift = 0; shift < 32; shift += 8)
+            out += static_cast<char>((headerSize >> shift) & 0xFFu);
+        out += encodedHeader;
+        out += turns;
+        return out;
+    }
+
+    bool SessionCodec::isBinary(std::string_view data)
+    {
+        return data.size() >= PREAMBLE_SIZE && data.substr(0, MAGIC.size()) == MAGIC;
+    }
+
+    std::optional<ChatSessionSnapshot> SessionCodec::decode(std::shared_ptr<const std::string> data, nlohmann::json* attributes,
+                                                            std::shared_ptr<IBlobStore> blobs)
+    {
+        if (!data || !isBinary(*data))
+            return std::nullopt;
+
+        const std::string& bytes = *data;
+        const auto version = static_cast<uint8_t>(bytes[4]);
+        const auto encoding = static_cast<SessionEncoding>(bytes[5]);
+        if (version != VERSION || (encoding != SessionEncoding::MessagePack && encoding != SessionEncoding::Cbor))
+        {
+            GEMINI_ERROR("Unsupported session container (version {}, encoding {})", version, static_cast<int>(encoding));
+            return std::nullopt;
+        }
+
+        uint32_t headerSize = 0;
+        for (int i = 0; i < 4; ++i)
+            headerSize |= static_cast<uint32_t>(static_cast<uint8_t>(bytes[6 + i])) << (8 * i);
+        if (headerSize > bytes.size() - PREAMBLE_SIZE)
+            return std::nullopt;
+
+        try
+        {
+            const char* headerBegin = bytes.data() + PREAMBLE_SIZE;
+            const nlohmann::json header = parseEncoded(headerBegin, headerBegin + headerSize, encoding);
+
+            ChatSessionSnapshot snapshot;
+            snapshot.id = header.value("id", "");
+            snapshot.name = header.value("name", "");
+            snapshot.model = header.value("model", "gemini-2.5-flash");
+            snapshot.systemInstruction = header.value("systemInstruction", "");
+            snapshot.turnTokens = header.value("turnTokens", std::vector<int>{});
+            if (header.contains("summary"))
+                snapshot.summary = HistorySummary::fromJson(header["summary"]);
+            snapshot.parentId = header.value("parentId", "");
+            snapshot.forkPoints = header.value("forkPoints", std::vector<size_t>{});
+            if (attributes)
+                *attributes = header.value("attributes", nlohmann::json::object());
+
+            const size_t turnsBegin = PREAMBLE_SIZE + headerSize;
+            const size_t turnsSize = bytes.size() - turnsBegin;
+            for (const auto& entry : header.at("turns"))
+            {
+                const auto offset = entry.at(0).get<size_t>();
+                const auto length = entry.at(1).get<size_t>();
+                const auto jsonSize = entry.at(2).get<size_t>();
+                if (offset > turnsSize || length > turnsSize - offset)
+                    return std::nullopt;
+
+                snapshot.history.push_back_lazy(jsonSize, [data, first = turnsBegin + offset, length, encoding, blobs]() {
+                    nlohmann::json turn = parseEncoded(data->data() + first, data->data() + first + length, encoding);
+                    if (blobs ? !BlobOffload::rehydrate(turn, *blobs) : BlobOffload::hasReferences(turn))
+                        throw History::IncompleteTurn("a blob referenced by the turn cannot be read", std::move(turn));
+                    return turn;
+                });
+            }
+            return snapshot;
+        }
+        catch (const std::exception& e)
+        {
+            GEMINI_ERROR("Cannot decode session header: {}", e.what());
+            return std::nullopt;
+        }
+    }
+}
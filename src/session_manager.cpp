@@ -0,0 +1,377 @@
+﻿#include "gemini/session_manager.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "gemini/logger.h"
+
+namespace GeminiCPP
+{
+    SessionManager::SessionManager(Client* client, SessionManagerOptions options)
+        : client_(client), options_(std::move(options)),
+          shardCount_(options_.shards > 0 ? options_.shards : 4 * std::max(1u, std::thread::hardware_concurrency())),
+          shards_(std::make_unique<Shard[]>(shardCount_))
+    {
+        if (options_.storage)
+            sweeper_ = std::thread([this]() { run(); });
+    }
+
+    SessionManager::~SessionManager()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sweepMutex_);
+            stopping_ = true;
+        }
+        sweepCv_.notify_all();
+        if (sweeper_.joinable())
+            sweeper_.join();
+
+        if (options_.storage && !saveAll())
+            GEMINI_ERROR("SessionManager: some live sessions could not be saved on shutdown");
+    }
+
+    SessionManager::Shard& SessionManager::shardFor(const std::string& sessionId) const
+    {
+        return shards_[std::hash<std::string>{}(sessionId) % shardCount_];
+    }
+
+    size_t SessionManager::sessionBytes(const ChatSession& session)
+    {
+        return sizeof(ChatSession) + session.historySnapshot().jsonBytes();
+    }
+
+    std::shared_ptr<ChatSession> SessionManager::create(std::string_view model, std::string sessionName, std::string sessionId)
+    {
+        auto session = std::make_shared<ChatSession>(client_, model, std::move(sessionName), std::move(sessionId));
+        const std::string id = session->getId();
+        const size_t bytes = sessionBytes(*session);
+
+        Shard& shard = shardFor(id);
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto [it, inserted] = shard.sessions.try_emplace(id);
+            it->second.lastAccess = Clock::now();
+            ++it->second.accesses;
+            if (!inserted)
+                return it->second.session;
+
+            it->second.session = session;
+            it->second.bytes = bytes;
+        }
+
+        ++sessions_;
+        if ((bytes_ += bytes) > options_.memoryBudget)
+            sweepCv_.notify_one();
+        return session;
+    }
+
+    Result<std::shared_ptr<ChatSession>> SessionManager::get(const std::string& sessionId)
+    {
+        Shard& shard = shardFor(sessionId);
+        std::promise<LoadResult> promise;
+        std::shared_future<LoadResult> pending;
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            if (const auto it = shard.sessions.find(sessionId); it != shard.sessions.end())
+            {
+                it->second.lastAccess = Clock::now();
+                ++it->second.accesses;
+                ++hits_;
+                return LoadResult::Success(it->second.session);
+            }
+
+            if (const auto it = shard.loading.find(sessionId); it != shard.loading.end())
+            {
+                ++coalescedLoads_;
+                pending = it->second;
+            }
+            else
+            {
+                shard.loading.emplace(sessionId, promise.get_future().share());
+            }
+        }
+
+        if (pending.valid())
+            return pending.get();
+
+        LoadResult result = rehydrate(sessionId);
+        promise.set_value(result);
+        return result;
+    }
+
+    SessionManager::LoadResult SessionManager::rehydrate(const std::string& sessionId)
+    {
+        LoadResult result;
+        if (!options_.storage)
+        {
+            result = LoadResult::Failure("Session not found: " + sessionId, frenum::value(HttpMappedStatusCode::NOT_FOUND));
+        }
+        else
+        {
+            try
+            {
+                Result<ChatSession> loaded = options_.storage->load(sessionId, client_);
+                result = loaded
+                    ? LoadResult::Success(std::make_shared<ChatSession>(*loaded.value))
+                    : LoadResult::Failure(loaded.errorMessage, frenum::value(loaded.statusCode));
+            }
+            catch (const std::exception& e)
+            {
+                result = LoadResult::Failure(std::string("Load Error: ") + e.what());
+            }
+        }
+
+        Shard& shard = shardFor(sessionId);
+        size_t bytes = 0;
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.loading.erase(sessionId);
+            if (!result)
+                return result;
+
+            // create() may have made the session live meanwhile; that one wins.
+            auto [it, inserted] = shard.sessions.try_emplace(sessionId);
+            it->second.lastAccess = Clock::now();
+            ++it->second.accesses;
+            if (!inserted)
+                return LoadResult::Success(it->second.session);
+
+            bytes = sessionBytes(**result.value);
+            it->second.session = *result.value;
+            it->second.bytes = bytes;
+        }
+
+        ++sessions_;
+        ++rehydrations_;
+        if ((bytes_ += bytes) > options_.memoryBudget)
+            sweepCv_.notify_one();
+        return result;
+    }
+
+    bool SessionManager::contains(const std::string& sessionId) const
+    {
+        Shard& shard = shardFor(sessionId);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.sessions.contains(sessionId);
+    }
+
+    bool SessionManager::remove(const std::string& sessionId)
+    {
+        Shard& shard = shardFor(sessionId);
+        std::shared_ptr<ChatSession> removed; // Released after the shard lock.
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        const auto it = shard.sessions.find(sessionId);
+        if (it == shard.sessions.end())
+            return false;
+
+        removed = std::move(it->second.session);
+        bytes_ -= it->second.bytes;
+        --sessions_;
+        shard.sessions.erase(it);
+        return true;
+    }
+
+    bool SessionManager::evict(Shard& shard, const std::string& sessionId, uint64_t accesses)
+    {
+        std::shared_ptr<ChatSession> session;
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            const auto it = shard.sessions.find(sessionId);
+            if (it == shard.sessions.end() || it->second.evicting || it->second.accesses != accesses
+                || it->second.session.use_count() != 1)
+                return false;
+
+            // Async turns hold the session by reference, not by pointer.
+            const SerialExecutorStats turns = it->second.session->turnQueueStats();
+            if (turns.running || turns.queued > 0)
+                return false;
+
+            it->second.evicting = true;
+            session = it->second.session;
+        }
+
+        bool saved = false;
+        try
+        {
+            saved = options_.storage->save(*session);
+        }
+        catch (const std::exception& e)
+        {
+            GEMINI_ERROR("SessionManager: could not save '{}' for eviction: {}", sessionId, e.what());
+        }
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        const auto it = shard.sessions.find(sessionId);
+        if (it == shard.sessions.end() || it->second.session != session)
+            return false; // Removed meanwhile.
+
+        it->second.evicting = false;
+        if (!saved)
+        {
+            ++evictionFailures_;
+            return false;
+        }
+
+        // Used while it was being saved: the saved copy may already be stale, keep the live one.
+        if (it->second.accesses != accesses || session.use_count() != 2)
+            return false;
+
+        bytes_ -= it->second.bytes;
+        --sessions_;
+        ++evictions_;
+        shard.sessions.erase(it);
+        return true;
+    }
+
+    size_t SessionManager::evictIdle()
+    {
+        std::lock_guard<std::mutex> lock(sweepMutex_);
+        return sweep();
+    }
+
+    size_t SessionManager::sweep()
+    {
+        struct Candidate
+        {
+            Clock::time_point lastAccess;
+            Shard* shard;
+            std::string id;
+            uint64_t accesses;
+        };
+
+        const bool expire = options_.idleTimeout.count() > 0;
+        std::vector<Candidate> candidates;
+
+        for (size_t i = 0; i < shardCount_; ++i)
+        {
+            Shard& shard = shards_[i];
+
+            // Measure outside the shard lock: it takes each session's own lock.
+            std::vector<std::pair<std::string, std::shared_ptr<ChatSession>>> live;
+            {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                live.reserve(shard.sessions.size());
+                for (const auto& [id, entry] : shard.sessions)
+                    live.emplace_back(id, entry.session);
+            }
+
+            std::vector<size_t> sizes(live.size());
+            for (size_t j = 0; j < live.size(); ++j)
+            {
+                sizes[j] = sessionBytes(*live[j].second);
+                live[j].second.reset(); // So that use_count() below only counts outside holders.
+            }
+
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            for (size_t j = 0; j < live.size(); ++j)
+            {
+                const auto it = shard.sessions.find(live[j].first);
+                if (it == shard.sessions.end())
+                    continue;
+
+                bytes_ += sizes[j];
+                bytes_ -= it->second.bytes;
+                it->second.bytes = sizes[j];
+
+                if (!it->second.evicting && it->second.session.use_count() == 1)
+                    candidates.push_back(Candidate{it->second.lastAccess, &shard, it->first, it->second.accesses});
+            }
+        }
+
+        if (bytes_ <= options_.memoryBudget && !expire)
+            return 0;
+
+        std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+            return a.lastAccess < b.lastAccess;
+        });
+
+        const auto now = Clock::now();
+        size_t evicted = 0;
+        for (const auto& candidate : candidates)
+        {
+            const bool expired = expire && now - candidate.lastAccess >= options_.idleTimeout;
+            if (!expired && bytes_ <= options_.memoryBudget)
+                break; // Oldest first: the rest are neither expired nor needed.
+
+            if (evict(*candidate.shard, candidate.id, candidate.accesses))
+                ++evicted;
+        }
+
+        if (evicted > 0)
+            GEMINI_DEBUG("SessionManager: evicted {} idle sessions ({} live, {} bytes)", evicted, sessions_.load(), bytes_.load());
+        return evicted;
+    }
+
+    void SessionManager::run()
+    {
+        std::unique_lock<std::mutex> lock(sweepMutex_);
+        while (!stopping_)
+        {
+            sweepCv_.wait_for(lock, options_.sweepInterval, [this]() {
+                return stopping_ || bytes_ > options_.memoryBudget;
+            });
+            if (stopping_)
+                break;
+
+            sweep();
+
+            // Over budget with nothing left to evict (everything in use): wait for the next interval.
+            if (bytes_ > options_.memoryBudget)
+                sweepCv_.wait_for(lock, options_.sweepInterval, [this]() { return stopping_; });
+        }
+    }
+
+    bool SessionManager::saveAll()
+    {
+        if (!options_.storage)
+            return false;
+
+        bool ok = true;
+        for (size_t i = 0; i < shardCount_; ++i)
+        {
+            std::vector<std::shared_ptr<ChatSession>> live;
+            {
+                std::lock_guard<std::mutex> lock(shards_[i].mutex);
+                for (const auto& [id, entry] : shards_[i].sessions)
+                    live.push_back(entry.session);
+            }
+
+            for (const auto& session : live)
+            {
+                try
+                {
+                    ok = options_.storage->save(*session) && ok;
+                }
+                catch (const std::exception& e)
+                {
+                    GEMINI_ERROR("SessionManager: could not save '{}': {}", session->getId(), e.what());
+                    ok = false;
+                }
+            }
+        }
+        return ok;
+    }
+
+    size_t SessionManager::size() const
+    {
+        return sessions_;
+    }
+
+    size_t SessionManager::memoryBytes() const
+    {
+        return bytes_;
+    }
+
+    SessionManagerStats SessionManager::stats() const
+    {
+        SessionManagerStats stats;
+        stats.sessions = sessions_;
+        stats.bytes = bytes_;
+        stats.hits = hits_;
+        stats.rehydrations = rehydrations_;
+        stats.coalescedLoads = coalescedLoads_;
+        stats.evictions = evictions_;
+        stats.evictionFailures = evictionFailures_;
+        return stats;
+    }
+}
@@ -1,8 +1,14 @@
 ﻿#include "gemini/storage.h"
 
+#include <algorithm>
 #include <fstream>
 #include <cpr/cpr.h>
+#include "gemini/internal/file_utils.h"
+#include "gemini/internal/gzip.h"
+#include "gemini/internal/io_engine.h"
+#include "gemini/internal/journal.h"
 #include "gemini/logger.h"
+#include "gemini/session_codec.h"
 #include "gemini/http_mapped_status_code.h"
 #include "gemini/utils.h"
 
@@ -10,46 +16,598 @@ using namespace std::string_literals;
 
 namespace GeminiCPP
 {
-    LocalStorage::LocalStorage(std::string rootPath)
-        : rootPath_(std::move(rootPath))
+    namespace
+    {
+        nlohmann::json sessionMeta(const ChatSessionSnapshot& snapshot)
+        {
+            return {
+                {"name", snapshot.name},
+                {"model", snapshot.model},
+                {"systemInstruction", snapshot.systemInstruction},
+                {"summary", snapshot.summary.empty() ? nlohmann::json() : snapshot.summary.toJson()}
+            };
+        }
+
+        // Appends the cached JSON of a turn, with its large inline payloads offloaded to the blob store.
+        void appendTurnJson(std::string& out, std::string_view json, const BlobOffloadPolicy& blobs)
+        {
+            if (blobs.enabled() && json.size() >= blobs.minBytes && json.find("\"inlineData\"") != std::string_view::npos)
+            {
+                nlohmann::json turn = nlohmann::json::parse(json);
+                if (BlobOffload::offload(turn, blobs))
+                {
+                    out += turn.dump();
+                    return;
+                }
+            }
+            out += json;
+        }
+
+        // Like ChatSessionSnapshot::fromJson(), but turns referencing blobs are rehydrated lazily.
+        ChatSessionSnapshot snapshotFromJson(nlohmann::json j, const std::shared_ptr<IBlobStore>& blobs)
+        {
+            nlohmann::json history = nlohmann::json::array();
+            if (const auto it = j.find("history"); it != j.end())
+            {
+                history = std::move(*it);
+                j.erase(it);
+            }
+
+            ChatSessionSnapshot snapshot = ChatSessionSnapshot::fromJson(j);
+            for (auto& turn : history)
+                BlobOffload::appendTurn(snapshot.history, std::move(turn), blobs);
+            return snapshot;
+        }
+
+        // Serializes like ChatSessionSnapshot::toJson().dump(), but splices in the cached JSON of the turns.
+        std::string dumpSnapshot(const ChatSessionSnapshot& snapshot, const nlohmann::json& attributes, const BlobOffloadPolicy& blobs)
+        {
+            nlohmann::json j;
+            j["id"] = snapshot.id;
+            j["name"] = snapshot.name;
+            j["model"] = snapshot.model;
+            j["systemInstruction"] = snapshot.systemInstruction;
+            j["turnTokens"] = snapshot.turnTokens;
+            if (!snapshot.summary.empty())
+                j["summary"] = snapshot.summary.toJson();
+            if (!snapshot.parentId.empty())
+                j["parentId"] = snapshot.parentId;
+            if (!snapshot.forkPoints.empty())
+                j["forkPoints"] = snapshot.forkPoints;
+            for (const auto& [key, value] : attributes.items())
+                j[key] = value;
+
+            const std::string rest = j.dump();
+            std::string out;
+            out.reserve(snapshot.history.jsonBytes() + snapshot.history.size() + rest.size() + 16);
+            out += "{\"history\":[";
+            if (blobs.enabled())
+            {
+                const auto turns = snapshot.history.jsonSince(0);
+                for (size_t i = 0; i < turns.size(); ++i)
+                {
+                    if (i > 0)
+                        out += ',';
+                    appendTurnJson(out, turns[i], blobs);
+                }
+            }
+            else
+            {
+                snapshot.history.appendJson(out);
+            }
+            out += "],";
+            out.append(rest, 1, std::string::npos);
+            return out;
+        }
+
+        // Fork points that can be stored as shared prefixes: increasing and within the history.
+        bool hasSharedPrefix(const ChatSessionSnapshot& snapshot)
+        {
+            return !snapshot.forkPoints.empty() && snapshot.forkPoints.front() > 0 && snapshot.forkPoints.back() <= snapshot.history.size() &&
+                std::adjacent_find(snapshot.forkPoints.begin(), snapshot.forkPoints.end(), std::greater_equal<>()) == snapshot.forkPoints.end();
+        }
+
+        constexpr size_t kMaxSharedPrefixes = 1024;
+
+        /**
+         * @brief Applies the journal records on top of a snapshot.
+         * @return The number of records applied (including the header), or 0 if the journal belongs to another snapshot.
+         */
+        size_t replayJournal(ChatSessionSnapshot& snapshot, const Internal::JournalContents& journal, uint64_t generation,
+                             const std::string& sessionId, const std::shared_ptr<IBlobStore>& blobs)
+        {
+            if (journal.records.empty())
+                return 0;
+
+            const auto header = nlohmann::json::parse(journal.records.front(), nullptr, false);
+            if (header.is_discarded() || header.value("generation", uint64_t{0}) != generation)
+                return 0;
+
+            size_t applied = 1;
+            for (size_t r = 1; r < journal.records.size(); ++r)
+            {
+                const std::string& payload = journal.records[r];
+                auto record = nlohmann::json::parse(payload, nullptr, false);
+                if (record.is_discarded() || record.value("base", size_t{0}) != snapshot.history.size())
+                {
+                    GEMINI_WARN("Journal of session {} is inconsistent at record {}, ignoring the rest", sessionId, r);
+                    break;
+                }
+
+                if (const auto turns = record.find("turns"); turns != record.end())
+                {
+                    for (auto& turn : *turns)
+                        BlobOffload::appendTurn(snapshot.history, std::move(turn), blobs);
+                }
+                snapshot.turnTokens.resize(snapshot.history.size(), 0);
+
+                if (const auto changed = record.find("tokens"); changed != record.end())
+                {
+                    for (const auto& entry : *changed)
+                    {
+                        const auto index = entry.at(0).get<size_t>();
+                        if (index < snapshot.turnTokens.size())
+                            snapshot.turnTokens[index] = entry.at(1).get<int>();
+                    }
+                }
+
+                if (const auto meta = record.find("meta"); meta != record.end())
+                {
+                    snapshot.name = meta->value("name", snapshot.name);
+                    snapshot.model = meta->value("model", snapshot.model);
+                    snapshot.systemInstruction = meta->value("systemInstruction", snapshot.systemInstruction);
+                    const auto summary = meta->find("summary");
+                    snapshot.summary = summary == meta->end() || summary->is_null() ? HistorySummary{} : HistorySummary::fromJson(*summary);
+                }
+
+                ++applied;
+            }
+            return applied;
+        }
+    }
+
+    LocalStorage::LocalStorage(std::string rootPath, LocalStorageOptions options)
+        : rootPath_(std::move(rootPath)), options_(std::move(options)),
+          catalog_(std::filesystem::path(rootPath_) / ".catalog", false) // Synced once per batch by drain().
     {
         if (!std::filesystem::exists(rootPath_)) {
             std::filesystem::create_directories(rootPath_);
         }
+
+        if (catalog_.open())
+            reconcileCatalog();
+        rebuildCatalog();
+    }
+
+    void LocalStorage::reconcileCatalog()
+    {
+        const auto sessions = catalog_.unfinished();
+        if (sessions.empty())
+            return;
+
+        // Loading re-indexes a session whose catalog record was lost; one that was never written fails to load.
+        GEMINI_INFO("Re-indexing {} sessions of {} whose last save was interrupted", sessions.size(), rootPath_);
+        for (const auto& id : sessions)
+            (void)load(id, nullptr);
+        catalog_.clearUnfinished();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& id : sessions)
+            journals_.erase(id);
+    }
+
+    void LocalStorage::rebuildCatalog()
+    {
+        // Only file names are listed; sessions already in the catalog are not opened.
+        std::vector<std::string> sessions;
+        for (const auto& entry : std::filesystem::directory_iterator(rootPath_))
+        {
+            if (entry.path().extension() == ".json" || entry.path().extension() == ".session")
+            {
+                std::string id = entry.path().stem().string();
+                if (!catalog_.find(id))
+                    sessions.push_back(std::move(id));
+            }
+        }
+
+        // A session may briefly have snapshots in both formats after the encoding was changed.
+        std::sort(sessions.begin(), sessions.end());
+        sessions.erase(std::unique(sessions.begin(), sessions.end()), sessions.end());
+        if (sessions.empty())
+            return;
+
+        // Loading a session registers it in the catalog. Binary snapshots only decode their header.
+        if (catalog_.size() == 0)
+            GEMINI_INFO("Building the session catalog of {} ({} sessions)", rootPath_, sessions.size());
+        else
+            GEMINI_INFO("Indexing {} sessions of {} missing from its catalog", sessions.size(), rootPath_);
+        for (const auto& id : sessions)
+        {
+            if (!load(id, nullptr).success)
+                GEMINI_WARN("Cannot index session {}", id);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& id : sessions)
+            journals_.erase(id);
+    }
+
+    std::filesystem::path LocalStorage::snapshotPath(const std::string& sessionId, SessionEncoding encoding) const
+    {
+        return std::filesystem::path(rootPath_) / (sessionId + (encoding == SessionEncoding::Json ? ".json" : ".session"));
+    }
+
+    std::filesystem::path LocalStorage::journalPath(const std::string& sessionId) const
+    {
+        return std::filesystem::path(rootPath_) / (sessionId + ".journal");
     }
 
     bool LocalStorage::save(const ChatSession& session)
     {
-        try {
-            std::string filename = session.getId() + ".json";
-            std::filesystem::path path = std::filesystem::path(rootPath_) / filename;
-                
-            std::ofstream file(path);
-            if (file.is_open())
+        // Through the writer as well, so it cannot overtake (and later be overwritten by) a queued older save.
+        return saveAsync(session).get();
+    }
+
+    bool LocalStorage::persist(const ChatSessionSnapshot& snapshot, std::vector<Internal::FileAppend>& deferredAppends)
+    {
+        if (!writeSession(snapshot, deferredAppends))
+            return false;
+
+        // Same lock as the session write, so the catalog never lags behind a completed save of this process.
+        updateCatalog(snapshot, std::chrono::system_clock::now(), false);
+        return true;
+    }
+
+    void LocalStorage::updateCatalog(const ChatSessionSnapshot& snapshot, std::chrono::system_clock::time_point updatedAt, bool force)
+    {
+        SessionInfo info;
+        info.id = snapshot.id;
+        info.name = snapshot.name;
+        info.model = snapshot.model;
+        info.turnCount = snapshot.history.size();
+        info.updatedAt = updatedAt;
+
+        if (const auto it = journals_.find(snapshot.id); it != journals_.end())
+        {
+            // Includes journal records of this batch that are not appended yet.
+            info.bytes = it->second.snapshotBytes + it->second.journalBytes;
+        }
+        else
+        {
+            std::error_code ec;
+            for (const auto& path : {snapshotPath(snapshot.id, SessionEncoding::Json), snapshotPath(snapshot.id, SessionEncoding::MessagePack), journalPath(snapshot.id)})
             {
-                file << session.toJson().dump(4);
-                return true;
+                const auto size = std::filesystem::file_size(path, ec);
+                if (!ec)
+                    info.bytes += static_cast<size_t>(size);
             }
         }
-        catch (const std::exception& e)
+
+        if (!force)
         {
-            GEMINI_ERROR("LocalStorage Save Error: {}", e.what());
+            const auto current = catalog_.find(info.id);
+            if (current && current->name == info.name && current->model == info.model && current->turnCount == info.turnCount && current->bytes == info.bytes)
+                return;
         }
-        return false;
+        catalog_.upsert(info);
+    }
+
+    bool LocalStorage::writeSession(const ChatSessionSnapshot& snapshot, std::vector<Internal::FileAppend>& deferredAppends)
+    {
+        const auto it = journals_.find(snapshot.id);
+        if (it == journals_.end() || !snapshot.history.extends(it->second.history))
+            return writeSnapshot(snapshot);
+
+        JournalState& state = it->second;
+        const size_t base = state.history.size();
+        if (!snapshot.history.readable(base))
+        {
+            GEMINI_ERROR("Not saving session {}: a new history turn cannot be decoded", snapshot.id);
+            return false;
+        }
+
+        nlohmann::json tokens = nlohmann::json::array();
+        for (size_t i = 0; i < snapshot.turnTokens.size(); ++i)
+        {
+            const int previous = i < state.turnTokens.size() ? state.turnTokens[i] : 0;
+            if (snapshot.turnTokens[i] != previous)
+                tokens.push_back({i, snapshot.turnTokens[i]});
+        }
+
+        nlohmann::json meta = sessionMeta(snapshot);
+        const auto turns = snapshot.history.jsonSince(base);
+        const bool metaChanged = meta != state.meta;
+        if (turns.empty() && tokens.empty() && !metaChanged)
+            return true;
+
+        // One record per save, so a save is applied either completely or not at all.
+        std::string payload = "{\"base\":" + std::to_string(base);
+        if (!turns.empty())
+        {
+            payload += ",\"turns\":[";
+            for (size_t i = 0; i < turns.size(); ++i)
+            {
+                if (i > 0)
+                    payload += ',';
+                appendTurnJson(payload, turns[i], options_.blobs);
+            }
+            payload += ']';
+        }
+        if (!tokens.empty())
+            payload += ",\"tokens\":" + tokens.dump();
+        if (metaChanged)
+            payload += ",\"meta\":" + meta.dump();
+        payload += '}';
+
+        std::string record = Internal::encodeJournalRecord(payload);
+        const double limit = std::max(static_cast<double>(options_.minCompactionBytes), options_.compactionRatio * static_cast<double>(state.snapshotBytes));
+        if (static_cast<double>(state.journalBytes + record.size()) > limit)
+        {
+            // The new snapshot contains this save, so the record is not appended at all. An older turn that
+            // cannot be decoded would be lost by rewriting the snapshot: keep journaling instead.
+            if (snapshot.history.readable())
+            {
+                GEMINI_DEBUG("Compacting journal of session {} ({} bytes)", snapshot.id, state.journalBytes);
+                return writeSnapshot(snapshot);
+            }
+            GEMINI_WARN("Not compacting the journal of session {}: a history turn cannot be decoded", snapshot.id);
+        }
+
+        state.history = snapshot.history.mark();
+        state.turnTokens = snapshot.turnTokens;
+        state.meta = std::move(meta);
+        state.journalBytes += record.size();
+        deferredAppends.push_back({journalPath(snapshot.id), std::move(record)});
+        return true;
+    }
+
+    bool LocalStorage::writeSnapshot(const ChatSessionSnapshot& snapshot)
+    {
+        // Never replace stored turns with the placeholders of turns that could not be decoded.
+        if (!snapshot.history.readable())
+        {
+            GEMINI_ERROR("Not saving session {}: a history turn cannot be decoded", snapshot.id);
+            return false;
+        }
+
+        uint64_t generation;
+        const auto it = journals_.find(snapshot.id);
+        do {
+            generation = random_();
+        } while (generation == 0 || (it != journals_.end() && generation == it->second.generation));
+
+        // A forked session only writes the turns after its last fork; the shared ones are in the blob store.
+        nlohmann::json attributes = {{"journalGeneration", generation}};
+        std::optional<ChatSessionSnapshot> tail;
+        if (options_.blobs.enabled() && hasSharedPrefix(snapshot))
+        {
+            if (const auto key = storePrefix(snapshot, snapshot.forkPoints.size() - 1))
+            {
+                const size_t shared = snapshot.forkPoints.back();
+                tail = snapshot;
+                tail->history = History();
+                tail->history.append(snapshot.history, shared);
+                attributes["historyBase"] = {{"blobRef", *key}, {"turns", shared}};
+            }
+        }
+        const ChatSessionSnapshot& written = tail ? *tail : snapshot;
+
+        // The new journal only counts once the snapshot naming its generation is in place; a stale journal
+        // left behind by a crash in between carries the old generation and is ignored on load.
+        const std::string data = options_.encoding == SessionEncoding::Json
+            ? dumpSnapshot(written, attributes, options_.blobs)
+            : SessionCodec::encode(written, options_.encoding, attributes, options_.blobs);
+        if (!Internal::writeFileAtomic(snapshotPath(snapshot.id, options_.encoding), data, options_.durable))
+        {
+            journals_.erase(snapshot.id);
+            return false;
+        }
+
+        // A snapshot in the other format (written before the encoding was changed) is now stale.
+        std::error_code ec;
+        const auto other = options_.encoding == SessionEncoding::Json ? SessionEncoding::MessagePack : SessionEncoding::Json;
+        std::filesystem::remove(snapshotPath(snapshot.id, other), ec);
+
+        const std::string header = Internal::encodeJournalRecord(nlohmann::json{{"generation", generation}}.dump());
+        if (!Internal::writeFileAtomic(journalPath(snapshot.id), header, options_.durable))
+        {
+            GEMINI_WARN("Cannot reset journal of session {}, the next save writes a full snapshot", snapshot.id);
+            journals_.erase(snapshot.id);
+            return true;
+        }
+
+        JournalState& state = journals_[snapshot.id];
+        state.history = snapshot.history.mark();
+        state.turnTokens = snapshot.turnTokens;
+        state.meta = sessionMeta(snapshot);
+        state.generation = generation;
+        state.journalBytes = header.size();
+        state.snapshotBytes = data.size();
+        return true;
+    }
+
+    std::optional<std::string> LocalStorage::storePrefix(const ChatSessionSnapshot& snapshot, size_t forkIndex)
+    {
+        const size_t count = snapshot.forkPoints[forkIndex];
+        for (const SharedPrefix& prefix : sharedPrefixes_)
+        {
+            if (prefix.history.size() == count && snapshot.history.extends(prefix.history.mark()))
+                return prefix.key;
+        }
+
+        // Each prefix blob holds the turns since the previous fork point and references the blob before it.
+        std::optional<std::string> base;
+        size_t from = 0;
+        if (forkIndex > 0)
+        {
+            base = storePrefix(snapshot, forkIndex - 1);
+            if (!base)
+                return std::nullopt;
+            from = snapshot.forkPoints[forkIndex - 1];
+        }
+
+        const History prefix = snapshot.history.prefix(count);
+        std::string data = "{\"base\":" + (base ? nlohmann::json(*base).dump() : "null"s) + ",\"baseTurns\":" + std::to_string(from) + ",\"turns\":[";
+        const auto turns = prefix.jsonSince(from);
+        for (size_t i = 0; i < turns.size(); ++i)
+        {
+            if (i > 0)
+                data += ',';
+            appendTurnJson(data, turns[i], options_.blobs);
+        }
+        data += "]}";
+
+        auto key = options_.blobs.store->put(data);
+        if (!key)
+        {
+            GEMINI_WARN("Cannot store the shared history of session {}, writing it in full", snapshot.id);
+            return std::nullopt;
+        }
+        rememberPrefix(prefix, *key);
+        return key;
+    }
+
+    std::optional<History> LocalStorage::loadPrefix(const std::string& key)
+    {
+        // Sessions forked from the same point share the turns in memory too. The recent prefixes are held
+        // strongly: reviving a released one from a weak reference could race with its chain being unlinked.
+        for (const SharedPrefix& prefix : sharedPrefixes_)
+        {
+            if (prefix.key == key)
+                return prefix.history;
+        }
+
+        if (!options_.blobs.store)
+            return std::nullopt;
+        const auto data = options_.blobs.store->get(key);
+        if (!data)
+            return std::nullopt;
+        auto j = nlohmann::json::parse(*data, nullptr, false);
+        if (j.is_discarded() || !j.is_object())
+            return std::nullopt;
+
+        History history;
+        if (const auto base = j.find("base"); base != j.end() && base->is_string())
+        {
+            auto loaded = loadPrefix(base->get<std::string>());
+            if (!loaded || loaded->size() != j.value("baseTurns", size_t{0}))
+                return std::nullopt;
+            history = std::move(*loaded);
+        }
+        if (const auto turns = j.find("turns"); turns != j.end() && turns->is_array())
+        {
+            for (auto& turn : *turns)
+                BlobOffload::appendTurn(history, std::move(turn), options_.blobs.store);
+        }
+        rememberPrefix(history, key);
+        return history;
+    }
+
+    void LocalStorage::rememberPrefix(const History& prefix, const std::string& key)
+    {
+        std::erase_if(sharedPrefixes_, [&key](const SharedPrefix& entry) { return entry.key == key; });
+        sharedPrefixes_.push_back({prefix, key});
+        if (sharedPrefixes_.size() > kMaxSharedPrefixes)
+            sharedPrefixes_.pop_front();
     }
 
     Result<ChatSession> LocalStorage::load(const std::string& sessionId, Client* client)
     {
         try
         {
-            std::filesystem::path path = std::filesystem::path(rootPath_) / (sessionId + ".json");
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            std::filesystem::path path = snapshotPath(sessionId, options_.encoding);
             if (!std::filesystem::exists(path))
-                return Result<ChatSession>::Failure("Session file not found: " + path.string(), frenum::value(HttpMappedStatusCode::OK));
+            {
+                const auto other = options_.encoding == SessionEncoding::Json ? SessionEncoding::MessagePack : SessionEncoding::Json;
+                if (!std::filesystem::exists(snapshotPath(sessionId, other)))
+                    return Result<ChatSession>::Failure("Session file not found: " + path.string(), frenum::value(HttpMappedStatusCode::OK));
+                path = snapshotPath(sessionId, other);
+            }
 
-            std::ifstream file(path);
-            nlohmann::json j;
-            file >> j;
-            return Result<ChatSession>::Success(ChatSession::fromJson(client, j));
+            auto file = Internal::readFile(path);
+            if (!file)
+                return Result<ChatSession>::Failure("Cannot read session file: " + path.string());
+            const auto data = std::make_shared<const std::string>(std::move(*file));
+
+            // Binary snapshots only decode their header here; turns are decoded when first used.
+            ChatSessionSnapshot snapshot;
+            uint64_t generation = 0;
+            nlohmann::json historyBase;
+            if (SessionCodec::isBinary(*data))
+            {
+                nlohmann::json attributes;
+                auto decoded = SessionCodec::decode(data, &attributes, options_.blobs.store);
+                if (!decoded)
+                    return Result<ChatSession>::Failure("Corrupt session file: " + path.string());
+                snapshot = std::move(*decoded);
+                generation = attributes.value("journalGeneration", uint64_t{0});
+                historyBase = attributes.value("historyBase", nlohmann::json());
+            }
+            else
+            {
+                nlohmann::json j = nlohmann::json::parse(*data);
+                generation = j.value("journalGeneration", uint64_t{0});
+                if (const auto it = j.find("historyBase"); it != j.end())
+                    historyBase = *it;
+                snapshot = snapshotFromJson(std::move(j), options_.blobs.store);
+            }
+
+            // A forked session's snapshot only holds the turns after its last fork.
+            if (historyBase.is_object())
+            {
+                const std::string key = historyBase.value("blobRef", "");
+                auto prefix = loadPrefix(key);
+                if (!prefix || prefix->size() != historyBase.value("turns", size_t{0}))
+                    return Result<ChatSession>::Failure("Shared history " + key + " of session " + sessionId + " is missing from the blob store");
+                prefix->append(snapshot.history);
+                snapshot.history = std::move(*prefix);
+            }
+
+            const auto journal = Internal::readJournal(journalPath(sessionId));
+            const size_t applied = replayJournal(snapshot, journal, generation, sessionId, options_.blobs.store);
+            const size_t appliedBytes = applied > 0 ? journal.recordEnds[applied - 1] : 0;
+            if (applied > 0 && (journal.torn || applied < journal.records.size()))
+            {
+                // Appending after a torn record would hide every later save, so cut it off now.
+                GEMINI_WARN("Discarding the incomplete end of the journal of session {}", sessionId);
+                std::filesystem::resize_file(journalPath(sessionId), appliedBytes);
+            }
+
+            ChatSession session = ChatSession::fromSnapshot(client, std::move(snapshot));
+            const ChatSessionSnapshot loaded = session.snapshot();
+
+            // Repairs the catalog after a crash between a session write and its catalog update.
+            const auto entry = catalog_.find(sessionId);
+            if (!entry || entry->turnCount != loaded.history.size() || entry->name != loaded.name || entry->model != loaded.model)
+            {
+                std::error_code ec;
+                auto modified = std::filesystem::last_write_time(path, ec);
+                const auto journalModified = std::filesystem::last_write_time(journalPath(sessionId), ec);
+                if (!ec && journalModified > modified)
+                    modified = journalModified;
+                const auto updatedAt = std::chrono::system_clock::now() + std::chrono::duration_cast<std::chrono::system_clock::duration>(modified - std::filesystem::file_time_type::clock::now());
+                updateCatalog(loaded, updatedAt, true);
+            }
+
+            if (applied > 0)
+            {
+                JournalState& state = journals_[sessionId];
+                state.history = loaded.history.mark();
+                state.turnTokens = loaded.turnTokens;
+                state.meta = sessionMeta(loaded);
+                state.generation = generation;
+                state.journalBytes = appliedBytes;
+                state.snapshotBytes = data->size();
+            }
+            else
+            {
+                // No usable journal (e.g. a file written before journaling): the next save writes a snapshot.
+                journals_.erase(sessionId);
+            }
+
+            return Result<ChatSession>::Success(std::move(session));
         }
         catch (const std::exception& e)
         {
@@ -59,45 +617,143 @@ namespace GeminiCPP
 
     std::vector<std::string> LocalStorage::listSessions()
     {
-        std::vector<std::string> sessions;
-        if (!std::filesystem::exists(rootPath_)) return sessions;
+        catalog_.refresh(); // Picks up sessions saved by other instances sharing the root.
+        return catalog_.ids();
+    }
 
-        for (const auto& entry : std::filesystem::directory_iterator(rootPath_))
+    SessionPage LocalStorage::querySessions(const SessionQuery& query) const
+    {
+        catalog_.refresh();
+        return catalog_.query(query);
+    }
+
+    std::optional<SessionInfo> LocalStorage::sessionInfo(const std::string& sessionId) const
+    {
+        catalog_.refresh();
+        return catalog_.find(sessionId);
+    }
+
+    std::future<bool> LocalStorage::saveAsync(const ChatSession& session)
+    {
+        // The snapshot shares the session's history, so taking it is cheap. A newer snapshot of the same
+        // session replaces the pending one: it contains every change the older one had.
+        ChatSessionSnapshot snapshot = session.snapshot();
+        std::promise<bool> promise;
+        auto future = promise.get_future();
+
+        std::lock_guard<std::mutex> lock(pendingMutex_);
+        ++submitted_;
+        if (const auto it = pendingSlots_.find(snapshot.id); it != pendingSlots_.end())
         {
-            if (entry.path().extension() == ".json")
-            {
-                sessions.push_back(entry.path().stem().string());
-            }
+            PendingSave& slot = pending_[it->second];
+            slot.snapshot = std::move(snapshot);
+            slot.done.push_back(std::move(promise));
+            return future;
         }
-        return sessions;
+
+        pendingSlots_.emplace(snapshot.id, pending_.size());
+        PendingSave slot{std::move(snapshot), {}};
+        slot.done.push_back(std::move(promise));
+        pending_.push_back(std::move(slot));
+
+        if (!draining_)
+        {
+            draining_ = true;
+            static_cast<void>(writer_.submit([this]() { drain(); }));
+        }
+        return future;
     }
 
-    std::future<bool> LocalStorage::saveAsync(const ChatSession& session)
+    void LocalStorage::drain()
     {
-        // Copying the session can be expensive, so instead of a const reference,
-        // it might make more sense to retrieve and pass the JSON output.
-        // However, since the session.toJson() call is thread-safe,
-        // we can call it here and pass the string data to the lambda.
-        
-        nlohmann::json data = session.toJson();
-        std::string id = session.getId();
+        while (true)
+        {
+            std::vector<PendingSave> batch;
+            {
+                std::lock_guard<std::mutex> lock(pendingMutex_);
+                if (pending_.empty())
+                {
+                    draining_ = false;
+                    return;
+                }
+                batch = std::move(pending_);
+                pending_.clear();
+                pendingSlots_.clear();
+            }
 
-        return std::async(std::launch::async, [this, id, data = std::move(data)]() {
-            try
+            // Group commit: every journal record of the batch, and their syncs, are submitted together.
+            // The appends run under the lock too, so a concurrent load() never reads a journal mid-batch.
+            std::vector<bool> results(batch.size(), false);
             {
-                std::string filename = id + ".json";
-                std::filesystem::path path = std::filesystem::path(rootPath_) / filename;
-                std::ofstream file(path);
-                if (file.is_open()) {
-                    file << data.dump(4);
-                    return true;
+                std::lock_guard<std::mutex> lock(mutex_);
+
+                // Announced before any session file changes, so a crash in the middle cannot leave a written
+                // session without its catalog record (see reconcileCatalog()).
+                std::vector<std::string> ids;
+                ids.reserve(batch.size());
+                for (const auto& save : batch)
+                    ids.push_back(save.snapshot.id);
+                const uint64_t catalogBatch = catalog_.beginBatch(ids, options_.durable);
+
+                std::vector<Internal::FileAppend> appends;
+                std::vector<size_t> owners; // Batch index of each append.
+                for (size_t i = 0; i < batch.size(); ++i)
+                {
+                    try
+                    {
+                        results[i] = persist(batch[i].snapshot, appends);
+                    }
+                    catch (const std::exception& e)
+                    {
+                        GEMINI_ERROR("LocalStorage Save Error: {}", e.what());
+                    }
+                    owners.resize(appends.size(), i);
+                }
+
+                const auto catalogPath = std::filesystem::path(rootPath_) / ".catalog";
+                const bool syncCatalog = options_.durable && std::filesystem::exists(catalogPath);
+                if (syncCatalog)
+                    appends.push_back({catalogPath, {}});
+
+                const std::vector<bool> written = Internal::IoEngine::instance().appendBatch(appends, options_.durable);
+                for (size_t a = 0; a < owners.size(); ++a)
+                {
+                    if (!written[a])
+                    {
+                        // The journal may now end in a partial record; start over with a snapshot next time.
+                        results[owners[a]] = false;
+                        journals_.erase(batch[owners[a]].snapshot.id);
+                    }
                 }
-            } catch (const std::exception& e)
+                if (syncCatalog && !written.back())
+                    GEMINI_WARN("Cannot sync the session catalog of {}", rootPath_);
+                else
+                    catalog_.endBatch(catalogBatch);
+            }
+
+            uint64_t completed = 0;
+            for (size_t i = 0; i < batch.size(); ++i)
             {
-                GEMINI_ERROR("LocalStorage Save Error: {}", e.what());
+                for (auto& done : batch[i].done)
+                {
+                    done.set_value(results[i]);
+                    ++completed;
+                }
             }
-            return false;
-        });
+
+            {
+                std::lock_guard<std::mutex> lock(pendingMutex_);
+                completed_ += completed;
+            }
+            flushed_.notify_all();
+        }
+    }
+
+    void LocalStorage::flush()
+    {
+        std::unique_lock<std::mutex> lock(pendingMutex_);
+        const uint64_t target = submitted_;
+        flushed_.wait(lock, [this, target]() { return completed_ >= target; });
     }
 
     std::future<Result<ChatSession>> LocalStorage::loadAsync(const std::string& sessionId, Client* client)
@@ -114,100 +770,282 @@ namespace GeminiCPP
         });
     }
 
-    std::future<bool> RemoteStorage::saveAsync(const ChatSession& session)
+    namespace
     {
-        nlohmann::json payload = session.toJson();
-        std::string id = session.getId();
+        enum class HttpMethod
+        {
+            Get,
+            Put,
+            Patch
+        };
 
-        return std::async(std::launch::async, [this, id, payload = std::move(payload)]() {
-            std::string url = baseUrl_ + "/chats/" + id;
+        std::string responseHeader(const cpr::Response& r, const std::string& name)
+        {
+            const auto it = r.header.find(name);
+            return it == r.header.end() ? std::string() : it->second;
+        }
+    }
 
-            cpr::Header headers = {{"Content-Type", "application/json"}};
-            if (!authToken_.empty()) {
-                headers.insert({"Authorization", "Bearer " + authToken_});
-            }
+    /**
+     * @brief Pool of idle HTTP sessions; each keeps its connection alive for the next request.
+     */
+    struct RemoteStorage::Connections
+    {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<cpr::Session>> idle;
 
-            cpr::Response r = cpr::Put(
-                cpr::Url{url},
-                headers,
-                cpr::Body{payload.dump()},
-                cpr::VerifySsl(false)
-            );
+        std::unique_ptr<cpr::Session> acquire()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (idle.empty())
+                return std::make_unique<cpr::Session>();
+            auto session = std::move(idle.back());
+            idle.pop_back();
+            return session;
+        }
 
-            if (HttpMappedStatusCodeHelper::isSuccess(r.status_code)) {
-                return true;
-            }
+        void release(std::unique_ptr<cpr::Session> session, size_t maxIdle)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (idle.size() < maxIdle)
+                idle.push_back(std::move(session));
+        }
+    };
 
-            GEMINI_ERROR("RemoteStorage Async Save Error [{}]: {}", r.status_code, Utils::parseErrorMessage(r.text));
-            return false;
-        });
+    RemoteStorage::RemoteStorage(std::string baseUrl, std::string authToken, RemoteStorageOptions options)
+        : baseUrl_(std::move(baseUrl)), authToken_(std::move(authToken)), options_(options),
+          connections_(std::make_unique<Connections>()),
+          uploader_(std::max<size_t>(1, options_.maxIdleConnections))
+    {
+        if (baseUrl_.back() == '/') baseUrl_.pop_back();
     }
 
-    std::future<Result<ChatSession>> RemoteStorage::loadAsync(const std::string& sessionId, Client* client)
+    RemoteStorage::~RemoteStorage() = default;
+
+    void RemoteStorage::setBlobOffload(BlobOffloadPolicy policy)
     {
-        return std::async(std::launch::async, [this, sessionId, client]() {
-            return load(sessionId, client);
-        });
+        blobs_ = std::move(policy);
     }
 
-    std::future<std::vector<std::string>> RemoteStorage::listSessionsAsync()
+    std::string RemoteStorage::serialize(const ChatSessionSnapshot& snapshot) const
     {
-        return std::async(std::launch::async, [this]() {
-            return listSessions();
-        });
+        nlohmann::json payload = snapshot.toJson();
+        if (blobs_.enabled())
+            BlobOffload::offload(payload["history"], blobs_);
+        return payload.dump();
     }
 
-    RemoteStorage::RemoteStorage(std::string baseUrl, std::string authToken)
-        : baseUrl_(std::move(baseUrl)), authToken_(std::move(authToken)) 
+    void RemoteStorage::remember(const std::string& etag, const ChatSessionSnapshot& snapshot)
     {
-        if (baseUrl_.back() == '/') baseUrl_.pop_back();
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (etag.empty())
+            synced_.erase(snapshot.id);
+        else
+            synced_[snapshot.id] = SyncedVersion{etag, snapshot};
+    }
+
+    namespace
+    {
+        // Sends one request through a pooled session, compressing the body if worthwhile.
+        cpr::Response sendRequest(cpr::Session& session, HttpMethod method, const std::string& url, cpr::Header headers,
+                                  const std::string& body, const RemoteStorageOptions& options, std::atomic<bool>& compressionRejected)
+        {
+            std::optional<std::string> compressed;
+            if (!body.empty() && options.compressRequests && !compressionRejected && body.size() >= options.compressionThreshold)
+                compressed = Internal::gzipCompress(body);
+
+            auto perform = [&](const std::string& payload, bool gzipped) {
+                cpr::Header requestHeaders = headers;
+                if (gzipped)
+                    requestHeaders["Content-Encoding"] = "gzip";
+
+                session.SetUrl(cpr::Url{url});
+                session.SetHeader(requestHeaders);
+                session.SetVerifySsl(cpr::VerifySsl(false));
+                session.SetTimeout(cpr::Timeout{options.timeout});
+                session.SetAcceptEncoding(cpr::AcceptEncoding{{cpr::AcceptEncodingMethods::gzip}});
+                if (method != HttpMethod::Get)
+                    session.SetBody(cpr::Body{payload});
+
+                switch (method)
+                {
+                case HttpMethod::Put:   return session.Put();
+                case HttpMethod::Patch: return session.Patch();
+                case HttpMethod::Get:
+                default:                return session.Get();
+                }
+            };
+
+            if (compressed)
+            {
+                cpr::Response r = perform(*compressed, true);
+                if (r.status_code != 415)
+                    return r;
+
+                GEMINI_WARN("Remote storage does not accept gzip request bodies, sending them uncompressed");
+                compressionRejected = true;
+            }
+            return perform(body, false);
+        }
     }
 
     bool RemoteStorage::save(const ChatSession& session)
     {
-        std::string url = baseUrl_ + "/chats";
-        nlohmann::json payload = session.toJson();
+        // Queued behind any upload of the same session, which would otherwise race it with the same If-Match.
+        return saveAsync(session).get();
+    }
+
+    bool RemoteStorage::upload(const ChatSessionSnapshot& snapshot)
+    {
+        if (!snapshot.history.readable())
+        {
+            GEMINI_ERROR("RemoteStorage Save Error: a history turn of session {} cannot be decoded", snapshot.id);
+            return false;
+        }
 
+        const std::string url = baseUrl_ + "/chats/" + snapshot.id;
         cpr::Header headers = {{"Content-Type", "application/json"}};
-        if(!authToken_.empty())
+        if (!authToken_.empty())
             headers.insert({"Authorization", "Bearer " + authToken_});
 
-        url += "/" + session.getId();
-            
-        cpr::Response r = cpr::Put(
-            cpr::Url{url},
-            headers,
-            cpr::Body{payload.dump()},
-            cpr::VerifySsl(false)
-        );
+        std::optional<SyncedVersion> synced;
+        if (options_.deltaSync)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (const auto it = synced_.find(snapshot.id); it != synced_.end())
+                synced = it->second;
+        }
+
+        auto connection = connections_->acquire();
+
+        // Delta: only what changed since the version the server has, applied if that is still its version.
+        if (synced && !patchUnsupported_ && snapshot.history.extends(synced->snapshot.history.mark()))
+        {
+            const size_t base = synced->snapshot.history.size();
+            nlohmann::json tokens = nlohmann::json::array();
+            for (size_t i = 0; i < snapshot.turnTokens.size(); ++i)
+            {
+                const int previous = i < synced->snapshot.turnTokens.size() ? synced->snapshot.turnTokens[i] : 0;
+                if (snapshot.turnTokens[i] != previous)
+                    tokens.push_back({i, snapshot.turnTokens[i]});
+            }
+
+            const nlohmann::json meta = sessionMeta(snapshot);
+            const bool metaChanged = meta != sessionMeta(synced->snapshot);
+            const auto turns = snapshot.history.jsonSince(base);
+            if (turns.empty() && tokens.empty() && !metaChanged)
+            {
+                connections_->release(std::move(connection), options_.maxIdleConnections);
+                return true;
+            }
+
+            std::string body = "{\"base\":" + std::to_string(base) + ",\"turns\":[";
+            for (size_t i = 0; i < turns.size(); ++i)
+            {
+                if (i > 0)
+                    body += ',';
+                appendTurnJson(body, turns[i], blobs_);
+            }
+            body += ']';
+            if (!tokens.empty())
+                body += ",\"tokens\":" + tokens.dump();
+            if (metaChanged)
+                body += ",\"meta\":" + meta.dump();
+            body += '}';
+
+            cpr::Header patchHeaders = headers;
+            patchHeaders["If-Match"] = synced->etag;
+            cpr::Response r = sendRequest(*connection, HttpMethod::Patch, url, patchHeaders, body, options_, compressionRejected_);
+            if (HttpMappedStatusCodeHelper::isSuccess(r.status_code))
+            {
+                connections_->release(std::move(connection), options_.maxIdleConnections);
+                remember(responseHeader(r, "ETag"), snapshot);
+                return true;
+            }
+
+            if (r.status_code == 412)
+            {
+                // Someone else changed the session since it was synced: overwriting it would lose their changes.
+                connections_->release(std::move(connection), options_.maxIdleConnections);
+                GEMINI_ERROR("RemoteStorage Save Error: session {} changed on the server since it was synced", snapshot.id);
+                return false;
+            }
+            if (r.status_code == 404)
+            {
+                // Gone from the server: there is nothing left to overwrite.
+                synced.reset();
+            }
+            else if (r.status_code == 405 || r.status_code == 501)
+            {
+                GEMINI_WARN("Remote storage does not support delta saves (HTTP {}), using full uploads", r.status_code);
+                patchUnsupported_ = true;
+            }
+            else if (r.status_code != 409)
+            {
+                GEMINI_WARN("RemoteStorage delta save failed [{}], retrying with a full upload", r.status_code);
+            }
+        }
+
+        // Replaces the synced version only: a blind PUT is left for sessions the server has no version of.
+        cpr::Header putHeaders = headers;
+        if (synced)
+            putHeaders["If-Match"] = synced->etag;
+        cpr::Response r = sendRequest(*connection, HttpMethod::Put, url, putHeaders, serialize(snapshot), options_, compressionRejected_);
+        connections_->release(std::move(connection), options_.maxIdleConnections);
 
         if (HttpMappedStatusCodeHelper::isSuccess(r.status_code))
+        {
+            remember(responseHeader(r, "ETag"), snapshot);
             return true;
-            
+        }
+        if (synced && r.status_code == 412)
+        {
+            GEMINI_ERROR("RemoteStorage Save Error: session {} changed on the server since it was synced", snapshot.id);
+            return false;
+        }
+
         GEMINI_ERROR("RemoteStorage Save Error [{}]: {}", r.status_code, Utils::parseErrorMessage(r.text));
         return false;
     }
 
+
     Result<ChatSession> RemoteStorage::load(const std::string& sessionId, Client* client)
     {
         std::string url = baseUrl_ + "/chats/" + sessionId;
-            
+
         cpr::Header headers;
         if(!authToken_.empty())
             headers.insert({"Authorization", "Bearer " + authToken_});
 
-        cpr::Response r = cpr::Get(
-            cpr::Url{url},
-            headers,
-            cpr::VerifySsl(false)
-        );
+        std::optional<SyncedVersion> synced;
+        if (options_.conditionalLoads)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (const auto it = synced_.find(sessionId); it != synced_.end())
+            {
+                synced = it->second;
+                headers["If-None-Match"] = synced->etag;
+            }
+        }
+
+        auto connection = connections_->acquire();
+        cpr::Response r = sendRequest(*connection, HttpMethod::Get, url, headers, {}, options_, compressionRejected_);
+        connections_->release(std::move(connection), options_.maxIdleConnections);
+
+        // Unchanged since it was last synced: no body was sent, and the remembered version shares its history.
+        if (r.status_code == 304 && synced)
+            return Result<ChatSession>::Success(ChatSession::fromSnapshot(client, synced->snapshot));
 
         if (HttpMappedStatusCodeHelper::isSuccess(r.status_code))
         {
             try
             {
                 auto j = nlohmann::json::parse(r.text);
-                return Result<ChatSession>::Success(ChatSession::fromJson(client, j));
+                ChatSessionSnapshot snapshot = snapshotFromJson(std::move(j), blobs_.store);
+                if (snapshot.id.empty())
+                    snapshot.id = sessionId;
+                remember(responseHeader(r, "ETag"), snapshot);
+                return Result<ChatSession>::Success(ChatSession::fromSnapshot(client, std::move(snapshot)));
             }
             catch (const std::exception& e)
             {
@@ -216,7 +1054,7 @@ namespace GeminiCPP
         }
 
         std::string errorMsg = Utils::parseErrorMessage(r.text);
-        GEMINI_ERROR("ListModels Error [{}]: {}", r.status_code, errorMsg);
+        GEMINI_ERROR("RemoteStorage Load Error [{}]: {}", r.status_code, errorMsg);
         return Result<ChatSession>::Failure(errorMsg, r.status_code);
     }
 
@@ -229,11 +1067,9 @@ namespace GeminiCPP
         if(!authToken_.empty())
             headers.insert({"Authorization", "Bearer " + authToken_});
 
-        cpr::Response r = cpr::Get(
-            cpr::Url{url},
-            headers,
-            cpr::VerifySsl(false)
-        );
+        auto connection = connections_->acquire();
+        cpr::Response r = sendRequest(*connection, HttpMethod::Get, url, headers, {}, options_, compressionRejected_);
+        connections_->release(std::move(connection), options_.maxIdleConnections);
 
         std::vector<std::string> sessions;
         if (HttpMappedStatusCodeHelper::isSuccess(r.status_code))
@@ -254,5 +1090,70 @@ namespace GeminiCPP
         }
         return sessions;
     }
+
+    std::future<bool> RemoteStorage::saveAsync(const ChatSession& session)
+    {
+        // The snapshot shares the session's history; the delta is computed on the worker thread.
+        ChatSessionSnapshot snapshot = session.snapshot();
+        std::promise<bool> promise;
+        auto future = promise.get_future();
+
+        std::lock_guard<std::mutex> lock(uploadsMutex_);
+        const auto [it, idle] = uploads_.try_emplace(snapshot.id);
+        const std::string sessionId = snapshot.id;
+        it->second.snapshot = std::move(snapshot);
+        it->second.done.push_back(std::move(promise));
+        if (idle)
+            static_cast<void>(uploader_.submit([this, sessionId]() { drainUploads(sessionId); }));
+        return future;
+    }
+
+    void RemoteStorage::drainUploads(const std::string& sessionId)
+    {
+        while (true)
+        {
+            ChatSessionSnapshot snapshot;
+            std::vector<std::promise<bool>> done;
+            {
+                std::lock_guard<std::mutex> lock(uploadsMutex_);
+                const auto it = uploads_.find(sessionId);
+                if (!it->second.snapshot)
+                {
+                    uploads_.erase(it);
+                    return;
+                }
+                snapshot = std::move(*it->second.snapshot);
+                it->second.snapshot.reset();
+                done = std::move(it->second.done);
+                it->second.done.clear();
+            }
+
+            bool saved = false;
+            try
+            {
+                saved = upload(snapshot);
+            }
+            catch (const std::exception& e)
+            {
+                GEMINI_ERROR("RemoteStorage Save Error: {}", e.what());
+            }
+            for (auto& promise : done)
+                promise.set_value(saved);
+        }
+    }
+
+    std::future<Result<ChatSession>> RemoteStorage::loadAsync(const std::string& sessionId, Client* client)
+    {
+        return std::async(std::launch::async, [this, sessionId, client]() {
+            return load(sessionId, client);
+        });
+    }
+
+    std::future<std::vector<std::string>> RemoteStorage::listSessionsAsync()
+    {
+        return std::async(std::launch::async, [this]() {
+            return listSessions();
+        });
+    }
 }
 
@@ -0,0 +1,86 @@
+﻿#include "gemini/thread_pool.h"
+
+#include <algorithm>
+
+namespace GeminiCPP
+{
+    ThreadPool::ThreadPool(size_t threads)
+    {
+        if (threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+
+        workers_.reserve(threads);
+        for (size_t i = 0; i < threads; ++i)
+            workers_.emplace_back([this]() { workerLoop(); });
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+
+        for (auto& worker : workers_)
+        {
+            if (worker.joinable())
+                worker.join();
+        }
+    }
+
+    void ThreadPool::grow(size_t threads)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_)
+            return;
+        for (size_t i = 0; i < threads; ++i)
+            workers_.emplace_back([this]() { workerLoop(); });
+    }
+
+    size_t ThreadPool::threadCount() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return workers_.size();
+    }
+
+    size_t ThreadPool::pending() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return queue_.size();
+    }
+
+    ThreadPool& ThreadPool::shared()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    void ThreadPool::enqueue(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(std::move(task));
+        }
+        cv_.notify_one();
+    }
+
+    void ThreadPool::workerLoop()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+
+                if (queue_.empty())
+                    return; // stopping_ and drained
+
+                task = std::move(queue_.front());
+                queue_.pop_front();
+            }
+            task();
+        }
+    }
+}
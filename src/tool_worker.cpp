@@ -0,0 +1,220 @@
+﻿#include "gemini/tool_worker.h"
+
+#include <algorithm>
+#include <memory>
+#include <optional>
+
+#include "gemini/internal/child_process.h"
+#include "gemini/logger.h"
+
+namespace GeminiCPP
+{
+    namespace
+    {
+        using Internal::ChildProcess;
+
+        /**
+         * @brief Sends one request line and waits for the reply carrying the same id.
+         * @return The reply, or nullopt if the worker died or timed out (it must then be replaced).
+         */
+        std::optional<nlohmann::json> exchange(ChildProcess& process, const nlohmann::json& request, ChildProcess::Clock::time_point deadline,
+                                               const std::string& toolName, bool& timedOut)
+        {
+            timedOut = false;
+            if (!process.writeLine(request.dump()))
+                return std::nullopt;
+
+            std::string line;
+            ChildProcess::ReadStatus status;
+            while ((status = process.readLine(line, deadline)) == ChildProcess::ReadStatus::Line)
+            {
+                nlohmann::json reply = nlohmann::json::parse(line, nullptr, false);
+                if (reply.is_discarded() || !reply.is_object())
+                {
+                    GEMINI_DEBUG("Tool worker {}: {}", toolName, line);
+                    continue;
+                }
+                if (reply.value("id", nlohmann::json()) == request["id"])
+                    return reply;
+            }
+            timedOut = status == ChildProcess::ReadStatus::Timeout;
+            return std::nullopt;
+        }
+
+        /**
+         * @brief Converts the error a worker replied with into the structured function error shape.
+         */
+        nlohmann::json workerError(const nlohmann::json& error)
+        {
+            if (error.is_string())
+                return Internal::functionError("UNKNOWN", error.get<std::string>());
+            if (error.is_object())
+            {
+                const auto status = error.find("status");
+                const auto message = error.find("message");
+                return Internal::functionError(status != error.end() && status->is_string() ? status->get<std::string>() : "UNKNOWN",
+                                               message != error.end() && message->is_string() ? message->get<std::string>() : error.dump());
+            }
+            return Internal::functionError("UNKNOWN", error.dump());
+        }
+    }
+
+    ToolWorkerPool::ToolWorkerPool(std::string toolName, ToolWorkerOptions options)
+        : toolName_(std::move(toolName)), options_(std::move(options))
+    {
+        const size_t workers = std::max<size_t>(options_.workers, 1);
+        threads_.reserve(workers);
+        for (size_t i = 0; i < workers; ++i)
+            threads_.emplace_back([this]() { workerLoop(); });
+    }
+
+    ToolWorkerPool::~ToolWorkerPool()
+    {
+        std::deque<Job> abandoned;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+            abandoned.swap(jobs_);
+        }
+        cv_.notify_all();
+        stopCv_.notify_all();
+
+        for (auto& thread : threads_)
+        {
+            if (thread.joinable())
+                thread.join();
+        }
+
+        for (auto& job : abandoned)
+            job.done(Internal::functionError("CANCELLED", "Tool worker pool " + toolName_ + " was shut down"));
+    }
+
+    void ToolWorkerPool::call(const nlohmann::json& args, Internal::FunctionCompletion done)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!stopping_)
+            {
+                jobs_.push_back(Job{args, std::move(done)});
+                cv_.notify_one();
+                return;
+            }
+        }
+        done(Internal::functionError("CANCELLED", "Tool worker pool " + toolName_ + " was shut down"));
+    }
+
+    size_t ToolWorkerPool::queuedCalls() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return jobs_.size();
+    }
+
+    void ToolWorkerPool::workerLoop()
+    {
+        std::unique_ptr<ChildProcess> process;
+        bool started = false;
+        bool answered = false; // The current process completed an exchange.
+        auto backoff = std::chrono::milliseconds(100);
+        auto lastActivity = ChildProcess::Clock::now();
+
+        while (true)
+        {
+            // Keep a live process ready, so calls do not pay the startup cost.
+            if (!process || !process->running())
+            {
+                if (started)
+                {
+                    if (!answered)
+                    {
+                        // Could not start or died before answering anything: wait, so a broken command does not spin.
+                        std::unique_lock<std::mutex> lock(mutex_);
+                        if (stopCv_.wait_for(lock, backoff, [this]() { return stopping_; }))
+                            return;
+                        backoff = std::min(backoff * 2, options_.maxRestartBackoff);
+                    }
+                    ++restarts_;
+                    GEMINI_WARN("Restarting tool worker: {}", toolName_);
+                }
+                process = ChildProcess::spawn(options_.command);
+                started = true;
+                answered = false;
+                lastActivity = ChildProcess::Clock::now();
+            }
+
+            std::optional<Job> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                const auto wake = [this]() { return stopping_ || !jobs_.empty(); };
+                // Without a process the restart delay above already paced this attempt.
+                if (process && options_.healthCheckInterval.count() > 0)
+                    cv_.wait_until(lock, lastActivity + options_.healthCheckInterval, wake);
+                else if (process)
+                    cv_.wait(lock, wake);
+
+                if (stopping_)
+                    return;
+                if (!jobs_.empty())
+                {
+                    job = std::move(jobs_.front());
+                    jobs_.pop_front();
+                }
+            }
+
+            if (!process)
+            {
+                // Could not start: fail one call per attempt, so callers are not stuck behind a broken command.
+                if (job)
+                    job->done(Internal::functionError("UNAVAILABLE", "Tool worker " + toolName_ + " could not be started"));
+                continue;
+            }
+
+            if (!job)
+            {
+                if (options_.healthCheckInterval.count() == 0 || ChildProcess::Clock::now() < lastActivity + options_.healthCheckInterval)
+                    continue;
+
+                bool timedOut;
+                const nlohmann::json ping{{"id", nextId_++}, {"ping", true}};
+                if (!exchange(*process, ping, ChildProcess::Clock::now() + options_.healthCheckTimeout, toolName_, timedOut))
+                {
+                    GEMINI_WARN("Tool worker {} failed its health check", toolName_);
+                    process.reset();
+                }
+                else
+                {
+                    answered = true;
+                    backoff = std::chrono::milliseconds(100);
+                }
+                lastActivity = ChildProcess::Clock::now();
+                continue;
+            }
+
+            const nlohmann::json request{{"id", nextId_++}, {"name", toolName_}, {"args", job->args}};
+            bool timedOut;
+            const auto reply = exchange(*process, request, ChildProcess::Clock::now() + options_.callTimeout, toolName_, timedOut);
+            lastActivity = ChildProcess::Clock::now();
+
+            if (!reply)
+            {
+                process.reset();
+                if (timedOut)
+                {
+                    GEMINI_WARN("Tool worker {} did not answer within {} ms", toolName_, options_.callTimeout.count());
+                    job->done(Internal::functionError("DEADLINE_EXCEEDED", "Tool worker " + toolName_ + " did not answer in time"));
+                }
+                else
+                {
+                    job->done(Internal::functionError("UNAVAILABLE", "Tool worker " + toolName_ + " exited during the call"));
+                }
+                continue;
+            }
+            answered = true;
+            backoff = std::chrono::milliseconds(100);
+
+            if (const auto error = reply->find("error"); error != reply->end())
+                job->done(workerError(*error));
+            else
+                job->done(reply->value("result", nlohmann::json::object()));
+        }
+    }
+}
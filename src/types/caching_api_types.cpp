@@ -770,7 +770,7 @@ namespace GeminiCPP
             j["displayName"] = displayName;
         }
         
-        if(!ttl.has_value())
+        if(ttl.has_value())
         {
             j["ttl"] = ttl->toJson();
         }
@@ -811,4 +811,19 @@ namespace GeminiCPP
         
         return r;
     }
+
+    nlohmann::json ListCachedContentsResponse::toJson() const
+    {
+        nlohmann::json j;
+        nlohmann::json arr = nlohmann::json::array();
+        for(const auto& c : cachedContents) arr.push_back(c.toJson());
+        j["cachedContents"] = arr;
+        
+        if(!nextPageToken.empty())
+        {
+            j["nextPageToken"] = nextPageToken;
+        }
+        
+        return j;
+    }
 }
@@ -2,6 +2,96 @@
 
 namespace GeminiCPP
 {
+    namespace
+    {
+        // With 'spliced' set, the history and the pre-serialized tools are left out; spliceRequest() adds them.
+        template <typename RequestBody>
+        nlohmann::json requestBodyToJson(const RequestBody& body, bool spliced)
+        {
+            nlohmann::json j = nlohmann::json::object();
+
+            j["contents"] = nlohmann::json::array();
+            if (!spliced)
+            {
+                for (const auto& turn : body.history.turns())
+                    j["contents"].push_back(turn->toJson());
+            }
+            for (const auto& content : body.contents)
+                j["contents"].push_back(content.toJson());
+
+            if (body.tools.has_value())
+            {
+                j["tools"] = nlohmann::json::array();
+                for (const auto& tool : *body.tools)
+                    j["tools"].push_back(tool.toJson());
+            }
+            else if (body.toolsJson && !spliced)
+            {
+                j["tools"] = nlohmann::json::parse(*body.toolsJson);
+            }
+            if (body.toolConfig.has_value())
+            {
+                j["toolConfig"] = body.toolConfig->toJson();
+            }
+            if (body.safetySettings.has_value())
+            {
+                j["safetySettings"] = nlohmann::json::array();
+                for (const auto& safetySetting : *body.safetySettings)
+                    j["safetySettings"].push_back(safetySetting.toJson());
+            }
+            if (body.systemInstruction.has_value())
+            {
+                j["systemInstruction"] = body.systemInstruction->toJson();
+            }
+            if (body.generationConfig.has_value())
+            {
+                j["generationConfig"] = body.generationConfig->toJson();
+            }
+            if (body.cachedContent.has_value())
+            {
+                j["cachedContent"] = body.cachedContent->str();
+            }
+
+            return j;
+        }
+
+        // Builds the final request string: cached history fragments followed by the new turns in 'fields["contents"]',
+        // then the pre-serialized tools (if any) and the remaining fields.
+        template <typename RequestBody>
+        std::string spliceRequest(const RequestBody& body, nlohmann::json fields)
+        {
+            const History& history = body.history;
+            const bool splicedTools = !body.tools.has_value() && body.toolsJson;
+            const std::string fresh = fields["contents"].dump(); // "[...]"
+            fields.erase("contents");
+            const std::string rest = fields.dump();               // "{...}"
+
+            std::string out;
+            out.reserve(history.jsonBytes() + history.size() + fresh.size() + rest.size() + (splicedTools ? body.toolsJson->size() : 0) + 32);
+            out += "{\"contents\":[";
+            history.appendJson(out);
+            if (!history.empty() && fresh.size() > 2)
+                out += ',';
+            out.append(fresh, 1, fresh.size() - 2);
+            out += ']';
+            if (splicedTools)
+            {
+                out += ",\"tools\":";
+                out += *body.toolsJson;
+            }
+            if (rest.size() > 2)
+            {
+                out += ',';
+                out.append(rest, 1, std::string::npos);
+            }
+            else
+            {
+                out += '}';
+            }
+            return out;
+        }
+    }
+
     SafetySetting SafetySetting::fromJson(const nlohmann::json& j)
     {
         SafetySetting result;
@@ -1057,42 +1147,12 @@ namespace GeminiCPP
 
     nlohmann::json GenerateContentRequestBody::toJson() const
     {
-        nlohmann::json j = nlohmann::json::object();
-
-        j["contents"] = nlohmann::json::array();
-        for (const auto& content : contents)
-            j["contents"].push_back(content.toJson());
-
-        if (tools.has_value())
-        {
-            j["tools"] = nlohmann::json::array();
-            for (const auto& tool : *tools)
-                j["tools"].push_back(tool.toJson());
-        }
-        if (toolConfig.has_value())
-        {
-            j["toolConfig"] = toolConfig->toJson();
-        }
-        if (safetySettings.has_value())
-        {
-            j["safetySettings"] = nlohmann::json::array();
-            for (const auto& safetySetting : *safetySettings)
-                j["safetySettings"].push_back(safetySetting.toJson());
-        }
-        if (systemInstruction.has_value())
-        {
-            j["systemInstruction"] = systemInstruction->toJson();
-        }
-        if (generationConfig.has_value())
-        {
-            j["generationConfig"] = generationConfig->toJson();
-        }
-        if (cachedContent.has_value())
-        {
-            j["cachedContent"] = cachedContent->str();
-        }
+        return requestBodyToJson(*this, false);
+    }
 
-        return j;
+    std::string GenerateContentRequestBody::dump() const
+    {
+        return spliceRequest(*this, requestBodyToJson(*this, true));
     }
 
     StreamGenerateContentRequestBody StreamGenerateContentRequestBody::fromJson(const nlohmann::json& j)
@@ -1143,42 +1203,12 @@ namespace GeminiCPP
 
     nlohmann::json StreamGenerateContentRequestBody::toJson() const
     {
-        nlohmann::json j = nlohmann::json::object();
-
-        j["contents"] = nlohmann::json::array();
-        for (const auto& content : contents)
-            j["contents"].push_back(content.toJson());
-
-        if (tools.has_value())
-        {
-            j["tools"] = nlohmann::json::array();
-            for (const auto& tool : *tools)
-                j["tools"].push_back(tool.toJson());
-        }
-        if (toolConfig.has_value())
-        {
-            j["toolConfig"] = toolConfig->toJson();
-        }
-        if (safetySettings.has_value())
-        {
-            j["safetySettings"] = nlohmann::json::array();
-            for (const auto& safetySetting : *safetySettings)
-                j["safetySettings"].push_back(safetySetting.toJson());
-        }
-        if (systemInstruction.has_value())
-        {
-            j["systemInstruction"] = systemInstruction->toJson();
-        }
-        if (generationConfig.has_value())
-        {
-            j["generationConfig"] = generationConfig->toJson();
-        }
-        if (cachedContent.has_value())
-        {
-            j["cachedContent"] = cachedContent->str();
-        }
+        return requestBodyToJson(*this, false);
+    }
 
-        return j;
+    std::string StreamGenerateContentRequestBody::dump() const
+    {
+        return spliceRequest(*this, requestBodyToJson(*this, true));
     }
 
     GenerateContentResponseBody GenerateContentResponseBody::fromJson(const nlohmann::json& j)
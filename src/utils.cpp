@@ -2,20 +2,20 @@
 
 #include <nlohmann/json.hpp>
 
+#include "gemini/internal/file_utils.h"
 #include "gemini/logger.h"
 
 namespace GeminiCPP
 {
     std::string Utils::fileToBase64(const std::string& filepath)
     {
-        std::ifstream file(filepath, std::ios::binary);
-        if (!file.is_open())
+        const auto data = Internal::readFile(filepath);
+        if (!data)
         {
             GEMINI_ERROR("The file could not be read: {}", filepath);
             return "";
         }
-        std::vector<unsigned char> buffer(std::istreambuf_iterator<char>(file), {});
-        return base64Encode(buffer);
+        return base64Encode(std::vector<unsigned char>(data->begin(), data->end()));
     }
 
     std::string Utils::getMimeType(const std::string& filepath)